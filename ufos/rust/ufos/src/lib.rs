@@ -28,9 +28,150 @@ impl UfoCore {
         ct: usize,
         populate: Box<UfoPopulateFn>,
     ) -> Result<UfoHandle, UfoAllocateErr> {
-        let ufo = self.core.allocate_ufo(prototype.new_config(ct, populate))?;
+        self.new_ufo_with_budget(prototype, ct, None, populate)
+    }
+
+    pub fn new_ufo_with_budget(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        budget: Option<Arc<UfoBudget>>,
+        populate: Box<UfoPopulateFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype.new_config(ct, populate).with_budget(budget);
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// A UFO whose chunks are kept in a file, reattached to if it already holds this UFO
+    pub fn new_persistent_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        persistence: UfoPersistence,
+        populate: Box<UfoPopulateFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype
+            .new_config(ct, populate)
+            .with_persistence(Some(persistence));
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// A UFO that hands its dirty chunks back to the source as they are evicted or flushed
+    pub fn new_write_through_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        populate: Box<UfoPopulateFn>,
+        write_through: Box<UfoWriteThroughFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype
+            .new_config(ct, populate)
+            .with_write_through(Some(write_through));
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// A UFO whose source can say a chunk is all zero or a constant, those are never populated
+    pub fn new_filled_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        fill: Box<UfoFillFn>,
+        populate: Box<UfoPopulateFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype.new_config(ct, populate).with_fill(Some(fill));
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// UFOs laid out like `prototype`, one for each element count and populate function, allocated
+    /// in one round trip to the core
+    pub fn new_ufos(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ufos: Vec<(usize, Box<UfoPopulateFn>)>,
+    ) -> Result<Vec<UfoHandle>, UfoAllocateErr> {
+        let configs = ufos
+            .into_iter()
+            .map(|(ct, populate)| prototype.new_config(ct, populate))
+            .collect();
+        let ufos = self.core.allocate_ufos(configs)?;
+        Ok(ufos.into_iter().map(|ufo| UfoHandle { ufo }).collect())
+    }
+
+    /// A UFO loaded in whole huge pages, whatever the core's huge page threshold
+    pub fn new_huge_page_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        populate: Box<UfoPopulateFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype.new_config(ct, populate).with_huge_pages();
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// A UFO whose chunks are populated a few pages at a time by several threads at once
+    pub fn new_parallel_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        populate: Box<UfoPopulateFn>,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        let config = prototype.new_config(ct, populate).with_parallel_populate(true);
+        let ufo = self.core.allocate_ufo(config)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    /// A UFO whose body is read by the core straight from a file
+    pub fn new_file_ufo(
+        &self,
+        prototype: &UfoObjectConfigPrototype,
+        ct: usize,
+        file_source: UfoFileSource,
+    ) -> Result<UfoHandle, UfoAllocateErr> {
+        // never called, the core reads the file itself
+        let populate: Box<UfoPopulateFn> = Box::new(|_, _, _| Err(UfoPopulateError));
+        let config = prototype
+            .new_config(ct, populate)
+            .with_file_source(Some(file_source));
+        let ufo = self.core.allocate_ufo(config)?;
         Ok(UfoHandle { ufo })
     }
+
+    pub fn eviction_stats(&self) -> EvictionStats {
+        self.core.eviction_stats()
+    }
+
+    pub fn config(&self) -> Arc<UfoCoreConfig> {
+        self.core.config()
+    }
+
+    pub fn reconfigure(&self, config: UfoCoreConfig) -> anyhow::Result<()> {
+        self.core.reconfigure(config)
+    }
+
+    pub fn loaded_memory(&self) -> usize {
+        self.core.loaded_memory()
+    }
+
+    pub fn worker_stats(&self) -> WorkerStats {
+        self.core.worker_stats()
+    }
+
+    pub fn stats(&self) -> UfoStats {
+        self.core.stats()
+    }
+
+    pub fn writeback_log_stats(&self) -> WritebackLogStats {
+        self.core.writeback_log_stats()
+    }
+
+    pub fn reset_stats(&self) -> anyhow::Result<()> {
+        self.core.reset_stats()
+    }
 }
 
 impl Drop for UfoCore {
@@ -60,6 +201,72 @@ impl UfoHandle {
         Ok(())
     }
 
+    /// Start populating elements `start..end`, wait on the result to know when they are loaded
+    pub fn prefetch(
+        &self,
+        start: usize,
+        end: usize,
+    ) -> Result<crossbeam::sync::WaitGroup, UfoLookupErr> {
+        self.ufo.read()?.prefetch(start, end)
+    }
+
+    pub fn stats(&self) -> Result<UfoStats, UfoLookupErr> {
+        Ok(self.ufo.read()?.stats())
+    }
+
+    /// Save what changed to the file of a persistent UFO
+    pub fn checkpoint(&self) -> anyhow::Result<()> {
+        self.ufo
+            .read()
+            .map_err(|_| anyhow::anyhow!("lock poisoned"))?
+            .checkpoint()
+    }
+
+    /// Move the UFO into a file of its own, which can be opened again later
+    pub fn persist(&self, persistence: UfoPersistence) -> anyhow::Result<()> {
+        self.ufo
+            .write()
+            .map_err(|_| anyhow::anyhow!("lock poisoned"))?
+            .persist(persistence)
+    }
+
+    /// Write what changed through to the source of a write through UFO
+    pub fn flush(&self) -> anyhow::Result<()> {
+        let core = self
+            .ufo
+            .read()
+            .map_err(|_| anyhow::anyhow!("lock poisoned"))?
+            .core
+            .upgrade()
+            .ok_or_else(|| anyhow::anyhow!("core shut down"))?;
+        core.flush(&self.ufo)
+    }
+
+    /// A copy of the UFO as it is now, sharing its source and written back chunks until either
+    /// of them writes to them
+    pub fn clone_ufo(&self) -> Result<UfoHandle, UfoAllocateErr> {
+        let core = self
+            .ufo
+            .read()
+            .map_err(|_| UfoAllocateErr::CloneError("lock poisoned".to_string()))?
+            .core
+            .upgrade()
+            .ok_or(UfoAllocateErr::MessageSendError)?;
+        let ufo = core.clone_ufo(&self.ufo)?;
+        Ok(UfoHandle { ufo })
+    }
+
+    pub fn set_budget(&self, budget: Option<Arc<UfoBudget>>) -> Result<(), UfoLookupErr> {
+        let core = self
+            .ufo
+            .read()?
+            .core
+            .upgrade()
+            .ok_or(UfoLookupErr::CoreShutdown)?;
+        core.set_budget(&self.ufo, budget);
+        Ok(())
+    }
+
     pub fn free(self) -> Result<(), UfoLookupErr> {
         let waiter = self.ufo.write()?.free()?;
         waiter.wait();
@@ -95,6 +302,7 @@ mod tests {
             writeback_temp_path: "/tmp".to_string(),
             high_watermark: 1024 * 1024 * 1024,
             low_watermark: 512 * 1024 * 1024,
+            ..UfoCoreConfig::default()
         };
         let core = UfoCore::new_ufo_core(config).expect("error getting core");
 
@@ -117,6 +325,7 @@ mod tests {
             writeback_temp_path: "/tmp".to_string(),
             high_watermark: 1024 * 1024 * 1024,
             low_watermark: 512 * 1024 * 1024,
+            ..UfoCoreConfig::default()
         };
         let core = UfoCore::new_ufo_core(config).expect("error getting core");
 
@@ -202,6 +411,1757 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn parallel_ufos() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 64 * 1024 * 1024,
+            low_watermark: 32 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+
+        let ct = 4 * 1024 * 1024;
+        let ufos: Vec<UfoHandle> = (0..8u64)
+            .map(|n| {
+                core.new_ufo(
+                    &prototype,
+                    ct,
+                    Box::new(move |start, end, fill| {
+                        let slice = unsafe {
+                            std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start)
+                        };
+                        for idx in start..end {
+                            slice[idx - start] = idx as u64 * n;
+                        }
+                        Ok(())
+                    }),
+                )
+            })
+            .collect::<Result<_, _>>()?;
+
+        // every thread faults on its own UFO, together they keep the core evicting
+        let threads: Vec<_> = ufos
+            .iter()
+            .enumerate()
+            .map(|(n, o)| {
+                let body = o.body_ptr().unwrap() as usize;
+                std::thread::spawn(move || {
+                    let arr = unsafe { std::slice::from_raw_parts(body as *const u64, ct) };
+                    (0..ct).find(|x| arr[*x] != *x as u64 * n as u64)
+                })
+            })
+            .collect();
+
+        for t in threads {
+            if let Some(x) = t.join().unwrap() {
+                anyhow::bail!("bad value at {}", x);
+            }
+        }
+
+        std::mem::drop(ufos);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn bounded_workers() -> anyhow::Result<()> {
+        anyhow::ensure!(
+            parse_cpu_list("0-2,5,7-8\n")? == vec![0, 1, 2, 5, 7, 8],
+            "cpu list"
+        );
+        anyhow::ensure!(parse_cpu_list("3-1").is_err(), "bad range accepted");
+        anyhow::ensure!(parse_cpu_list("0,1024").is_err(), "cpu past the set accepted");
+        anyhow::ensure!(
+            UfoCore::new_ufo_core(UfoCoreConfig {
+                worker_cpus: vec![4096],
+                ..UfoCoreConfig::default()
+            })
+            .is_err(),
+            "core pinned past the set"
+        );
+
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 64 * 1024 * 1024,
+            low_watermark: 32 * 1024 * 1024,
+            max_workers: 2,
+            worker_cpus: vec![0],
+            worker_idle_timeout: Some(std::time::Duration::from_millis(10)),
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+
+        let ct = 1024 * 1024;
+        let ufos: Vec<UfoHandle> = (0..8u64)
+            .map(|n| {
+                core.new_ufo(
+                    &prototype,
+                    ct,
+                    Box::new(move |start, end, fill| {
+                        let slice = unsafe {
+                            std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start)
+                        };
+                        for idx in start..end {
+                            slice[idx - start] = idx as u64 * n;
+                        }
+                        Ok(())
+                    }),
+                )
+            })
+            .collect::<Result<_, _>>()?;
+
+        let threads: Vec<_> = ufos
+            .iter()
+            .enumerate()
+            .map(|(n, o)| {
+                let body = o.body_ptr().unwrap() as usize;
+                std::thread::spawn(move || {
+                    let arr = unsafe { std::slice::from_raw_parts(body as *const u64, ct) };
+                    (0..ct).find(|x| arr[*x] != *x as u64 * n as u64)
+                })
+            })
+            .collect();
+        for t in threads {
+            if let Some(x) = t.join().unwrap() {
+                anyhow::bail!("bad value at {}", x);
+            }
+        }
+
+        let stats = core.worker_stats();
+        anyhow::ensure!(stats.populate.peak_running <= 2, "{:?}", stats);
+        anyhow::ensure!(stats.prefetch.peak_running <= 2, "{:?}", stats);
+
+        std::mem::drop(ufos);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn nested_populate_past_worker_limit() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 64 * 1024 * 1024,
+            low_watermark: 32 * 1024 * 1024,
+            readahead_depth: 0,
+            max_workers: 1,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+
+        let ct = 1024 * 1024;
+        let inner = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        // the only worker faults on inner while populating outer
+        let inner_body = inner.body_ptr().unwrap() as usize;
+        let outer = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(move |start, end, fill| {
+                let inner = unsafe { std::slice::from_raw_parts(inner_body as *const u64, ct) };
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = inner[idx] * 2;
+                }
+                Ok(())
+            }),
+        )?;
+
+        let arr =
+            unsafe { std::slice::from_raw_parts(outer.body_ptr().unwrap().cast::<u64>(), ct) };
+        if let Some(x) = (0..ct).find(|x| arr[*x] != *x as u64 * 2) {
+            anyhow::bail!("bad value at {}", x);
+        }
+        let stats = core.worker_stats();
+        anyhow::ensure!(stats.populate.spilled > 0, "{:?}", stats);
+
+        std::mem::drop(outer);
+        std::mem::drop(inner);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn readahead_strided() -> anyhow::Result<()> {
+        let ct = 1024 * 1024 * 64;
+        let (core, o) = basic_test_object::<u64>(0, ct, 4096, false)?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // walk every third chunk backwards, then forwards over everything writing as we go
+        for x in (0..ct).rev().step_by(3 * 4096) {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+        }
+
+        for x in 0..ct {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+            arr[x] = 2 * x as u64;
+        }
+
+        for x in 0..ct {
+            if 2 * x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", 2 * x, arr[x]);
+            }
+        }
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn prefetch_range() -> anyhow::Result<()> {
+        let ct = 1024 * 1024 * 16;
+        let (core, o) = basic_test_object::<u64>(0, ct, 4096, false)?;
+
+        o.prefetch(ct / 4, ct / 2)?.wait();
+        // overlapping and out of range requests are fine too
+        o.prefetch(0, ct / 3)?.wait();
+        o.prefetch(ct - 10, ct + 10)?.wait();
+
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in 0..ct {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+        }
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    fn hot_and_cold(policy: UfoEvictionPolicy) -> anyhow::Result<EvictionStats> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 4 * 1024 * 1024,
+            low_watermark: 2 * 1024 * 1024,
+            readahead_depth: 0,
+            eviction_policy: policy,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let chunk = 4096;
+
+        let populate = |slow: bool| -> Box<UfoPopulateFn> {
+            Box::new(move |start, end, fill| {
+                if slow {
+                    std::thread::sleep(std::time::Duration::from_millis(1));
+                }
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            })
+        };
+
+        // a small lookup table which is expensive to build, used between scans over cold data
+        let hot_ct = 4 * chunk;
+        let cold_ct = 64 * 1024 * chunk;
+        let hot = core.new_ufo(&prototype, hot_ct, populate(true))?;
+        let cold = core.new_ufo(&prototype, cold_ct, populate(false))?;
+        let hot_arr =
+            unsafe { std::slice::from_raw_parts(hot.body_ptr().unwrap().cast::<u64>(), hot_ct) };
+        let cold_arr =
+            unsafe { std::slice::from_raw_parts(cold.body_ptr().unwrap().cast::<u64>(), cold_ct) };
+
+        let mut cold_at = 0;
+        for _round in 0..32 {
+            for x in (0..hot_ct).step_by(chunk) {
+                anyhow::ensure!(hot_arr[x] == x as u64, "bad hot value at {}", x);
+            }
+            for _ in 0..64 {
+                anyhow::ensure!(
+                    cold_arr[cold_at] == cold_at as u64,
+                    "bad cold value at {}",
+                    cold_at
+                );
+                cold_at += chunk;
+            }
+        }
+
+        let stats = core.eviction_stats();
+        std::mem::drop(hot);
+        std::mem::drop(cold);
+        std::mem::drop(core);
+        Ok(stats)
+    }
+
+    #[test]
+    fn eviction_policies() -> anyhow::Result<()> {
+        let fifo = hot_and_cold(UfoEvictionPolicy::Fifo)?;
+        let clock = hot_and_cold(UfoEvictionPolicy::Clock)?;
+        let cost_aware = hot_and_cold(UfoEvictionPolicy::CostAware)?;
+
+        for stats in [&fifo, &clock, &cost_aware] {
+            anyhow::ensure!(stats.evicted_chunks > 0, "nothing evicted {:?}", stats);
+        }
+        // FIFO throws the hot chunks out on every sweep
+        anyhow::ensure!(fifo.refaulted_chunks > 0, "{:?}", fifo);
+        anyhow::ensure!(
+            clock.hit_rate() > fifo.hit_rate(),
+            "{:?} vs {:?}",
+            clock,
+            fifo
+        );
+        anyhow::ensure!(
+            cost_aware.hit_rate() > fifo.hit_rate(),
+            "{:?} vs {:?}",
+            cost_aware,
+            fifo
+        );
+
+        Ok(())
+    }
+
+    #[test]
+    fn background_reclaim() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 64 * 1024 * 1024,
+            low_watermark: 16 * 1024 * 1024,
+            background_watermark: Some(24 * 1024 * 1024),
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 64 * 1024 * 1024;
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+
+        let arr = unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in 0..ct {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+        }
+
+        // how often the faulting thread still frees memory itself depends on how many cores we get
+        let stats = core.eviction_stats();
+        anyhow::ensure!(stats.background_reclaims > 0, "{:?}", stats);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn budgets() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 32 * 1024 * 1024,
+            low_watermark: 16 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let fill = || -> Box<UfoPopulateFn> {
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            })
+        };
+
+        let hot_ct = 256 * 1024;
+        let hot = core.new_ufo(&prototype, hot_ct, fill())?;
+        let hot_arr =
+            unsafe { std::slice::from_raw_parts(hot.body_ptr().unwrap().cast::<u64>(), hot_ct) };
+        let sum: u64 = hot_arr.iter().sum();
+
+        // scanning a UFO far bigger than its budget only ever evicts its own chunks
+        let cap = 4 * 1024 * 1024;
+        let budget = UfoBudget::new(cap, 0);
+        let ct = 8 * 1024 * 1024;
+        let o = core.new_ufo_with_budget(&prototype, ct, Some(budget.clone()), fill())?;
+        let arr = unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in 0..ct {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+        }
+        anyhow::ensure!(budget.used() <= cap, "{} over {}", budget.used(), cap);
+
+        let stats = core.eviction_stats();
+        anyhow::ensure!(sum == hot_arr.iter().sum(), "hot data changed");
+        anyhow::ensure!(stats.budget_reclaims > 0, "{:?}", stats);
+        // the core as a whole never ran out so nothing outside the budget was evicted
+        anyhow::ensure!(stats.direct_reclaims == 0, "{:?}", stats);
+        anyhow::ensure!(stats.background_reclaims == 0, "{:?}", stats);
+
+        // UFOs sharing a budget faulted on from several threads at once, each load reserves its
+        // share before the next one checks the cap
+        let shared = UfoBudget::new(cap, 0);
+        let shared_ct = 2 * 1024 * 1024;
+        let ufos: Vec<_> = (0..4)
+            .map(|_| core.new_ufo_with_budget(&prototype, shared_ct, Some(shared.clone()), fill()))
+            .collect::<Result<_, _>>()?;
+        let threads: Vec<_> = ufos
+            .iter()
+            .map(|o| {
+                let body = o.body_ptr().unwrap() as usize;
+                std::thread::spawn(move || {
+                    let arr = unsafe { std::slice::from_raw_parts(body as *const u64, shared_ct) };
+                    (0..shared_ct).find(|x| arr[*x] != *x as u64)
+                })
+            })
+            .collect();
+        for t in threads {
+            if let Some(x) = t.join().unwrap() {
+                anyhow::bail!("bad value at {}", x);
+            }
+        }
+        anyhow::ensure!(shared.used() <= cap, "{} over {}", shared.used(), cap);
+
+        std::mem::drop(ufos);
+        std::mem::drop(o);
+        std::mem::drop(hot);
+        std::mem::drop(core);
+        anyhow::ensure!(budget.used() == 0, "{} still charged", budget.used());
+        anyhow::ensure!(shared.used() == 0, "{} still charged", shared.used());
+        Ok(())
+    }
+
+    #[test]
+    fn reconfigure() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 64 * 1024 * 1024,
+            low_watermark: 48 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 4 * 1024 * 1024;
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+
+        let arr = unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        let sum: u64 = arr.iter().sum();
+        anyhow::ensure!(core.loaded_memory() > 16 * 1024 * 1024, "nothing loaded");
+
+        // shrinking the watermarks evicts straight away
+        let mut config = (*core.config()).clone();
+        config.high_watermark = 16 * 1024 * 1024;
+        config.low_watermark = 8 * 1024 * 1024;
+        config.eviction_policy = UfoEvictionPolicy::Fifo;
+        config.max_workers = 2;
+        core.reconfigure(config)?;
+        anyhow::ensure!(
+            core.loaded_memory() <= 8 * 1024 * 1024,
+            "{} still loaded",
+            core.loaded_memory()
+        );
+        anyhow::ensure!(sum == arr.iter().sum(), "data changed");
+
+        let mut config = (*core.config()).clone();
+        config.low_watermark = config.high_watermark;
+        anyhow::ensure!(core.reconfigure(config).is_err(), "accepted bad watermarks");
+
+        // the chunks of o are 32k, too many for a gap of 16k
+        let mut config = (*core.config()).clone();
+        config.low_watermark = config.high_watermark - 16 * 1024;
+        config.fault_batch_size = 1;
+        anyhow::ensure!(
+            core.reconfigure(config).is_err(),
+            "accepted watermarks a chunk cannot fit"
+        );
+
+        let mut config = (*core.config()).clone();
+        config.background_watermark = Some(config.high_watermark + 1);
+        anyhow::ensure!(
+            core.reconfigure(config).is_err(),
+            "accepted a background watermark past high"
+        );
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn stats() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let fill = || -> Box<UfoPopulateFn> {
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            })
+        };
+
+        let small_ct = 64 * 1024;
+        let small = core.new_ufo(&prototype, small_ct, fill())?;
+        let small_arr = unsafe {
+            std::slice::from_raw_parts(small.body_ptr().unwrap().cast::<u64>(), small_ct)
+        };
+        let sum: u64 = small_arr.iter().sum();
+        anyhow::ensure!(sum == (0..small_ct as u64).sum(), "bad sum {}", sum);
+
+        // written and then pushed out by the scan below, so it comes back from the writeback file
+        let ct = 4 * 1024 * 1024;
+        let o = core.new_ufo(&prototype, ct, fill())?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        arr[0] = 7;
+        for x in 1..ct {
+            if x as u64 != arr[x] {
+                anyhow::bail!("  {} != {}", x, arr[x]);
+            }
+        }
+        // volatile or the compiler answers from the write above
+        let first = unsafe { std::ptr::read_volatile(&arr[0]) };
+        anyhow::ensure!(first == 7, "lost the write");
+
+        let chunks = (ct / 4096) as u64;
+        let small_stats = small.stats()?;
+        anyhow::ensure!(small_stats.populate_calls == 16, "{:?}", small_stats);
+        anyhow::ensure!(
+            small_stats.resident_bytes <= small_ct as u64 * 8,
+            "{:?}",
+            small_stats
+        );
+
+        let ufo_stats = o.stats()?;
+        anyhow::ensure!(ufo_stats.faults >= chunks, "{:?}", ufo_stats);
+        anyhow::ensure!(ufo_stats.readback_hits == 1, "{:?}", ufo_stats);
+        anyhow::ensure!(ufo_stats.writebacks >= 1, "{:?}", ufo_stats);
+        anyhow::ensure!(ufo_stats.freed_chunks > 0, "{:?}", ufo_stats);
+
+        let global = core.stats();
+        anyhow::ensure!(
+            global.populate_calls == small_stats.populate_calls + ufo_stats.populate_calls,
+            "{:?}",
+            global
+        );
+        anyhow::ensure!(
+            global.faults >= ufo_stats.faults + small_stats.faults,
+            "{:?}",
+            global
+        );
+        let load = global.latency(UfoStage::Load);
+        anyhow::ensure!(
+            load.count == global.populate_calls + global.readback_hits,
+            "{:?}",
+            load
+        );
+        anyhow::ensure!(
+            load.p50_ns <= load.p90_ns && load.p90_ns <= load.p99_ns && load.p99_ns <= load.max_ns,
+            "{:?}",
+            load
+        );
+        anyhow::ensure!(
+            global.latency(UfoStage::Copy).count >= load.count,
+            "{:?}",
+            global
+        );
+        anyhow::ensure!(
+            global.latency(UfoStage::Free).count == global.freed_chunks,
+            "{:?}",
+            global
+        );
+
+        core.reset_stats()?;
+        let global = core.stats();
+        anyhow::ensure!(global.faults == 0, "{:?}", global);
+        anyhow::ensure!(global.latency(UfoStage::Load).count == 0, "{:?}", global);
+        anyhow::ensure!(o.stats()?.populate_calls == 0, "not reset");
+        anyhow::ensure!(
+            o.stats()?.resident_bytes > 0,
+            "resident bytes are not a counter"
+        );
+
+        std::mem::drop(o);
+        std::mem::drop(small);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    fn write_and_evict(dirty_tracking: UfoDirtyTracking) -> anyhow::Result<UfoStats> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            dirty_tracking,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 4 * 1024 * 1024;
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // read everything, write to every 64th chunk, then scan again so they all come back
+        for round in 0..2 {
+            for x in 0..ct {
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                let chunk = x / 4096;
+                let expected = if round > 0 && chunk % 64 == 0 && x % 4096 == 7 {
+                    0
+                } else {
+                    x as u64
+                };
+                if v != expected {
+                    anyhow::bail!("  {} != {} @ {}", v, expected, x);
+                }
+                if round == 0 && chunk % 64 == 0 && x % 4096 == 7 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+                }
+            }
+        }
+
+        let stats = o.stats()?;
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(stats)
+    }
+
+    #[test]
+    fn dirty_tracking() -> anyhow::Result<()> {
+        let written = (4 * 1024 * 1024 / 4096 / 64) as u64;
+
+        let hashed = write_and_evict(UfoDirtyTracking::Hash)?;
+        anyhow::ensure!(hashed.latency(UfoStage::Hash).count > 0, "{:?}", hashed);
+        anyhow::ensure!(hashed.writebacks == written, "{:?}", hashed);
+
+        // kernels without write protection fall back to hashing, which the test can't tell apart
+        let protected = write_and_evict(UfoDirtyTracking::WriteProtect)?;
+        if protected.latency(UfoStage::Hash).count == 0 {
+            anyhow::ensure!(protected.writebacks == written, "{:?}", protected);
+            anyhow::ensure!(protected.faults > hashed.faults, "{:?}", protected);
+        }
+        Ok(())
+    }
+
+    fn compressed_write_and_evict(compression: UfoCompression) -> anyhow::Result<UfoStats> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            writeback_compression: compression,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 4 * 1024 * 1024 + 100; // the last chunk is cut short
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // mostly NA, like the vectors this is for. Twice over so some chunks are stored again
+        let expected = |x: usize| if x % 1000 == 0 { x as u64 } else { u64::MAX };
+        for _round in 0..2 {
+            for x in 0..ct {
+                unsafe { std::ptr::write_volatile(&mut arr[x], expected(x)) };
+            }
+            for x in 0..ct {
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != expected(x) {
+                    anyhow::bail!("  {} != {} @ {}", v, expected(x), x);
+                }
+            }
+        }
+
+        let stats = o.stats()?;
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(stats)
+    }
+
+    #[test]
+    fn compressed_writeback() -> anyhow::Result<()> {
+        let raw = compressed_write_and_evict(UfoCompression::None)?;
+        anyhow::ensure!(raw.readback_hits > 0, "{:?}", raw);
+        anyhow::ensure!(raw.compression_ratio() == 1.0, "{:?}", raw);
+
+        for compression in [UfoCompression::Lz4, UfoCompression::Zstd(3)] {
+            let stats = compressed_write_and_evict(compression)?;
+            anyhow::ensure!(stats.readback_hits > 0, "{:?} {:?}", compression, stats);
+            anyhow::ensure!(
+                stats.compression_ratio() > 5.0,
+                "{:?} only compressed {}x",
+                compression,
+                stats.compression_ratio()
+            );
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn shared_writeback_log() -> anyhow::Result<()> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            writeback_compression: UfoCompression::Lz4,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 4 * 1024 * 1024;
+
+        let ufos = (0..4)
+            .map(|_| {
+                core.new_ufo(
+                    &prototype,
+                    ct,
+                    Box::new(|start, end, fill| {
+                        let slice = unsafe {
+                            std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start)
+                        };
+                        slice.fill(0);
+                        Ok(())
+                    }),
+                )
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+
+        for (n, o) in ufos.iter().enumerate() {
+            let arr =
+                unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            for x in (0..ct).step_by(512) {
+                unsafe { std::ptr::write_volatile(&mut arr[x], n as u64) };
+            }
+        }
+        for (n, o) in ufos.iter().enumerate() {
+            let arr =
+                unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            for x in 0..ct {
+                let expected = if x % 512 == 0 { n as u64 } else { 0 };
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != expected {
+                    anyhow::bail!("  {} != {} @ {} in {}", v, expected, x, n);
+                }
+            }
+        }
+
+        // one file for every UFO, holding only the (compressed) chunks written back
+        let written = core.writeback_log_stats();
+        let ufo_bytes = (ufos.len() * ct * size_of::<u64>()) as u64;
+        anyhow::ensure!(written.live_bytes > 0, "{:?}", written);
+        anyhow::ensure!(written.live_bytes * 4 < ufo_bytes, "{:?}", written);
+
+        for o in ufos {
+            o.free()?;
+        }
+        let freed = core.writeback_log_stats();
+        anyhow::ensure!(freed.live_bytes == 0, "{:?}", freed);
+        anyhow::ensure!(freed.file_bytes == 0, "{:?}", freed);
+        anyhow::ensure!(freed.compactions > 0, "{:?}", freed);
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    fn queued_write_and_evict(queue_depth: usize, direct: bool) -> anyhow::Result<WritebackLogStats> {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            writeback_queue_depth: queue_depth,
+            writeback_direct_io: direct,
+            ..UfoCoreConfig::default()
+        };
+        let core = UfoCore::new_ufo_core(config).expect("error getting core");
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 8 * 1024 * 1024;
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // read back straight after writing, some chunks are still queued when they fault again
+        for round in 1..3u64 {
+            for x in 0..ct {
+                unsafe { std::ptr::write_volatile(&mut arr[x], x as u64 * round) };
+            }
+            for x in (0..ct).rev() {
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != x as u64 * round {
+                    anyhow::bail!("  {} != {} @ {}", v, x as u64 * round, x);
+                }
+            }
+        }
+
+        let stats = core.writeback_log_stats();
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(stats)
+    }
+
+    #[test]
+    fn queued_writeback() -> anyhow::Result<()> {
+        let unqueued = queued_write_and_evict(0, false)?;
+        anyhow::ensure!(unqueued.writes > 0, "{:?}", unqueued);
+        anyhow::ensure!(unqueued.submissions == unqueued.writes, "{:?}", unqueued);
+
+        let queued = queued_write_and_evict(64, false)?;
+        anyhow::ensure!(queued.writes > 0, "{:?}", queued);
+        anyhow::ensure!(queued.submissions < queued.writes, "{:?}", queued);
+
+        // falls back to buffered writes on a tmpfs
+        let direct = queued_write_and_evict(64, true)?;
+        anyhow::ensure!(direct.writes > 0, "{:?}", direct);
+        Ok(())
+    }
+
+    fn persistent_core() -> UfoCore {
+        let config = UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            ..UfoCoreConfig::default()
+        };
+        UfoCore::new_ufo_core(config).expect("error getting core")
+    }
+
+    fn persistence(path: &str) -> UfoPersistence {
+        UfoPersistence {
+            path: path.to_string(),
+            identity: "index * 3".to_string(),
+            tag: 7,
+        }
+    }
+
+    #[test]
+    fn persistent_checkpoint_and_reopen() -> anyhow::Result<()> {
+        let path = format!("/tmp/ufo_persistent_{}", std::process::id());
+        let _ = std::fs::remove_file(&path);
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let ct = 4 * 1024 * 1024;
+        let expected = |x: usize| if x % 3 == 0 { x as u64 } else { x as u64 * 3 };
+
+        {
+            let core = persistent_core();
+            let o = core.new_persistent_ufo(
+                &prototype,
+                ct,
+                persistence(&path),
+                Box::new(|start, end, fill| {
+                    let slice =
+                        unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                    for idx in start..end {
+                        slice[idx - start] = idx as u64 * 3;
+                    }
+                    Ok(())
+                }),
+            )?;
+            let arr =
+                unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            for x in (0..ct).step_by(3) {
+                unsafe { std::ptr::write_volatile(&mut arr[x], x as u64) };
+            }
+            o.checkpoint()?;
+        }
+
+        let info = persistent_info(&path)?;
+        anyhow::ensure!(info.header.tag == 7 && info.header.element_ct == ct, "{:?}", info);
+        anyhow::ensure!(info.held_chunks == info.chunk_ct, "{:?}", info);
+
+        // every chunk comes back from the file, the source is never asked
+        let core = persistent_core();
+        let o = core.new_persistent_ufo(
+            &prototype,
+            ct,
+            persistence(&path),
+            Box::new(|_, _, _| Err(UfoPopulateError)),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in 0..ct {
+            let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+            if v != expected(x) {
+                anyhow::bail!("  {} != {} @ {}", v, expected(x), x);
+            }
+        }
+
+        // writes evicted between checkpoints stay out of the file, a reset goes back to it
+        for x in 0..ct {
+            unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+        }
+        o.reset()?;
+        for x in 0..ct {
+            let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+            if v != expected(x) {
+                anyhow::bail!("  {} != {} @ {} after reset", v, expected(x), x);
+            }
+        }
+
+        // the same file cannot be opened as something else
+        let other = UfoPersistence {
+            identity: "index * 4".to_string(),
+            ..persistence(&path)
+        };
+        anyhow::ensure!(core
+            .new_persistent_ufo(&prototype, ct, other, Box::new(|_, _, _| Ok(())))
+            .is_err());
+        // nor opened a second time while a UFO has it
+        anyhow::ensure!(core
+            .new_persistent_ufo(
+                &prototype,
+                ct,
+                persistence(&path),
+                Box::new(|_, _, _| Ok(()))
+            )
+            .is_err());
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        std::fs::remove_file(&path)?;
+        Ok(())
+    }
+
+    #[test]
+    fn persist_existing_ufo() -> anyhow::Result<()> {
+        let path = format!("/tmp/ufo_persist_{}", std::process::id());
+        let _ = std::fs::remove_file(&path);
+        let ct = 2 * 1024 * 1024 + 10;
+        {
+            let (core, o) = basic_test_object::<u64>(0, ct, 4096, false)?;
+            let arr =
+                unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            // only some of it is ever loaded, the rest has to be populated for the file
+            for x in 0..ct / 4 {
+                unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+            }
+            o.persist(persistence(&path))?;
+            std::mem::drop(o);
+            std::mem::drop(core);
+        }
+
+        let info = persistent_info(&path)?;
+        anyhow::ensure!(info.held_chunks == info.chunk_ct, "{:?}", info);
+
+        let core = persistent_core();
+        let prototype = UfoObjectConfigPrototype::new_prototype(
+            0,
+            size_of::<u64>(),
+            Some(info.header.elements_per_chunk),
+            false,
+        );
+        let o = core.new_persistent_ufo(
+            &prototype,
+            info.header.element_ct,
+            persistence(&path),
+            Box::new(|_, _, _| Err(UfoPopulateError)),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in 0..ct {
+            let expected = if x < ct / 4 { 0 } else { x as u64 };
+            let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+            if v != expected {
+                anyhow::bail!("  {} != {} @ {}", v, expected, x);
+            }
+        }
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        std::fs::remove_file(&path)?;
+        Ok(())
+    }
+
+    #[test]
+    fn write_through() -> anyhow::Result<()> {
+        use std::sync::atomic::{AtomicU64, Ordering};
+
+        let ct = 4 * 1024 * 1024;
+        let source: Arc<Vec<AtomicU64>> = Arc::new((0..ct as u64).map(AtomicU64::new).collect());
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        let (read_from, write_to) = (source.clone(), source.clone());
+        let o = core.new_write_through_ufo(
+            &prototype,
+            ct,
+            Box::new(move |start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = read_from[idx].load(Ordering::Relaxed);
+                }
+                Ok(())
+            }),
+            Box::new(move |start, end, data| {
+                let slice = unsafe { std::slice::from_raw_parts::<u64>(data.cast(), end - start) };
+                for idx in start..end {
+                    write_to[idx].store(slice[idx - start], Ordering::Relaxed);
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // twice the high watermark, the first half is evicted by the time we are done
+        for x in (0..ct).step_by(512) {
+            unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+        }
+        anyhow::ensure!(source[0].load(Ordering::Relaxed) == 0, "evicted chunk not written through");
+        anyhow::ensure!(core.writeback_log_stats().live_bytes == 0, "{:?}", core.writeback_log_stats());
+
+        // the source holds the write now, it comes back from there
+        let v = unsafe { std::ptr::read_volatile(&arr[0]) };
+        anyhow::ensure!(v == 0, "{} != 0", v);
+        anyhow::ensure!(unsafe { std::ptr::read_volatile(&arr[1]) } == 1);
+
+        // the last chunk is still loaded, flushing is the only way it reaches the source
+        unsafe { std::ptr::write_volatile(&mut arr[ct - 1], 7) };
+        anyhow::ensure!(source[ct - 1].load(Ordering::Relaxed) == ct as u64 - 1);
+        o.flush()?;
+        anyhow::ensure!(source[ct - 1].load(Ordering::Relaxed) == 7);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn constant_chunks() -> anyhow::Result<()> {
+        let ct = 4 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        // zeros then sevens, the source is never asked for data
+        let o = core.new_filled_ufo(
+            &prototype,
+            ct,
+            Box::new(move |start, _| {
+                if start < ct / 2 {
+                    UfoChunkFill::Zero
+                } else {
+                    UfoChunkFill::Constant(7u64.to_ne_bytes().to_vec())
+                }
+            }),
+            Box::new(|_, _, _| Err(UfoPopulateError)),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        let expected = |x: usize| if x < ct / 2 { 0 } else { 7 };
+
+        // twice the high watermark, so chunks are evicted and loaded again
+        for round in 0..2 {
+            for x in 0..ct {
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                let want = if round > 0 && x % (1024 * 1024) == 3 { 1 } else { expected(x) };
+                if v != want {
+                    anyhow::bail!("  {} != {} @ {}", v, want, x);
+                }
+                if round == 0 && x % (1024 * 1024) == 3 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 1) };
+                }
+            }
+        }
+
+        // only the chunks written to were written back, zero pages included
+        let stats = o.stats()?;
+        anyhow::ensure!(stats.populate_calls == 0, "{:?}", stats);
+        anyhow::ensure!(stats.constant_chunks > (ct / 4096) as u64, "{:?}", stats);
+        anyhow::ensure!(stats.writebacks > 0 && stats.writebacks <= 4, "{:?}", stats);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn clone_copy_on_write() -> anyhow::Result<()> {
+        let ct = 4 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        let o = core.new_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // twice the high watermark, the early writes are in the log by the time we clone
+        for x in (0..ct).step_by(1024) {
+            unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+        }
+        let c = o.clone_ufo()?;
+        let cloned =
+            unsafe { std::slice::from_raw_parts_mut(c.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // neither sees what the other writes afterwards
+        for x in (0..ct).step_by(1024) {
+            unsafe { std::ptr::write_volatile(&mut arr[x + 1], 1) };
+            unsafe { std::ptr::write_volatile(&mut cloned[x + 2], 2) };
+        }
+        for x in 0..ct {
+            let (mut parent, mut clone) = if x % 1024 == 0 { (0, 0) } else { (x as u64, x as u64) };
+            match x % 1024 {
+                1 => parent = 1,
+                2 => clone = 2,
+                _ => {}
+            }
+            let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+            anyhow::ensure!(v == parent, "parent {} != {} @ {}", v, parent, x);
+            let v = unsafe { std::ptr::read_volatile(&cloned[x]) };
+            anyhow::ensure!(v == clone, "clone {} != {} @ {}", v, clone, x);
+        }
+
+        // the chunks still shared outlive the parent
+        o.free()?;
+        for x in (0..ct).step_by(1024) {
+            let v = unsafe { std::ptr::read_volatile(&cloned[x]) };
+            anyhow::ensure!(v == 0, "clone {} != 0 @ {}", v, x);
+        }
+
+        std::mem::drop(c);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn huge_pages() -> anyhow::Result<()> {
+        let ct = 4 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        let o = core.new_huge_page_ufo(
+            &prototype,
+            ct,
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let body = o.body_ptr().unwrap();
+        anyhow::ensure!(body as usize % get_huge_page_size() == 0, "{:?} not aligned", body);
+        let arr = unsafe { std::slice::from_raw_parts_mut(body.cast::<u64>(), ct) };
+
+        // twice the high watermark, so huge chunks are evicted, written back and loaded again
+        for round in 0..2 {
+            for x in 0..ct {
+                let want = if round > 0 && x % 4096 == 5 { 0 } else { x as u64 };
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != want {
+                    anyhow::bail!("  {} != {} @ {}", v, want, x);
+                }
+                if round == 0 && x % 4096 == 5 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 0) };
+                }
+            }
+        }
+
+        // not every kernel can collapse on demand, khugepaged gets to the rest eventually
+        let stats = o.stats()?;
+        anyhow::ensure!(stats.writebacks > 0, "{:?}", stats);
+        println!("huge page chunks {}", stats.huge_page_chunks);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    #[ignore]
+    fn huge_page_scan() -> anyhow::Result<()> {
+        let ct = 256 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), true);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 4 * 1024 * 1024 * 1024,
+            low_watermark: 1024 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        })?;
+
+        // the same scan over 4K and huge pages, a cold pass to load it then a warm one
+        for huge in [false, true] {
+            let populate: Box<UfoPopulateFn> = Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            });
+            let o = if huge {
+                core.new_huge_page_ufo(&prototype, ct, populate)?
+            } else {
+                core.new_ufo(&prototype, ct, populate)?
+            };
+            let arr =
+                unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            for pass in ["cold", "warm"] {
+                let start = std::time::Instant::now();
+                let mut sum = 0u64;
+                for x in (0..ct).step_by(509) {
+                    sum = sum.wrapping_add(unsafe { std::ptr::read_volatile(&arr[x]) });
+                }
+                println!("huge {} {} {:?} ({})", huge, pass, start.elapsed(), sum);
+            }
+            println!("{:?}", o.stats()?);
+            o.free()?;
+        }
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn shared_memory() -> anyhow::Result<()> {
+        let ct = 4 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            backing: UfoBacking::SharedMemory,
+            ..UfoCoreConfig::default()
+        })?;
+        // the config says what new UFOs get, kernels without minor faults leave nothing to test
+        if core.config().backing != UfoBacking::SharedMemory {
+            println!("no minor faults on shared memory, skipped");
+            return Ok(());
+        }
+        // the first quarter is zero and never populated
+        let o = core.new_filled_ufo(
+            &prototype,
+            ct,
+            Box::new(move |start, _| {
+                if start < ct / 4 {
+                    UfoChunkFill::Zero
+                } else {
+                    UfoChunkFill::Data
+                }
+            }),
+            Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        let expected = |x: usize| if x < ct / 4 { 0 } else { x as u64 };
+
+        // twice the high watermark, written chunks are evicted and read back
+        for round in 0..2 {
+            for x in 0..ct {
+                let want = if round > 0 && x % 4096 == 7 { 1 } else { expected(x) };
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != want {
+                    anyhow::bail!("  {} != {} @ {}", v, want, x);
+                }
+                if round == 0 && x % 4096 == 7 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 1) };
+                }
+            }
+        }
+
+        let stats = o.stats()?;
+        anyhow::ensure!(stats.shared_memory_chunks > 0, "{:?}", stats);
+        anyhow::ensure!(stats.readback_hits > 0, "{:?}", stats);
+        anyhow::ensure!(stats.constant_chunks > 0, "{:?}", stats);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn parallel_populate() -> anyhow::Result<()> {
+        use std::sync::atomic::{AtomicUsize, Ordering};
+
+        let ct = 4 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(64 * 1024), false);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            readahead_depth: 0,
+            max_workers: 4,
+            ..UfoCoreConfig::default()
+        })?;
+        let calls = Arc::new(AtomicUsize::new(0));
+        let populate_calls = calls.clone();
+        let o = core.new_parallel_ufo(
+            &prototype,
+            ct,
+            Box::new(move |start, end, fill| {
+                populate_calls.fetch_add(1, Ordering::Relaxed);
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    slice[idx - start] = idx as u64;
+                }
+                Ok(())
+            }),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // twice the high watermark, so parts written back come back whole
+        for round in 0..2 {
+            for x in 0..ct {
+                let want = if round > 0 && x % 4096 == 3 { 3 } else { x as u64 };
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != want {
+                    anyhow::bail!("  {} != {} @ {}", v, want, x);
+                }
+                if round == 0 && x % 4096 == 3 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 3) };
+                }
+            }
+        }
+
+        // four populate threads, so every chunk is split up
+        let chunks = ct / (64 * 1024);
+        let calls = calls.load(Ordering::Relaxed);
+        anyhow::ensure!(calls > chunks, "{} calls for {} chunks", calls, chunks);
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    #[ignore]
+    fn parallel_populate_scan() -> anyhow::Result<()> {
+        let ct = 64 * 1024 * 1024;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(256 * 1024), true);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 4 * 1024 * 1024 * 1024,
+            low_watermark: 1024 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        })?;
+
+        // a source that does real work for every element, eg. decompressing or parsing
+        for parallel in [false, true] {
+            let populate: Box<UfoPopulateFn> = Box::new(|start, end, fill| {
+                let slice =
+                    unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                for idx in start..end {
+                    let mut v = idx as u64;
+                    for _ in 0..64 {
+                        v = v.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407);
+                    }
+                    slice[idx - start] = v;
+                }
+                Ok(())
+            });
+            let o = if parallel {
+                core.new_parallel_ufo(&prototype, ct, populate)?
+            } else {
+                core.new_ufo(&prototype, ct, populate)?
+            };
+            let arr =
+                unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            let start = std::time::Instant::now();
+            let mut sum = 0u64;
+            for x in (0..ct).step_by(509) {
+                sum = sum.wrapping_add(unsafe { std::ptr::read_volatile(&arr[x]) });
+            }
+            println!("parallel {} {:?} ({})", parallel, start.elapsed(), sum);
+            o.free()?;
+        }
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn file_source() -> anyhow::Result<()> {
+        use std::io::Write;
+
+        let ct = 4 * 1024 * 1024;
+        let path = "/tmp/ufo_file_source_test";
+        // a header the body starts after
+        let mut file = std::fs::File::create(path)?;
+        file.write_all(&[0xff; 100])?;
+        for idx in 0..ct as u64 {
+            file.write_all(&(idx * 3).to_ne_bytes())?;
+        }
+        std::mem::drop(file);
+
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        let file_source = UfoFileSource::open(path, 100)?;
+        anyhow::ensure!(file_source.len()? == (ct * size_of::<u64>()) as u64);
+        let o = core.new_file_ufo(&prototype, ct, file_source)?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+
+        // twice the high watermark, written chunks are evicted and read back
+        for round in 0..2 {
+            for x in 0..ct {
+                let want = if round > 0 && x % 4096 == 9 { 1 } else { x as u64 * 3 };
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != want {
+                    anyhow::bail!("  {} != {} @ {}", v, want, x);
+                }
+                if round == 0 && x % 4096 == 9 {
+                    unsafe { std::ptr::write_volatile(&mut arr[x], 1) };
+                }
+            }
+        }
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        std::fs::remove_file(path)?;
+        Ok(())
+    }
+
+    #[test]
+    fn persist_file_ufo() -> anyhow::Result<()> {
+        use std::io::Write;
+
+        let ct = 1024 * 1024;
+        let source_path = format!("/tmp/ufo_persist_file_source_{}", std::process::id());
+        let path = format!("/tmp/ufo_persist_file_{}", std::process::id());
+        let _ = std::fs::remove_file(&path);
+        let mut file = std::fs::File::create(&source_path)?;
+        for idx in 0..ct as u64 {
+            file.write_all(&(idx * 3).to_ne_bytes())?;
+        }
+        std::mem::drop(file);
+
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        {
+            // nothing loaded, every chunk is read from the file for the persistent one
+            let core = persistent_core();
+            let o = core.new_file_ufo(&prototype, ct, UfoFileSource::open(&source_path, 0)?)?;
+            o.persist(persistence(&path))?;
+            std::mem::drop(o);
+            std::mem::drop(core);
+        }
+        std::fs::remove_file(&source_path)?;
+
+        let core = persistent_core();
+        let o = core.new_persistent_ufo(
+            &prototype,
+            ct,
+            persistence(&path),
+            Box::new(|_, _, _| Err(UfoPopulateError)),
+        )?;
+        let arr =
+            unsafe { std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct) };
+        for x in (0..ct).step_by(97) {
+            let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+            if v != x as u64 * 3 {
+                anyhow::bail!("  {} != {} @ {}", v, x * 3, x);
+            }
+        }
+
+        std::mem::drop(o);
+        std::mem::drop(core);
+        std::fs::remove_file(&path)?;
+        Ok(())
+    }
+
+    #[test]
+    fn batch_allocation() -> anyhow::Result<()> {
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = persistent_core();
+        let ufos = core.new_ufos(
+            &prototype,
+            (0..100u64)
+                .map(|n| {
+                    let populate: Box<UfoPopulateFn> = Box::new(move |start, end, fill| {
+                        let slice = unsafe {
+                            std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start)
+                        };
+                        for idx in start..end {
+                            slice[idx - start] = idx as u64 * n;
+                        }
+                        Ok(())
+                    });
+                    (10000 + n as usize, populate)
+                })
+                .collect(),
+        )?;
+        anyhow::ensure!(ufos.len() == 100);
+
+        // in order, each with its own length and source
+        for (n, o) in ufos.iter().enumerate() {
+            let ct = 10000 + n;
+            let arr =
+                unsafe { std::slice::from_raw_parts(o.body_ptr().unwrap().cast::<u64>(), ct) };
+            for x in (0..ct).step_by(97).chain(std::iter::once(ct - 1)) {
+                let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                if v != (x * n) as u64 {
+                    anyhow::bail!("  {} != {} @ {} of {}", v, x * n, x, n);
+                }
+            }
+        }
+
+        // refused as a whole
+        let read_only = UfoObjectConfigPrototype::new_prototype(0, 8, None, true);
+        let persistent = read_only
+            .new_config(1000, Box::new(|_, _, _| Ok(())))
+            .with_persistence(Some(persistence("/tmp/ufo_batch_refused")));
+        anyhow::ensure!(core.core.allocate_ufos(vec![persistent]).is_err());
+
+        for o in ufos {
+            o.free()?;
+        }
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    #[ignore]
+    fn batch_allocation_bench() -> anyhow::Result<()> {
+        let ct = 4000;
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(64, size_of::<u64>(), None, false);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 1024 * 1024 * 1024,
+            low_watermark: 512 * 1024 * 1024,
+            ..UfoCoreConfig::default()
+        })?;
+        let populate = || -> Box<UfoPopulateFn> { Box::new(|_, _, _| Ok(())) };
+
+        // a CSV file with a few thousand columns, one UFO for each
+        let start = std::time::Instant::now();
+        let ufos = (0..ct)
+            .map(|_| core.new_ufo(&prototype, 100000, populate()))
+            .collect::<Result<Vec<_>, _>>()?;
+        println!("one by one {:?}", start.elapsed());
+        for o in ufos {
+            o.free()?;
+        }
+
+        let start = std::time::Instant::now();
+        let ufos = core.new_ufos(&prototype, (0..ct).map(|_| (100000, populate())).collect())?;
+        println!("batched {:?}", start.elapsed());
+        for o in ufos {
+            o.free()?;
+        }
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    fn arena() -> anyhow::Result<()> {
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(0, size_of::<u64>(), Some(4096), false);
+        let core = UfoCore::new_ufo_core(UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 16 * 1024 * 1024,
+            low_watermark: 8 * 1024 * 1024,
+            arena_bytes: 1024 * 1024 * 1024,
+            // a readahead job holding on to a freed UFO would keep its segment from the next one
+            readahead_depth: 0,
+            ..UfoCoreConfig::default()
+        })?;
+        let ct = 10000;
+        let new_ufo = |n: u64| {
+            core.new_ufo(
+                &prototype,
+                ct,
+                Box::new(move |start, end, fill| {
+                    let slice =
+                        unsafe { std::slice::from_raw_parts_mut::<u64>(fill.cast(), end - start) };
+                    for idx in start..end {
+                        slice[idx - start] = idx as u64 + n;
+                    }
+                    Ok(())
+                }),
+            )
+        };
+
+        for round in 0..3u64 {
+            let ufos = (0..100)
+                .map(|n| new_ufo(round * 1000 + n))
+                .collect::<Result<Vec<_>, _>>()?;
+            for (n, o) in ufos.iter().enumerate() {
+                let n = round * 1000 + n as u64;
+                let arr = unsafe {
+                    std::slice::from_raw_parts_mut(o.body_ptr().unwrap().cast::<u64>(), ct)
+                };
+                for x in (0..ct).step_by(97) {
+                    let v = unsafe { std::ptr::read_volatile(&arr[x]) };
+                    if v != x as u64 + n {
+                        anyhow::bail!("  {} != {} @ {} of {}", v, x as u64 + n, x, n);
+                    }
+                    arr[x] = 0;
+                }
+            }
+            for o in ufos {
+                o.free()?;
+            }
+        }
+
+        // the segment is handed out again, holding the new UFO rather than the old writes
+        let first = new_ufo(1)?;
+        let at = first.body_ptr().unwrap();
+        unsafe { std::ptr::write_volatile(at.cast::<u64>(), 0) };
+        first.free()?;
+        let second = new_ufo(2)?;
+        anyhow::ensure!(second.body_ptr().unwrap() == at);
+        let v = unsafe { std::ptr::read_volatile(at.cast::<u64>()) };
+        anyhow::ensure!(v == 2, "{} != 2", v);
+        second.free()?;
+
+        std::mem::drop(core);
+        Ok(())
+    }
+
+    #[test]
+    #[ignore]
+    fn arena_churn() -> anyhow::Result<()> {
+        let prototype =
+            UfoObjectConfigPrototype::new_prototype(64, size_of::<u64>(), None, false);
+        let populate = || -> Box<UfoPopulateFn> { Box::new(|_, _, _| Ok(())) };
+
+        for arena_bytes in [0, 1024 * 1024 * 1024] {
+            let core = UfoCore::new_ufo_core(UfoCoreConfig {
+                writeback_temp_path: "/tmp".to_string(),
+                high_watermark: 1024 * 1024 * 1024,
+                low_watermark: 512 * 1024 * 1024,
+                arena_bytes,
+                ..UfoCoreConfig::default()
+            })?;
+
+            // many short lived vectors, as R makes of intermediate results
+            let start = std::time::Instant::now();
+            for _ in 0..100000 {
+                let o = core.new_ufo(&prototype, 1000, populate())?;
+                unsafe { std::ptr::read_volatile(o.body_ptr().unwrap().cast::<u64>()) };
+                o.free()?;
+            }
+            println!("arena of {} bytes {:?}", arena_bytes, start.elapsed());
+            std::mem::drop(core);
+        }
+        Ok(())
+    }
+
     #[test]
     fn large_load() -> anyhow::Result<()> {
         use stderrlog;
@@ -3,9 +3,13 @@ use std::sync::{Arc, RwLockWriteGuard};
 
 use anyhow::Result;
 
+use crossbeam::sync::WaitGroup;
 use libc::c_void;
 use ufos_core::{
-    UfoCoreConfig, UfoObject, UfoObjectConfigPrototype, UfoPopulateError, WrappedUfoObject,
+    EvictionStats, LatencySnapshot, PoolStats, UfoBacking, UfoChunkFill, UfoCompression,
+    UfoCoreConfig, UfoDirtyTracking, UfoFileSource, UfoFillFn, UfoObject,
+    UfoObjectConfigPrototype, UfoPersistence, UfoPopulateError, UfoStage, UfoWriteThroughError,
+    UfoWriteThroughFn, WrappedUfoObject, WritebackLogStats,
 };
 
 macro_rules! opaque_c_type {
@@ -64,6 +68,389 @@ opaque_c_type!(UfoCore, Arc<ufos_core::UfoCore>);
 
 type UfoPopulateData = *mut c_void;
 type UfoPopulateCallout = extern "C" fn(UfoPopulateData, usize, usize, *mut libc::c_uchar) -> i32;
+type UfoWriteThroughCallout =
+    extern "C" fn(UfoPopulateData, usize, usize, *const libc::c_uchar) -> i32;
+/// Returns one of UfoFill for elements start..end, writing the element for UfoFillConstant
+type UfoFillCallout = extern "C" fn(UfoPopulateData, usize, usize, *mut libc::c_uchar) -> i32;
+
+/// What a UfoFillCallout says a range of elements holds
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub enum UfoFill {
+    /// Anything, the populate function is called for it
+    UfoFillData = 0,
+    UfoFillZero = 1,
+    /// Every element is the one the callout wrote out
+    UfoFillConstant = 2,
+}
+
+#[repr(C)]
+pub struct UfoCoreParameters {
+    pub writeback_temp_path: *const libc::c_char,
+    pub low_water_mark: usize,
+    pub high_water_mark: usize,
+    /// Most faults drained from the kernel in one read, 1 disables batching
+    pub fault_batch_size: usize,
+    /// Chunks read ahead of a sequential or strided walk, 0 disables readahead
+    pub readahead_depth: usize,
+    pub readahead_max_bytes: usize,
+    pub eviction_policy: UfoEvictionPolicy,
+    /// Reclaim starts in the background past this, 0 picks half way between the low and high marks
+    pub background_water_mark: usize,
+    /// Most threads populating (and prefetching) at once, 0 is no limit
+    pub max_workers: usize,
+    /// Cpus the workers are pinned to as a list like "0-3,8", NULL runs them anywhere
+    pub worker_cpus: *const libc::c_char,
+    /// Pin the workers to the cpus of this NUMA node instead, -1 for none
+    pub worker_numa_node: i32,
+    /// Spare workers exit after being idle this long, 0 keeps them around
+    pub worker_idle_timeout_ms: u64,
+    /// Find written chunks by hashing them even where the kernel can write protect them instead
+    pub hash_dirty_tracking: bool,
+    /// How chunks are compressed on their way to the writeback file, for UFOs created from now on
+    pub writeback_compression: UfoWritebackCompression,
+    /// Only for zstd, 1 (fast) to 22 (small), 0 for zstd's default
+    pub writeback_compression_level: i32,
+    /// Evicted chunks queued for a writer thread to write out in batches, 0 writes them one by one
+    pub writeback_queue_depth: usize,
+    /// Write back past the page cache with O_DIRECT, where the file system allows it
+    pub writeback_direct_io: bool,
+    /// UFOs at least this large are loaded as transparent huge pages, 0 for none
+    pub huge_page_min_bytes: usize,
+    /// Load UFOs created from now on into shared memory and map it without copying, where the
+    /// kernel supports userfaultfd minor faults
+    pub shared_memory: bool,
+    /// Address space reserved once for small UFOs to be carved out of, 0 maps each on its own. Fixed
+    /// by the first UFO allocated in it
+    pub arena_bytes: usize,
+}
+
+impl UfoCoreParameters {
+    unsafe fn to_config(&self) -> UfoCoreConfig {
+        let wb = std::ffi::CStr::from_ptr(self.writeback_temp_path)
+            .to_str()
+            .expect("invalid string")
+            .to_string();
+
+        let mut low_water_mark = self.low_water_mark;
+        let mut high_water_mark = self.high_water_mark;
+
+        if low_water_mark > high_water_mark {
+            std::mem::swap(&mut low_water_mark, &mut high_water_mark);
+        }
+        assert!(low_water_mark < high_water_mark);
+
+        UfoCoreConfig {
+            writeback_temp_path: wb,
+            low_watermark: low_water_mark,
+            high_watermark: high_water_mark,
+            fault_batch_size: self.fault_batch_size,
+            readahead_depth: self.readahead_depth,
+            readahead_max_bytes: self.readahead_max_bytes,
+            eviction_policy: self.eviction_policy.into(),
+            background_watermark: match self.background_water_mark {
+                0 => None,
+                mark => Some(mark),
+            },
+            max_workers: self.max_workers,
+            worker_cpus: if !self.worker_cpus.is_null() {
+                let list = std::ffi::CStr::from_ptr(self.worker_cpus)
+                    .to_str()
+                    .expect("invalid string");
+                ufos_core::parse_cpu_list(list).expect("invalid cpu list")
+            } else if self.worker_numa_node >= 0 {
+                ufos_core::numa_node_cpus(self.worker_numa_node as usize).expect("unknown node")
+            } else {
+                Vec::new()
+            },
+            worker_idle_timeout: match self.worker_idle_timeout_ms {
+                0 => None,
+                ms => Some(std::time::Duration::from_millis(ms)),
+            },
+            dirty_tracking: if self.hash_dirty_tracking {
+                UfoDirtyTracking::Hash
+            } else {
+                UfoDirtyTracking::WriteProtect
+            },
+            writeback_compression: match self.writeback_compression {
+                UfoWritebackCompression::UfoCompressNone => UfoCompression::None,
+                UfoWritebackCompression::UfoCompressLz4 => UfoCompression::Lz4,
+                UfoWritebackCompression::UfoCompressZstd => {
+                    UfoCompression::Zstd(self.writeback_compression_level)
+                }
+            },
+            writeback_queue_depth: self.writeback_queue_depth,
+            writeback_direct_io: self.writeback_direct_io,
+            huge_page_min_bytes: self.huge_page_min_bytes,
+            backing: if self.shared_memory {
+                UfoBacking::SharedMemory
+            } else {
+                UfoBacking::Anonymous
+            },
+            arena_bytes: self.arena_bytes,
+        }
+    }
+
+    fn from_config(config: &UfoCoreConfig) -> Self {
+        UfoCoreParameters {
+            writeback_temp_path: b"/tmp/\0".as_ptr().cast(),
+            low_water_mark: config.low_watermark,
+            high_water_mark: config.high_watermark,
+            fault_batch_size: config.fault_batch_size,
+            readahead_depth: config.readahead_depth,
+            readahead_max_bytes: config.readahead_max_bytes,
+            eviction_policy: config.eviction_policy.into(),
+            background_water_mark: config.background_watermark.unwrap_or(0),
+            max_workers: config.max_workers,
+            worker_cpus: std::ptr::null(),
+            worker_numa_node: -1,
+            worker_idle_timeout_ms: config
+                .worker_idle_timeout
+                .map_or(0, |t| t.as_millis() as u64),
+            hash_dirty_tracking: config.dirty_tracking == UfoDirtyTracking::Hash,
+            writeback_compression: match config.writeback_compression {
+                UfoCompression::None => UfoWritebackCompression::UfoCompressNone,
+                UfoCompression::Lz4 => UfoWritebackCompression::UfoCompressLz4,
+                UfoCompression::Zstd(_) => UfoWritebackCompression::UfoCompressZstd,
+            },
+            writeback_compression_level: match config.writeback_compression {
+                UfoCompression::Zstd(level) => level,
+                _ => 0,
+            },
+            writeback_queue_depth: config.writeback_queue_depth,
+            writeback_direct_io: config.writeback_direct_io,
+            huge_page_min_bytes: config.huge_page_min_bytes,
+            shared_memory: config.backing == UfoBacking::SharedMemory,
+            arena_bytes: config.arena_bytes,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub enum UfoWritebackCompression {
+    UfoCompressNone,
+    UfoCompressLz4,
+    UfoCompressZstd,
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub enum UfoEvictionPolicy {
+    UfoEvictFifo,
+    UfoEvictClock,
+    UfoEvictCostAware,
+}
+
+impl From<UfoEvictionPolicy> for ufos_core::UfoEvictionPolicy {
+    fn from(policy: UfoEvictionPolicy) -> Self {
+        match policy {
+            UfoEvictionPolicy::UfoEvictFifo => ufos_core::UfoEvictionPolicy::Fifo,
+            UfoEvictionPolicy::UfoEvictClock => ufos_core::UfoEvictionPolicy::Clock,
+            UfoEvictionPolicy::UfoEvictCostAware => ufos_core::UfoEvictionPolicy::CostAware,
+        }
+    }
+}
+
+impl From<ufos_core::UfoEvictionPolicy> for UfoEvictionPolicy {
+    fn from(policy: ufos_core::UfoEvictionPolicy) -> Self {
+        match policy {
+            ufos_core::UfoEvictionPolicy::Fifo => UfoEvictionPolicy::UfoEvictFifo,
+            ufos_core::UfoEvictionPolicy::Clock => UfoEvictionPolicy::UfoEvictClock,
+            ufos_core::UfoEvictionPolicy::CostAware => UfoEvictionPolicy::UfoEvictCostAware,
+        }
+    }
+}
+
+#[repr(C)]
+pub struct UfoEvictionStats {
+    pub loaded_chunks: u64,
+    pub evicted_chunks: u64,
+    /// Chunks loaded again soon after being evicted
+    pub refaulted_chunks: u64,
+    pub second_chances: u64,
+    pub background_reclaims: u64,
+    pub budget_reclaims: u64,
+    /// Times a faulting thread had to wait for memory to be freed
+    pub direct_reclaims: u64,
+    /// Fraction of loads which were not refaults
+    pub hit_rate: f64,
+}
+
+impl From<EvictionStats> for UfoEvictionStats {
+    fn from(stats: EvictionStats) -> Self {
+        UfoEvictionStats {
+            loaded_chunks: stats.loaded_chunks,
+            evicted_chunks: stats.evicted_chunks,
+            refaulted_chunks: stats.refaulted_chunks,
+            second_chances: stats.second_chances,
+            background_reclaims: stats.background_reclaims,
+            budget_reclaims: stats.budget_reclaims,
+            direct_reclaims: stats.direct_reclaims,
+            hit_rate: stats.hit_rate(),
+        }
+    }
+}
+
+/// Space used by the file every UFO of the core writes back to
+#[repr(C)]
+#[derive(Default)]
+pub struct UfoWritebackLogStats {
+    /// Bytes the file spans, holes included
+    pub file_bytes: u64,
+    /// Bytes holding written back chunks
+    pub live_bytes: u64,
+    pub compactions: u64,
+    pub writes: u64,
+    /// Write calls the writes took, fewer when they were batched
+    pub submissions: u64,
+    /// Writes waiting to reach the file
+    pub queued: u64,
+}
+
+impl From<WritebackLogStats> for UfoWritebackLogStats {
+    fn from(stats: WritebackLogStats) -> Self {
+        UfoWritebackLogStats {
+            file_bytes: stats.file_bytes,
+            live_bytes: stats.live_bytes,
+            compactions: stats.compactions,
+            writes: stats.writes,
+            submissions: stats.submissions,
+            queued: stats.queued,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Default)]
+pub struct UfoPoolStats {
+    pub running: u32,
+    pub idle: u32,
+    /// Requests waiting for a worker
+    pub queued: u32,
+    pub peak_running: u32,
+    pub spawned: u64,
+    pub retired: u64,
+    /// Started past max_workers because every worker was stuck in a populate function
+    pub spilled: u64,
+}
+
+impl From<PoolStats> for UfoPoolStats {
+    fn from(stats: PoolStats) -> Self {
+        UfoPoolStats {
+            running: stats.running,
+            idle: stats.idle,
+            queued: stats.queued,
+            peak_running: stats.peak_running,
+            spawned: stats.spawned,
+            retired: stats.retired,
+            spilled: stats.spilled,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Default)]
+pub struct UfoWorkerStats {
+    pub populate: UfoPoolStats,
+    pub prefetch: UfoPoolStats,
+    pub prefetch_queue_depth: usize,
+}
+
+/// Latencies in nanoseconds, percentiles are accurate to within a quarter
+#[repr(C)]
+#[derive(Default)]
+pub struct UfoLatency {
+    pub count: u64,
+    pub total_ns: u64,
+    pub p50_ns: u64,
+    pub p90_ns: u64,
+    pub p99_ns: u64,
+    pub max_ns: u64,
+}
+
+impl From<&LatencySnapshot> for UfoLatency {
+    fn from(l: &LatencySnapshot) -> Self {
+        UfoLatency {
+            count: l.count,
+            total_ns: l.total_ns,
+            p50_ns: l.p50_ns,
+            p90_ns: l.p90_ns,
+            p99_ns: l.p99_ns,
+            max_ns: l.max_ns,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Default)]
+pub struct UfoStats {
+    pub faults: u64,
+    pub populate_calls: u64,
+    pub readback_hits: u64,
+    /// Chunks loaded without populating, the source said they were zero or a constant
+    pub constant_chunks: u64,
+    /// Chunks mapped as transparent huge pages
+    pub huge_page_chunks: u64,
+    /// Chunks loaded straight into shared memory
+    pub shared_memory_chunks: u64,
+    pub writebacks: u64,
+    pub writeback_bytes: u64,
+    /// Bytes the writebacks took up on disk
+    pub writeback_stored_bytes: u64,
+    /// writeback_bytes over writeback_stored_bytes
+    pub compression_ratio: f64,
+    pub freed_chunks: u64,
+    pub resident_bytes: u64,
+    /// Taking the chunk lock to the data being in the UFO, readback or populate included
+    pub load: UfoLatency,
+    pub populate: UfoLatency,
+    pub copy: UfoLatency,
+    pub hash: UfoLatency,
+    /// Evicting a chunk, writeback included
+    pub free: UfoLatency,
+    pub writeback: UfoLatency,
+    /// Threads stalled freeing memory before they could load
+    pub reclaim: UfoLatency,
+}
+
+impl From<ufos_core::UfoStats> for UfoStats {
+    fn from(stats: ufos_core::UfoStats) -> Self {
+        UfoStats {
+            faults: stats.faults,
+            populate_calls: stats.populate_calls,
+            readback_hits: stats.readback_hits,
+            constant_chunks: stats.constant_chunks,
+            huge_page_chunks: stats.huge_page_chunks,
+            shared_memory_chunks: stats.shared_memory_chunks,
+            writebacks: stats.writebacks,
+            writeback_bytes: stats.writeback_bytes,
+            writeback_stored_bytes: stats.writeback_stored_bytes,
+            compression_ratio: stats.compression_ratio(),
+            freed_chunks: stats.freed_chunks,
+            resident_bytes: stats.resident_bytes,
+            load: stats.latency(UfoStage::Load).into(),
+            populate: stats.latency(UfoStage::Populate).into(),
+            copy: stats.latency(UfoStage::Copy).into(),
+            hash: stats.latency(UfoStage::Hash).into(),
+            free: stats.latency(UfoStage::Free).into(),
+            writeback: stats.latency(UfoStage::Writeback).into(),
+            reclaim: stats.latency(UfoStage::Reclaim).into(),
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn ufo_default_core_parameters() -> UfoCoreParameters {
+    UfoCoreParameters::from_config(&UfoCoreConfig::default())
+}
+
+/// The defaults, but with watermarks sized to the memory available to this process (including
+/// cgroup v2 memory.max and memory.high limits)
+#[no_mangle]
+pub extern "C" fn ufo_system_core_parameters() -> UfoCoreParameters {
+    UfoCoreParameters::from_config(&UfoCoreConfig::default().with_system_watermarks())
+}
 
 impl UfoCore {
     #[no_mangle]
@@ -72,25 +459,19 @@ impl UfoCore {
         low_water_mark: usize,
         high_water_mark: usize,
     ) -> Self {
-        std::panic::catch_unwind(|| {
-            let wb = std::ffi::CStr::from_ptr(writeback_temp_path)
-                .to_str()
-                .expect("invalid string")
-                .to_string();
-
-            let mut low_water_mark = low_water_mark;
-            let mut high_water_mark = high_water_mark;
-
-            if low_water_mark > high_water_mark {
-                std::mem::swap(&mut low_water_mark, &mut high_water_mark);
-            }
-            assert!(low_water_mark < high_water_mark);
+        let parameters = UfoCoreParameters {
+            writeback_temp_path,
+            low_water_mark,
+            high_water_mark,
+            ..ufo_default_core_parameters()
+        };
+        Self::ufo_new_core_with_parameters(&parameters)
+    }
 
-            let config = UfoCoreConfig {
-                writeback_temp_path: wb,
-                low_watermark: low_water_mark,
-                high_watermark: high_water_mark,
-            };
+    #[no_mangle]
+    pub unsafe extern "C" fn ufo_new_core_with_parameters(parameters: &UfoCoreParameters) -> Self {
+        std::panic::catch_unwind(|| {
+            let config = parameters.to_config();
 
             let core = ufos_core::UfoCore::new(config);
             match core {
@@ -104,11 +485,79 @@ impl UfoCore {
     #[no_mangle]
     pub extern "C" fn ufo_core_shutdown(self) {}
 
+    /// Change the parameters of a running core, smaller watermarks take effect immediately
+    #[no_mangle]
+    pub unsafe extern "C" fn ufo_core_reconfigure(&self, parameters: &UfoCoreParameters) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|core| match core.reconfigure(parameters.to_config()) {
+                    Ok(()) => 0,
+                    Err(_) => -1,
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
     #[no_mangle]
     pub extern "C" fn ufo_core_is_error(&self) -> bool {
         self.deref().is_none()
     }
 
+    #[no_mangle]
+    pub extern "C" fn ufo_core_eviction_stats(&self) -> UfoEvictionStats {
+        self.deref()
+            .map(|core| core.eviction_stats())
+            .unwrap_or_default()
+            .into()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn ufo_core_worker_stats(&self) -> UfoWorkerStats {
+        self.deref()
+            .map(|core| {
+                let stats = core.worker_stats();
+                UfoWorkerStats {
+                    populate: stats.populate.into(),
+                    prefetch: stats.prefetch.into(),
+                    prefetch_queue_depth: stats.prefetch_queue_depth,
+                }
+            })
+            .unwrap_or_default()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn ufo_core_writeback_stats(&self) -> UfoWritebackLogStats {
+        self.deref()
+            .map(|core| core.writeback_log_stats().into())
+            .unwrap_or_default()
+    }
+
+    /// Counters and latencies summed over every UFO
+    #[no_mangle]
+    pub extern "C" fn ufo_core_stats(&self) -> UfoStats {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|core| core.stats().into())
+                .unwrap_or_default()
+        })
+        .unwrap_or_default()
+    }
+
+    /// Zero the stats of the core and of every UFO
+    #[no_mangle]
+    pub extern "C" fn ufo_core_reset_stats(&self) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|core| match core.reset_stats() {
+                    Ok(()) => 0,
+                    Err(_) => -1,
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
     #[no_mangle]
     pub extern "C" fn ufo_get_by_address(&self, ptr: *mut libc::c_void) -> UfoObj {
         std::panic::catch_unwind(|| {
@@ -145,6 +594,7 @@ impl UfoCore {
         min_load_ct: libc::size_t,
         read_only: bool,
         ct: libc::size_t,
+        budget: Option<&UfoBudget>,
         callback_data: UfoPopulateData,
         populate: UfoPopulateCallout,
     ) -> UfoObj {
@@ -167,9 +617,70 @@ impl UfoCore {
                     Ok(())
                 }
             };
-            let r = self
-                .deref()
-                .map(move |core| core.allocate_ufo(prototype.new_config(ct, Box::new(populate))));
+            let budget = budget.and_then(UfoBudget::deref).cloned();
+            let r = self.deref().map(move |core| {
+                core.allocate_ufo(
+                    prototype
+                        .new_config(ct, Box::new(populate))
+                        .with_budget(budget),
+                )
+            });
+            match r {
+                Some(Ok(ufo)) => UfoObj::wrap(ufo),
+                _ => UfoObj::none(),
+            }
+        })
+        .unwrap_or_else(|_| UfoObj::none())
+    }
+
+    /// A UFO whose chunks are kept in the file at `path`, which is reattached to if it was made with
+    /// the same `identity` and layout and created otherwise. `tag` is stored for the caller's use
+    #[no_mangle]
+    pub unsafe extern "C" fn ufo_new_persistent(
+        &self,
+        header_size: libc::size_t,
+        stride: libc::size_t,
+        min_load_ct: libc::size_t,
+        ct: libc::size_t,
+        path: *const libc::c_char,
+        identity: *const libc::c_char,
+        tag: u32,
+        callback_data: UfoPopulateData,
+        populate: UfoPopulateCallout,
+    ) -> UfoObj {
+        std::panic::catch_unwind(|| {
+            let min_load_ct = Some(min_load_ct).filter(|x| *x > 0);
+            let prototype =
+                UfoObjectConfigPrototype::new_prototype(header_size, stride, min_load_ct, false);
+            let persistence = UfoPersistence {
+                path: std::ffi::CStr::from_ptr(path)
+                    .to_str()
+                    .expect("invalid string")
+                    .to_string(),
+                identity: std::ffi::CStr::from_ptr(identity)
+                    .to_str()
+                    .expect("invalid string")
+                    .to_string(),
+                tag,
+            };
+
+            let callback_data_int = callback_data as usize;
+            let populate = move |start, end, to_populate| {
+                let ret = populate(callback_data_int as *mut c_void, start, end, to_populate);
+
+                if ret != 0 {
+                    Err(UfoPopulateError)
+                } else {
+                    Ok(())
+                }
+            };
+            let r = self.deref().map(move |core| {
+                core.allocate_ufo(
+                    prototype
+                        .new_config(ct, Box::new(populate))
+                        .with_persistence(Some(persistence)),
+                )
+            });
             match r {
                 Some(Ok(ufo)) => UfoObj::wrap(ufo),
                 _ => UfoObj::none(),
@@ -183,6 +694,7 @@ impl UfoCore {
         &self,
         prototype: &UfoPrototype,
         ct: libc::size_t,
+        budget: Option<&UfoBudget>,
         callback_data: *mut c_void,
         populate: extern "C" fn(*mut c_void, libc::size_t, libc::size_t, *mut libc::c_uchar) -> i32,
     ) -> UfoObj {
@@ -197,11 +709,16 @@ impl UfoCore {
                     Ok(())
                 }
             };
+            let budget = budget.and_then(UfoBudget::deref).cloned();
             let r = self
                 .deref()
                 .zip(prototype.deref())
                 .map(move |(core, prototype)| {
-                    core.allocate_ufo(prototype.new_config(ct, Box::new(populate)))
+                    core.allocate_ufo(
+                        prototype
+                            .new_config(ct, Box::new(populate))
+                            .with_budget(budget),
+                    )
                 });
             match r {
                 Some(Ok(ufo)) => UfoObj::wrap(ufo),
@@ -210,6 +727,136 @@ impl UfoCore {
         })
         .unwrap_or_else(|_| UfoObj::none())
     }
+
+    /// Allocate `n` UFOs in one round trip to the core. UFO i is laid out like `prototypes[i]`,
+    /// holds `cts[i]` elements and is populated by `populates[i]` with `callback_data[i]`. Writes
+    /// them to `out` and returns 0, or allocates none of them and returns -1
+    #[no_mangle]
+    pub unsafe extern "C" fn ufo_new_batch(
+        &self,
+        n: libc::size_t,
+        prototypes: *const UfoPrototype,
+        cts: *const libc::size_t,
+        callback_data: *const UfoPopulateData,
+        populates: *const UfoPopulateCallout,
+        out: *mut UfoObj,
+    ) -> i32 {
+        std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+            if n == 0 {
+                return 0;
+            }
+            let prototypes = std::slice::from_raw_parts(prototypes, n);
+            let cts = std::slice::from_raw_parts(cts, n);
+            let callback_data = std::slice::from_raw_parts(callback_data, n);
+            let populates = std::slice::from_raw_parts(populates, n);
+            let out = std::slice::from_raw_parts_mut(out, n);
+
+            let core = match self.deref() {
+                Some(core) => core,
+                None => return -1,
+            };
+            let mut configs = Vec::with_capacity(n);
+            for i in 0..n {
+                let prototype = match prototypes[i].deref() {
+                    Some(prototype) => prototype,
+                    None => return -1,
+                };
+                let callback_data_int = callback_data[i] as usize;
+                let populate = populates[i];
+                let populate = move |start, end, to_populate| {
+                    let ret = populate(callback_data_int as *mut c_void, start, end, to_populate);
+
+                    if ret != 0 {
+                        Err(UfoPopulateError)
+                    } else {
+                        Ok(())
+                    }
+                };
+                configs.push(prototype.new_config(cts[i], Box::new(populate)));
+            }
+
+            match core.allocate_ufos(configs) {
+                Ok(ufos) => {
+                    for (slot, ufo) in out.iter_mut().zip(ufos) {
+                        std::ptr::write(slot, UfoObj::wrap(ufo));
+                    }
+                    0
+                }
+                Err(_) => -1,
+            }
+        }))
+        .unwrap_or(-1)
+    }
+
+    /// A new UFO holding what `ufo` holds now, populated by the same function with the same data.
+    /// The chunks `ufo` wrote back are shared until either of them writes them again. Persistent
+    /// and write through UFOs cannot be cloned
+    #[no_mangle]
+    pub extern "C" fn ufo_clone(&self, ufo: &UfoObj) -> UfoObj {
+        std::panic::catch_unwind(|| {
+            let r = self
+                .deref()
+                .zip(ufo.deref())
+                .map(|(core, ufo)| core.clone_ufo(ufo));
+            match r {
+                Some(Ok(ufo)) => UfoObj::wrap(ufo),
+                _ => UfoObj::none(),
+            }
+        })
+        .unwrap_or_else(|_| UfoObj::none())
+    }
+}
+
+/// Room for the identity of a persistent UFO in UfoPersistentInfo, with its terminating zero
+pub const UFO_PERSISTENT_IDENTITY_BYTES: usize = 4096;
+
+/// What a persistent UFO file holds, see ufo_persistent_info
+#[repr(C)]
+pub struct UfoPersistentInfo {
+    /// What the file was made from, as given when it was saved
+    pub identity: [libc::c_char; UFO_PERSISTENT_IDENTITY_BYTES],
+    pub stride: usize,
+    pub element_ct: usize,
+    /// Pass as min_load_ct to open the file again
+    pub elements_per_chunk: usize,
+    pub tag: u32,
+    pub chunk_ct: usize,
+    /// Chunks in the file as of its last checkpoint, the rest come from the populate function
+    pub held_chunks: usize,
+}
+
+/// Read the header of a persistent UFO file into `info`, 0 on success
+#[no_mangle]
+pub unsafe extern "C" fn ufo_persistent_info(
+    path: *const libc::c_char,
+    info: &mut UfoPersistentInfo,
+) -> i32 {
+    std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+        let path = std::ffi::CStr::from_ptr(path).to_str().expect("invalid string");
+        match ufos_core::persistent_info(path) {
+            Ok(found) => {
+                let mut identity = [0; UFO_PERSISTENT_IDENTITY_BYTES];
+                let bytes = found.header.identity.as_bytes();
+                bytes
+                    .iter()
+                    .take(UFO_PERSISTENT_IDENTITY_BYTES - 1)
+                    .enumerate()
+                    .for_each(|(i, b)| identity[i] = *b as libc::c_char);
+                *info = UfoPersistentInfo {
+                    identity,
+                    stride: found.header.stride,
+                    element_ct: found.header.element_ct,
+                    elements_per_chunk: found.header.elements_per_chunk,
+                    tag: found.header.tag,
+                    chunk_ct: found.chunk_ct,
+                    held_chunks: found.held_chunks,
+                };
+                0
+            }
+            Err(_) => -1,
+        }
+    }))
+    .unwrap_or(-1)
 }
 
 #[repr(C)]
@@ -247,6 +894,36 @@ impl UfoPrototype {
     pub extern "C" fn ufo_free_prototype(self) {}
 }
 
+#[repr(C)]
+pub struct UfoBudget {
+    ptr: *mut c_void,
+}
+
+opaque_c_type!(UfoBudget, Arc<ufos_core::UfoBudget>);
+
+impl UfoBudget {
+    /// A cap on the memory loaded for the UFOs given this budget, chunks up to the reservation are
+    /// kept over those of other UFOs when the core runs short. One budget can be shared by a group
+    #[no_mangle]
+    pub extern "C" fn ufo_new_budget(cap: libc::size_t, reservation: libc::size_t) -> UfoBudget {
+        Self::wrap(ufos_core::UfoBudget::new(cap, reservation))
+    }
+
+    #[no_mangle]
+    pub extern "C" fn ufo_budget_used(&self) -> libc::size_t {
+        self.deref().map(|b| b.used()).unwrap_or(0)
+    }
+
+    #[no_mangle]
+    pub extern "C" fn ufo_budget_is_error(&self) -> bool {
+        self.deref().is_none()
+    }
+
+    /// UFOs in the budget keep it alive, this only releases the handle
+    #[no_mangle]
+    pub extern "C" fn ufo_free_budget(self) {}
+}
+
 #[repr(C)]
 pub struct UfoObj {
     ptr: *mut c_void,
@@ -254,6 +931,35 @@ pub struct UfoObj {
 
 opaque_c_type!(UfoObj, WrappedUfoObject);
 
+#[repr(C)]
+pub struct UfoPrefetch {
+    ptr: *mut c_void,
+}
+
+opaque_c_type!(UfoPrefetch, WaitGroup);
+
+impl UfoPrefetch {
+    /// Block until every chunk of the prefetch is loaded, this consumes the handle
+    #[no_mangle]
+    pub extern "C" fn ufo_prefetch_wait(self) {
+        std::panic::catch_unwind(|| {
+            let wait_group = self.deref().cloned();
+            std::mem::drop(self);
+            wait_group.map(WaitGroup::wait).unwrap_or(())
+        })
+        .unwrap_or(())
+    }
+
+    /// Let the prefetch carry on without ever waiting for it
+    #[no_mangle]
+    pub extern "C" fn ufo_prefetch_free(self) {}
+
+    #[no_mangle]
+    pub extern "C" fn ufo_prefetch_is_error(&self) -> bool {
+        self.deref().is_none()
+    }
+}
+
 impl UfoObj {
     fn with_ufo<F, T, E>(&self, f: F) -> Option<T>
     where
@@ -266,6 +972,217 @@ impl UfoObj {
         })
     }
 
+    /// Move the UFO into another budget, or out of any with NULL
+    #[no_mangle]
+    pub extern "C" fn ufo_set_budget(&self, budget: Option<&UfoBudget>) -> i32 {
+        std::panic::catch_unwind(|| {
+            let budget = budget.and_then(UfoBudget::deref).cloned();
+            self.deref()
+                .and_then(|ufo| {
+                    let core = ufo.read().ok()?.core.upgrade()?;
+                    core.set_budget(ufo, budget);
+                    Some(0)
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Have dirty chunks written back to the source through `write_through` (given elements start,
+    /// end and their data, 0 on success) rather than to the writeback file. NULL stops that
+    #[no_mangle]
+    pub extern "C" fn ufo_set_write_through(
+        &self,
+        callback_data: UfoPopulateData,
+        write_through: Option<UfoWriteThroughCallout>,
+    ) -> i32 {
+        std::panic::catch_unwind(|| {
+            let callback_data_int = callback_data as usize;
+            let write_through = write_through.map(|write_through| {
+                Box::new(move |start, end, data| {
+                    let ret = write_through(callback_data_int as *mut c_void, start, end, data);
+
+                    if ret != 0 {
+                        Err(UfoWriteThroughError)
+                    } else {
+                        Ok(())
+                    }
+                }) as Box<UfoWriteThroughFn>
+            });
+            self.deref()
+                .map(|ufo| {
+                    match ufo
+                        .write()
+                        .expect("unable to lock UFO")
+                        .set_write_through(write_through)
+                    {
+                        Ok(()) => 0,
+                        Err(_) => -1,
+                    }
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Have `fill` asked what chunks hold before they are populated, chunks of zeros or of a
+    /// constant are loaded without populating them. NULL stops that
+    #[no_mangle]
+    pub extern "C" fn ufo_set_fill(
+        &self,
+        callback_data: UfoPopulateData,
+        fill: Option<UfoFillCallout>,
+    ) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|ufo| {
+                    let mut ufo = ufo.write().expect("unable to lock UFO");
+                    let stride = ufo.config.stride();
+                    let callback_data_int = callback_data as usize;
+                    let fill = fill.map(|fill| {
+                        Box::new(move |start, end| {
+                            let mut element = vec![0u8; stride];
+                            let ret = fill(
+                                callback_data_int as *mut c_void,
+                                start,
+                                end,
+                                element.as_mut_ptr(),
+                            );
+                            match ret {
+                                r if r == UfoFill::UfoFillZero as i32 => UfoChunkFill::Zero,
+                                r if r == UfoFill::UfoFillConstant as i32 => {
+                                    UfoChunkFill::Constant(element)
+                                }
+                                _ => UfoChunkFill::Data,
+                            }
+                        }) as Box<UfoFillFn>
+                    });
+                    ufo.set_fill(fill);
+                    0
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Have each chunk split up and populated on several threads at once, the populate function
+    /// must be safe to call concurrently
+    #[no_mangle]
+    pub extern "C" fn ufo_set_parallel_populate(&self, parallel: bool) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|ufo| {
+                    ufo.write()
+                        .expect("unable to lock UFO")
+                        .set_parallel_populate(parallel);
+                    0
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Have the core read chunks itself from `fd`, starting `offset` bytes in, instead of calling
+    /// the populate function. The core reads from a duplicate of `fd`, the caller may close its
+    /// own. A negative `fd` goes back to the populate function
+    #[no_mangle]
+    pub extern "C" fn ufo_set_file_source(&self, fd: i32, offset: u64) -> i32 {
+        std::panic::catch_unwind(|| {
+            let file_source = if fd < 0 {
+                None
+            } else {
+                match UfoFileSource::from_fd(fd, offset) {
+                    Ok(file_source) => Some(file_source),
+                    Err(_) => return -1,
+                }
+            };
+            self.deref()
+                .map(|ufo| {
+                    ufo.write()
+                        .expect("unable to lock UFO")
+                        .set_file_source(file_source);
+                    0
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Write the dirty chunks of a write through UFO to the source now, 0 on success
+    #[no_mangle]
+    pub extern "C" fn ufo_flush(&self) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .and_then(|ufo| {
+                    let core = ufo.read().ok()?.core.upgrade()?;
+                    Some(match core.flush(ufo) {
+                        Ok(()) => 0,
+                        Err(_) => -1,
+                    })
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Counters and latencies of this UFO alone
+    #[no_mangle]
+    pub extern "C" fn ufo_stats(&self) -> UfoStats {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|ufo| ufo.read().expect("unable to lock UFO").stats().into())
+                .unwrap_or_default()
+        })
+        .unwrap_or_default()
+    }
+
+    /// Save the chunks changed since they were loaded to the file of a persistent UFO, 0 on success
+    #[no_mangle]
+    pub extern "C" fn ufo_checkpoint(&self) -> i32 {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|ufo| match ufo.read().expect("unable to lock UFO").checkpoint() {
+                    Ok(()) => 0,
+                    Err(_) => -1,
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
+    /// Move the UFO into a persistent file at `path`, written out in full so that it can be opened
+    /// later without the populate function. 0 on success
+    #[no_mangle]
+    pub unsafe extern "C" fn ufo_persist(
+        &self,
+        path: *const libc::c_char,
+        identity: *const libc::c_char,
+        tag: u32,
+    ) -> i32 {
+        std::panic::catch_unwind(|| {
+            let persistence = UfoPersistence {
+                path: std::ffi::CStr::from_ptr(path)
+                    .to_str()
+                    .expect("invalid string")
+                    .to_string(),
+                identity: std::ffi::CStr::from_ptr(identity)
+                    .to_str()
+                    .expect("invalid string")
+                    .to_string(),
+                tag,
+            };
+            self.deref()
+                .map(|ufo| {
+                    match ufo.write().expect("unable to lock UFO").persist(persistence) {
+                        Ok(()) => 0,
+                        Err(_) => -1,
+                    }
+                })
+                .unwrap_or(-1)
+        })
+        .unwrap_or(-1)
+    }
+
     #[no_mangle]
     pub unsafe extern "C" fn ufo_reset(&mut self) -> i32 {
         std::panic::catch_unwind(|| {
@@ -295,6 +1212,36 @@ impl UfoObj {
         .unwrap_or_else(|_| std::ptr::null_mut())
     }
 
+    /// Populate elements `start..end` ahead of use. Unless `asynchronous` this only returns once
+    /// they are loaded, either way the handle must be passed to ufo_prefetch_wait or ufo_prefetch_free
+    #[no_mangle]
+    pub extern "C" fn ufo_prefetch(
+        &self,
+        start: usize,
+        end: usize,
+        asynchronous: bool,
+    ) -> UfoPrefetch {
+        std::panic::catch_unwind(|| {
+            self.deref()
+                .map(|ufo| {
+                    ufo.read()
+                        .expect("unable to lock UFO")
+                        .prefetch(start, end)
+                        .expect("unable to prefetch")
+                })
+                .map(|wait_group| {
+                    if asynchronous {
+                        UfoPrefetch::wrap(wait_group)
+                    } else {
+                        wait_group.wait();
+                        UfoPrefetch::wrap(WaitGroup::new())
+                    }
+                })
+                .unwrap_or_else(UfoPrefetch::none)
+        })
+        .unwrap_or_else(|_| UfoPrefetch::none())
+    }
+
     #[no_mangle]
     pub extern "C" fn ufo_free(self) {
         std::panic::catch_unwind(|| {
@@ -311,6 +1258,10 @@ impl UfoObj {
         .unwrap_or(())
     }
 
+    /// Release a handle, such as one from ufo_get_by_address, without freeing the UFO
+    #[no_mangle]
+    pub extern "C" fn ufo_drop_handle(self) {}
+
     #[no_mangle]
     pub extern "C" fn ufo_is_error(&self) -> bool {
         self.deref().is_none()
@@ -0,0 +1,61 @@
+use anyhow::Context;
+use log::debug;
+
+/// Parse a cpu list as the kernel writes them, "0-3,8,10-11"
+pub fn parse_cpu_list(list: &str) -> anyhow::Result<Vec<usize>> {
+    let mut cpus = Vec::new();
+    for part in list.trim().split(',').filter(|p| !p.is_empty()) {
+        let part = part.trim();
+        match part.split_once('-') {
+            Some((from, to)) => {
+                let from: usize = from.parse().with_context(|| format!("bad cpu {}", part))?;
+                let to: usize = to.parse().with_context(|| format!("bad cpu {}", part))?;
+                anyhow::ensure!(from <= to, "bad cpu range {}", part);
+                cpus.extend(from..=to);
+            }
+            None => cpus.push(part.parse().with_context(|| format!("bad cpu {}", part))?),
+        }
+    }
+    cpus.sort_unstable();
+    cpus.dedup();
+    check_cpus(&cpus)?;
+    Ok(cpus)
+}
+
+/// Cpus past what a cpu_set_t can hold cannot be pinned to
+pub(crate) fn check_cpus(cpus: &[usize]) -> anyhow::Result<()> {
+    match cpus.iter().find(|cpu| **cpu >= libc::CPU_SETSIZE as usize) {
+        Some(cpu) => anyhow::bail!(
+            "cpu {} is past the last pinnable cpu {}",
+            cpu,
+            libc::CPU_SETSIZE - 1
+        ),
+        None => Ok(()),
+    }
+}
+
+/// The cpus of a NUMA node
+pub fn numa_node_cpus(node: usize) -> anyhow::Result<Vec<usize>> {
+    let path = format!("/sys/devices/system/node/node{}/cpulist", node);
+    let list = std::fs::read_to_string(&path).with_context(|| format!("reading {}", path))?;
+    parse_cpu_list(&list)
+}
+
+/// Keep the calling thread on these cpus, an empty list leaves it where it is
+pub(crate) fn pin_current_thread(cpus: &[usize]) {
+    if cpus.is_empty() {
+        return;
+    }
+    unsafe {
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        // checked when configured, CPU_SET panics on anything past the set
+        for cpu in cpus.iter().filter(|cpu| **cpu < libc::CPU_SETSIZE as usize) {
+            libc::CPU_SET(*cpu, &mut set);
+        }
+        let r = libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set);
+        if r != 0 {
+            // not worth failing over, the kernel may simply not have these cpus
+            debug!(target: "ufo_core", "could not pin worker to {:?}: {}", cpus, std::io::Error::last_os_error());
+        }
+    }
+}
@@ -0,0 +1,202 @@
+use std::collections::{BTreeMap, BTreeSet};
+use std::sync::{Arc, Mutex};
+
+use log::{debug, error, trace};
+use userfaultfd::Uffd;
+
+use crate::mmap_wrapers::{get_page_size, BaseMmap, MemoryProtectionFlag, Mmap, MmapFlag};
+use crate::return_checks::check_return_zero;
+use crate::uffd_ext::register_write_protect;
+
+/// Address space mapped and registered with userfaultfd once, which small UFOs are carved out of.
+/// Allocating and freeing one of those is then a free list operation rather than an mmap, a
+/// registration, an unregistration and a munmap. The arena is never unregistered or unmapped
+/// while the core runs, freed segments are emptied with MADV_DONTNEED and handed out again
+pub(crate) struct UfoArena {
+    mmap: BaseMmap,
+    /// Registered for write protect faults as well as missing ones
+    write_protect: bool,
+    /// Free extents by offset, adjacent extents are always merged
+    free: Mutex<BTreeMap<usize, usize>>,
+    /// Pages of free extents zero filled to answer a stray fault, emptied before they are handed
+    /// out. Only added to with the free list locked
+    strays: Mutex<BTreeSet<usize>>,
+}
+
+impl UfoArena {
+    pub fn new(uffd: &Uffd, size: usize, write_protect: bool) -> anyhow::Result<Arc<UfoArena>> {
+        let mmap = BaseMmap::new(
+            size,
+            &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
+            &[MmapFlag::Anonymous, MmapFlag::Private, MmapFlag::NoReserve],
+            None,
+        )?;
+        let write_protect = write_protect && register_write_protect(uffd, mmap.as_ptr().cast(), size)?;
+        if !write_protect {
+            uffd.register(mmap.as_ptr().cast(), size)?;
+        }
+        debug!(target: "ufo_core", "arena of {} bytes at {:#x}, write protect {}",
+            size, mmap.as_ptr() as usize, write_protect);
+
+        let mut free = BTreeMap::new();
+        free.insert(0, size);
+        Ok(Arc::new(UfoArena {
+            mmap,
+            write_protect,
+            free: Mutex::new(free),
+            strays: Mutex::new(BTreeSet::new()),
+        }))
+    }
+
+    pub fn write_protect(&self) -> bool {
+        self.write_protect
+    }
+
+    pub fn length(&self) -> usize {
+        self.mmap.length()
+    }
+
+    pub fn contains(&self, addr: usize) -> bool {
+        let start = self.mmap.as_ptr() as usize;
+        (start..start + self.length()).contains(&addr)
+    }
+
+    /// Fault in a page no UFO holds with `answer` to wake whoever touched it, if the page is free.
+    /// Checked and answered under the free list lock, so a segment just taken for a UFO which is
+    /// not looked up by address yet is never filled in ahead of the UFO. The page must not show up
+    /// in the next UFO given that part of the arena. Returns whether the page was free
+    pub fn answer_stray(&self, addr: usize, answer: impl FnOnce()) -> bool {
+        let offset = addr - self.mmap.as_ptr() as usize;
+        let free = self.free.lock().unwrap();
+        let is_free = free
+            .range(..=offset)
+            .next_back()
+            .map_or(false, |(&start, &len)| offset < start + len);
+        if is_free {
+            answer();
+            self.strays.lock().unwrap().insert(offset);
+        }
+        is_free
+    }
+
+    /// A page aligned segment of `len` bytes, the first that fits. None when the arena is full
+    pub fn take(self: &Arc<Self>, len: usize) -> Option<ArenaSegment> {
+        let mut free = self.free.lock().unwrap();
+        let (&offset, &extent) = free.iter().find(|(_, &extent)| extent >= len)?;
+        free.remove(&offset);
+        if extent > len {
+            free.insert(offset + len, extent - len);
+        }
+        drop(free);
+        self.empty_strays(offset, len);
+        trace!(target: "ufo_core", "arena segment {:#x} + {}", offset, len);
+        Some(ArenaSegment {
+            arena: self.clone(),
+            offset,
+            len,
+        })
+    }
+
+    fn empty_strays(&self, offset: usize, len: usize) {
+        let strays = &mut *self.strays.lock().unwrap();
+        let taken: Vec<usize> = strays.range(offset..offset + len).copied().collect();
+        for page in taken {
+            strays.remove(&page);
+            let zapped = unsafe {
+                libc::madvise(
+                    self.mmap.as_ptr().add(page).cast(),
+                    get_page_size(),
+                    libc::MADV_DONTNEED,
+                )
+            };
+            if let Err(e) = check_return_zero(zapped) {
+                error!(target: "ufo_core", "stray arena page {:#x} left in place: {}", page, e);
+            }
+        }
+    }
+
+    fn give_back(&self, offset: usize, len: usize) {
+        // empty it now, the next UFO here starts out with nothing loaded
+        let zapped = unsafe {
+            libc::madvise(
+                self.mmap.as_ptr().add(offset).cast(),
+                len,
+                libc::MADV_DONTNEED,
+            )
+        };
+        if let Err(e) = check_return_zero(zapped) {
+            // handing it out again would show the next UFO what this one held
+            error!(target: "ufo_core", "arena segment {:#x} + {} lost: {}", offset, len, e);
+            return;
+        }
+
+        let free = &mut *self.free.lock().unwrap();
+        let mut start = offset;
+        let mut end = offset + len;
+        if let Some((&before, &before_len)) = free.range(..offset).next_back() {
+            if before + before_len == start {
+                free.remove(&before);
+                start = before;
+            }
+        }
+        if let Some(after_len) = free.remove(&end) {
+            end += after_len;
+        }
+        free.insert(start, end - start);
+    }
+}
+
+/// Part of the arena held by one UFO, handed back when the UFO is dropped
+pub struct ArenaSegment {
+    arena: Arc<UfoArena>,
+    offset: usize,
+    len: usize,
+}
+
+impl ArenaSegment {
+    pub fn as_ptr(&self) -> *mut u8 {
+        unsafe { self.arena.mmap.as_ptr().add(self.offset) }
+    }
+
+    pub fn length(&self) -> usize {
+        self.len
+    }
+
+    /// Whether the arena is registered for write protect faults
+    pub fn write_protect(&self) -> bool {
+        self.arena.write_protect()
+    }
+}
+
+impl Drop for ArenaSegment {
+    fn drop(&mut self) {
+        self.arena.give_back(self.offset, self.len);
+    }
+}
+
+/// Where the memory of a UFO comes from, its own mapping or a segment of the arena
+pub enum UfoMapping {
+    Mmap(BaseMmap),
+    Arena(ArenaSegment),
+}
+
+impl UfoMapping {
+    pub fn as_ptr(&self) -> *mut u8 {
+        match self {
+            UfoMapping::Mmap(mmap) => mmap.as_ptr(),
+            UfoMapping::Arena(segment) => segment.as_ptr(),
+        }
+    }
+
+    pub fn length(&self) -> usize {
+        match self {
+            UfoMapping::Mmap(mmap) => mmap.length(),
+            UfoMapping::Arena(segment) => segment.length(),
+        }
+    }
+
+    /// Registered with the arena, rather than registered and unregistered on its own
+    pub fn in_arena(&self) -> bool {
+        matches!(self, UfoMapping::Arena(_))
+    }
+}
@@ -0,0 +1,84 @@
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+
+/// A cap on the memory loaded for one UFO, or for a group of UFOs sharing the budget. Chunks under
+/// the reservation are the last to go when the core as a whole runs out of memory
+#[derive(Debug)]
+pub struct UfoBudget {
+    pub cap: usize,
+    pub reservation: usize,
+    // charged and settled with the core's chunk lock held, atomic so that it can be read and
+    // reservations refunded without it
+    used: AtomicUsize,
+}
+
+impl UfoBudget {
+    pub fn new(cap: usize, reservation: usize) -> Arc<UfoBudget> {
+        Arc::new(UfoBudget {
+            cap,
+            reservation: std::cmp::min(cap, reservation),
+            used: AtomicUsize::new(0),
+        })
+    }
+
+    pub fn used(&self) -> usize {
+        self.used.load(Ordering::Relaxed)
+    }
+
+    /// Charge bytes about to be loaded up front, so that loads made at the same time each see the
+    /// others' share when they check the cap
+    pub(crate) fn reserve(self: &Arc<Self>, bytes: usize) -> UfoBudgetReservation {
+        self.charge(bytes);
+        UfoBudgetReservation {
+            budget: self.clone(),
+            bytes,
+        }
+    }
+
+    pub(crate) fn charge(&self, bytes: usize) {
+        self.used.fetch_add(bytes, Ordering::Relaxed);
+    }
+
+    pub(crate) fn refund(&self, bytes: usize) {
+        self.used.fetch_sub(bytes, Ordering::Relaxed);
+    }
+
+    pub(crate) fn within_reservation(&self) -> bool {
+        self.used() <= self.reservation
+    }
+
+    /// Like the global watermarks trim a quarter off so we don't come straight back here
+    pub(crate) fn trim_target(&self, to_load: usize) -> usize {
+        std::cmp::min(self.cap - self.cap / 4, self.cap.saturating_sub(to_load))
+    }
+}
+
+/// Bytes charged to a budget ahead of a load. Chunks loaded against it take their share over as
+/// they are added, whatever is left (a chunk already resident, a failed load) is refunded on drop
+#[derive(Debug)]
+pub(crate) struct UfoBudgetReservation {
+    budget: Arc<UfoBudget>,
+    bytes: usize,
+}
+
+impl UfoBudgetReservation {
+    pub(crate) fn budget(&self) -> &Arc<UfoBudget> {
+        &self.budget
+    }
+
+    /// Settle up to `bytes` of a chunk charged to `budget`, returns what is left to charge
+    pub(crate) fn settle(&mut self, budget: &Arc<UfoBudget>, bytes: usize) -> usize {
+        if !Arc::ptr_eq(&self.budget, budget) {
+            return bytes;
+        }
+        let settled = std::cmp::min(self.bytes, bytes);
+        self.bytes -= settled;
+        bytes - settled
+    }
+}
+
+impl Drop for UfoBudgetReservation {
+    fn drop(&mut self) {
+        self.budget.refund(self.bytes);
+    }
+}
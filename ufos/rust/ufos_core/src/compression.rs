@@ -0,0 +1,39 @@
+use anyhow::Result;
+
+/// How chunks written back to disk are compressed
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UfoCompression {
+    /// Chunks are written as they are
+    None,
+    /// Fast enough to keep up with most populate functions
+    Lz4,
+    /// Level 1 (fast) to 22 (small), 0 is zstd's default
+    Zstd(i32),
+}
+
+impl UfoCompression {
+    /// The compressed data, None when it would not get any smaller (or we are not compressing)
+    pub(crate) fn compress(&self, data: &[u8]) -> Result<Option<Vec<u8>>> {
+        let compressed = match self {
+            UfoCompression::None => return Ok(None),
+            UfoCompression::Lz4 => lz4_flex::block::compress(data),
+            UfoCompression::Zstd(level) => zstd::bulk::compress(data, *level)?,
+        };
+        Ok(Some(compressed).filter(|c| c.len() < data.len()))
+    }
+
+    /// Inflate a chunk into `out`, which must be large enough for the whole chunk
+    pub(crate) fn decompress(&self, compressed: &[u8], out: &mut [u8]) -> Result<()> {
+        match self {
+            UfoCompression::None => anyhow::bail!("chunk was not compressed"),
+            UfoCompression::Lz4 => {
+                lz4_flex::block::decompress_into(compressed, out)
+                    .map_err(|e| anyhow::anyhow!("lz4: {}", e))?;
+            }
+            UfoCompression::Zstd(_) => {
+                zstd::bulk::decompress_to_buffer(compressed, out)?;
+            }
+        }
+        Ok(())
+    }
+}
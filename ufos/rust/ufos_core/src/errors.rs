@@ -36,6 +36,10 @@ pub enum UfoAllocateErr {
     MessageSendError,
     #[error("Could not recieve message")]
     MessageRecvError,
+    #[error("Could not open the persistent store, {0}")]
+    PersistenceError(String),
+    #[error("Could not clone the Ufo, {0}")]
+    CloneError(String),
 }
 
 impl<T> From<std::sync::mpsc::SendError<T>> for UfoAllocateErr {
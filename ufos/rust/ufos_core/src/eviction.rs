@@ -0,0 +1,277 @@
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap, VecDeque};
+
+use super::ufo_objects::{UfoChunk, UfoId};
+
+/// How the core picks chunks to evict once the high watermark is reached
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UfoEvictionPolicy {
+    /// Oldest loaded chunk first
+    Fifo,
+    /// Second chance for chunks seen in use, or which were evicted and then faulted back in
+    Clock,
+    /// Prefer evicting chunks which were cheap to populate
+    CostAware,
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct EvictionStats {
+    pub loaded_chunks: u64,
+    pub evicted_chunks: u64,
+    /// Loads of a chunk which was evicted not long before, these are the policy's mistakes
+    pub refaulted_chunks: u64,
+    /// Times a chunk was picked for eviction but kept because it was in use
+    pub second_chances: u64,
+    /// Rounds of eviction run by the reclaimer thread
+    pub background_reclaims: u64,
+    /// Times a thread had to free memory itself before it could load a chunk
+    pub direct_reclaims: u64,
+    /// Rounds of eviction confined to a UFO budget which reached its cap
+    pub budget_reclaims: u64,
+}
+
+impl EvictionStats {
+    /// Fraction of loads which were not refaults of something we evicted
+    pub fn hit_rate(&self) -> f64 {
+        if self.loaded_chunks == 0 {
+            1.0
+        } else {
+            1.0 - self.refaulted_chunks as f64 / self.loaded_chunks as f64
+        }
+    }
+}
+
+pub(crate) trait EvictionPolicy: Send {
+    fn add(&mut self, chunk: UfoChunk);
+    /// Pick a victim among the chunks `eligible` accepts
+    fn evict(
+        &mut self,
+        stats: &mut EvictionStats,
+        eligible: &dyn Fn(&UfoChunk) -> bool,
+    ) -> Option<UfoChunk>;
+    fn retain(&mut self, keep: &mut dyn FnMut(&mut UfoChunk) -> bool);
+    /// Every chunk, for handing them over to another policy
+    fn drain(&mut self) -> Vec<UfoChunk>;
+}
+
+pub(crate) fn new_policy(kind: UfoEvictionPolicy) -> Box<dyn EvictionPolicy> {
+    match kind {
+        UfoEvictionPolicy::Fifo => Box::new(Fifo {
+            chunks: VecDeque::new(),
+        }),
+        UfoEvictionPolicy::Clock => Box::new(Clock {
+            chunks: VecDeque::new(),
+        }),
+        UfoEvictionPolicy::CostAware => Box::new(CostAware {
+            chunks: BinaryHeap::new(),
+            inflation: 0,
+            seq: 0,
+        }),
+    }
+}
+
+// Refaults saturate here so a chunk never lives through more sweeps than this without being used
+const MAX_CREDIT: u8 = 7;
+
+struct Fifo {
+    chunks: VecDeque<UfoChunk>,
+}
+
+impl EvictionPolicy for Fifo {
+    fn add(&mut self, chunk: UfoChunk) {
+        self.chunks.push_back(chunk);
+    }
+
+    fn evict(
+        &mut self,
+        _stats: &mut EvictionStats,
+        eligible: &dyn Fn(&UfoChunk) -> bool,
+    ) -> Option<UfoChunk> {
+        let idx = self.chunks.iter().position(|c| eligible(c))?;
+        self.chunks.remove(idx)
+    }
+
+    fn retain(&mut self, keep: &mut dyn FnMut(&mut UfoChunk) -> bool) {
+        self.chunks.retain_mut(|c| keep(c));
+    }
+
+    fn drain(&mut self) -> Vec<UfoChunk> {
+        self.chunks.drain(..).collect()
+    }
+}
+
+// User space cannot read the accessed bits of the page table, instead a chunk is marked referenced
+// when the core sees it asked for again while resident (by readahead, a prefetch or a racing
+// fault). Chunks which come back soon after being evicted start with credit for every time that
+// happened, a hot chunk which is never seen in use again still ends up sticking around.
+struct Clock {
+    chunks: VecDeque<(UfoChunk, u8)>,
+}
+
+impl EvictionPolicy for Clock {
+    fn add(&mut self, chunk: UfoChunk) {
+        let credit = chunk.refaults();
+        self.chunks.push_back((chunk, credit));
+    }
+
+    fn evict(
+        &mut self,
+        stats: &mut EvictionStats,
+        eligible: &dyn Fn(&UfoChunk) -> bool,
+    ) -> Option<UfoChunk> {
+        // every pass over an eligible chunk takes credit away, by then we have found one or there are none
+        let mut steps = self.chunks.len() * (MAX_CREDIT as usize + 2);
+        while let Some((chunk, credit)) = self.chunks.pop_front() {
+            if steps == 0 {
+                self.chunks.push_front((chunk, credit));
+                return None;
+            }
+            steps -= 1;
+            if !eligible(&chunk) {
+                self.chunks.push_back((chunk, credit));
+                continue;
+            }
+            let credit = credit + chunk.take_referenced() as u8;
+            if credit == 0 || chunk.size() == 0 {
+                return Some(chunk);
+            }
+            stats.second_chances += 1;
+            self.chunks.push_back((chunk, credit - 1));
+        }
+        None
+    }
+
+    fn retain(&mut self, keep: &mut dyn FnMut(&mut UfoChunk) -> bool) {
+        self.chunks.retain_mut(|(c, _)| keep(c));
+    }
+
+    fn drain(&mut self) -> Vec<UfoChunk> {
+        self.chunks.drain(..).map(|(c, _)| c).collect()
+    }
+}
+
+// GreedyDual: a chunk is worth what it cost to populate (per page) on top of the value of the last
+// chunk evicted, so cheap chunks go first but everything ages as the inflation grows
+struct CostAware {
+    chunks: BinaryHeap<Reverse<CostEntry>>,
+    inflation: u64,
+    seq: u64,
+}
+
+struct CostEntry {
+    priority: u64,
+    seq: u64,
+    chunk: UfoChunk,
+}
+
+impl PartialEq for CostEntry {
+    fn eq(&self, other: &Self) -> bool {
+        (self.priority, self.seq) == (other.priority, other.seq)
+    }
+}
+
+impl Eq for CostEntry {}
+
+impl PartialOrd for CostEntry {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl Ord for CostEntry {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        (self.priority, self.seq).cmp(&(other.priority, other.seq))
+    }
+}
+
+impl CostAware {
+    fn push(&mut self, chunk: UfoChunk, weight: u64) {
+        let pages = std::cmp::max(1, chunk.size() / 4096) as u64;
+        let cost = chunk.populate_cost_ns() / pages;
+        self.seq += 1;
+        self.chunks.push(Reverse(CostEntry {
+            priority: self.inflation + cost * weight,
+            seq: self.seq,
+            chunk,
+        }));
+    }
+}
+
+impl EvictionPolicy for CostAware {
+    fn add(&mut self, chunk: UfoChunk) {
+        let weight = 1 + chunk.refaults() as u64;
+        self.push(chunk, weight);
+    }
+
+    fn evict(
+        &mut self,
+        stats: &mut EvictionStats,
+        eligible: &dyn Fn(&UfoChunk) -> bool,
+    ) -> Option<UfoChunk> {
+        let mut skipped = Vec::new();
+        let mut victim = None;
+        while let Some(Reverse(entry)) = self.chunks.pop() {
+            if !eligible(&entry.chunk) {
+                skipped.push(Reverse(entry));
+                continue;
+            }
+            self.inflation = std::cmp::max(self.inflation, entry.priority);
+            if entry.chunk.size() > 0 && entry.chunk.take_referenced() {
+                stats.second_chances += 1;
+                self.push(entry.chunk, 1);
+                continue;
+            }
+            victim = Some(entry.chunk);
+            break;
+        }
+        self.chunks.extend(skipped);
+        victim
+    }
+
+    fn retain(&mut self, keep: &mut dyn FnMut(&mut UfoChunk) -> bool) {
+        let mut chunks = std::mem::take(&mut self.chunks).into_vec();
+        chunks.retain_mut(|Reverse(e)| keep(&mut e.chunk));
+        self.chunks = chunks.into();
+    }
+
+    fn drain(&mut self) -> Vec<UfoChunk> {
+        self.chunks.drain().map(|Reverse(e)| e.chunk).collect()
+    }
+}
+
+/// The most recently evicted chunks, so that we notice when one is faulted straight back in
+pub(crate) struct EvictionHistory {
+    order: VecDeque<(UfoId, usize, u64)>,
+    refaults: HashMap<(UfoId, usize, u64), u8>,
+}
+
+// Enough to cover a few sweeps of small chunks without holding on to much memory
+const EVICTION_HISTORY: usize = 64 * 1024;
+
+impl EvictionHistory {
+    pub fn new() -> Self {
+        EvictionHistory {
+            order: VecDeque::new(),
+            refaults: HashMap::new(),
+        }
+    }
+
+    pub fn evicted(&mut self, chunk: &UfoChunk) {
+        let key = chunk.history_key();
+        if self.refaults.insert(key, chunk.refaults()).is_none() {
+            self.order.push_back(key);
+        }
+        while self.order.len() > EVICTION_HISTORY {
+            let old = self.order.pop_front().unwrap();
+            self.refaults.remove(&old);
+        }
+    }
+
+    /// If this chunk was evicted recently return how often it has come back, including now
+    pub fn loaded(&mut self, chunk: &UfoChunk) -> Option<u8> {
+        // the entry in order stays behind, at worst it makes us forget a later eviction early
+        self.refaults
+            .remove(&chunk.history_key())
+            .map(|r| std::cmp::min(r + 1, MAX_CREDIT))
+    }
+}
@@ -0,0 +1,49 @@
+use std::os::unix::io::RawFd;
+
+use anyhow::Result;
+use log::debug;
+
+use crate::mmap_wrapers::OpenFile;
+use crate::return_checks::check_return_zero;
+use crate::writeback_log::read_at;
+
+/// A source whose body is the bytes of a file from some offset on, read by the core itself with
+/// pread instead of calling out to a populate function. Reads are safe from any thread
+pub struct UfoFileSource {
+    file: OpenFile,
+    offset: u64,
+}
+
+impl UfoFileSource {
+    /// Read from a duplicate of `fd`, the caller still owns and closes `fd`
+    pub fn from_fd(fd: RawFd, offset: u64) -> Result<UfoFileSource> {
+        let file = OpenFile::dup(fd)?;
+        debug!(target: "ufo_object", "file source on {} from {}", file.as_fd(), offset);
+        Ok(UfoFileSource { file, offset })
+    }
+
+    pub fn open(path: &str, offset: u64) -> Result<UfoFileSource> {
+        let file = OpenFile::open(path, libc::O_RDONLY | libc::O_CLOEXEC)?;
+        debug!(target: "ufo_object", "file source {} from {}", path, offset);
+        Ok(UfoFileSource { file, offset })
+    }
+
+    /// Bytes in the file past the offset, a body longer than this cannot be populated in full
+    pub fn len(&self) -> Result<u64> {
+        let mut stat: libc::stat64 = unsafe { std::mem::zeroed() };
+        check_return_zero(unsafe { libc::fstat64(self.file.as_fd(), &mut stat) })?;
+        Ok((stat.st_size as u64).saturating_sub(self.offset))
+    }
+
+    /// Fill `out` with the bytes `at` bytes into the body
+    pub(crate) fn read(&self, at: u64, out: &mut [u8]) -> Result<()> {
+        let read = read_at(&self.file, out, self.offset + at)?;
+        anyhow::ensure!(
+            read == out.len(),
+            "file source ends {} bytes into the body, {} wanted",
+            at + read as u64,
+            at + out.len() as u64
+        );
+        Ok(())
+    }
+}
@@ -1,15 +1,39 @@
-#![feature(ptr_internals, once_cell, slice_ptr_get, mutex_unlock, thread_id_value, int_roundings)]
+#![feature(ptr_internals, once_cell, slice_ptr_get, mutex_unlock, thread_id_value, int_roundings, slice_group_by)]
 
+mod affinity;
+mod arena;
 mod bitwise_spinlock;
+mod budget;
+mod compression;
 mod errors;
+mod eviction;
+mod file_source;
 mod math;
 mod mmap_wrapers;
 mod once_await;
+mod persistent;
 mod populate_workers;
+mod readahead;
+mod reclaimer;
 mod return_checks;
+mod segment_map;
+mod stats;
+mod system_limits;
+mod uffd_ext;
 mod ufo_core;
 mod ufo_objects;
+mod writeback_log;
 
+pub use affinity::{numa_node_cpus, parse_cpu_list};
+pub use budget::UfoBudget;
+pub use compression::UfoCompression;
 pub use errors::*;
+pub use eviction::{EvictionStats, UfoEvictionPolicy};
+pub use file_source::UfoFileSource;
+pub use mmap_wrapers::get_huge_page_size;
+pub use persistent::{persistent_info, PersistentHeader, PersistentInfo, UfoPersistence};
+pub use populate_workers::PoolStats;
+pub use stats::{LatencySnapshot, UfoStage, UfoStats, UFO_STAGES};
 pub use ufo_core::*;
 pub use ufo_objects::*;
+pub use writeback_log::WritebackLogStats;
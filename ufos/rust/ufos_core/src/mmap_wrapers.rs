@@ -16,6 +16,33 @@ pub fn get_page_size() -> usize {
     })
 }
 
+static HUGE_PAGE_SIZE: std::lazy::SyncOnceCell<usize> = std::lazy::SyncOnceCell::new();
+
+// not in the libc crate yet, Linux 6.1+
+const MADV_COLLAPSE: i32 = 25;
+
+/// The size of a transparent huge page, 2MiB where the kernel does not say
+pub fn get_huge_page_size() -> usize {
+    *HUGE_PAGE_SIZE.get_or_init(|| {
+        std::fs::read_to_string("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size")
+            .ok()
+            .and_then(|size| size.trim().parse().ok())
+            .filter(|size| size % get_page_size() == 0)
+            .unwrap_or(2 * 1024 * 1024)
+    })
+}
+
+/// Ask for transparent huge pages for the range, fails where the kernel has none
+pub(crate) fn advise_huge_pages(start: *mut u8, len: usize) -> Result<(), Error> {
+    check_return_zero(unsafe { libc::madvise(start.cast(), len, libc::MADV_HUGEPAGE) })
+}
+
+/// Replace the small pages of a fully loaded, huge page aligned range with huge pages now rather
+/// than waiting for khugepaged to (maybe) get to it. EINVAL on kernels without MADV_COLLAPSE
+pub(crate) fn collapse_huge_pages(start: *mut u8, len: usize) -> Result<(), Error> {
+    check_return_zero(unsafe { libc::madvise(start.cast(), len, MADV_COLLAPSE) })
+}
+
 pub trait Mmap: Sized {
     fn as_ptr(&self) -> *mut u8;
 
@@ -142,6 +169,53 @@ impl BaseMmap {
         )
     }
 
+    /// A mapping of `file` from `offset` on
+    pub fn map_file(
+        length: usize,
+        memory_protection: &[MemoryProtectionFlag],
+        mmap_flags: &[MmapFlag],
+        file: &OpenFile,
+        offset: i64,
+    ) -> Result<BaseMmap, Error> {
+        BaseMmap::new0(
+            length,
+            memory_protection,
+            mmap_flags,
+            None,
+            Some((file.as_fd(), offset)),
+        )
+    }
+
+    /// Like new, but placed so that the address `offset` bytes in is a multiple of `align`
+    pub fn new_aligned(
+        length: usize,
+        offset: usize,
+        align: usize,
+        memory_protection: &[MemoryProtectionFlag],
+        mmap_flags: &[MmapFlag],
+    ) -> Result<BaseMmap, Error> {
+        let padded = BaseMmap::new(length + align, memory_protection, mmap_flags, None)?;
+        let base = padded.base as usize;
+        let start = (base + offset).div_ceil(align) * align - offset;
+        let end = start + length;
+        // give back the slack on either side, the rest is ours
+        std::mem::forget(padded);
+        unsafe {
+            if start > base {
+                check_return_zero(libc::munmap(base as *mut libc::c_void, start - base))?;
+            }
+            if base + length + align > end {
+                let slack = base + length + align - end;
+                check_return_zero(libc::munmap(end as *mut libc::c_void, slack))?;
+            }
+        }
+        debug!(target: "ufo_malloc", "aligned {} bytes at {:#x}", length, start);
+        Ok(BaseMmap {
+            base: start as *mut u8,
+            len: length,
+        })
+    }
+
     pub fn as_ptr(&self) -> *mut u8 {
         self.base
     }
@@ -186,12 +260,17 @@ pub struct OpenFile {
 
 impl OpenFile {
     pub unsafe fn temp(path: &str, size: usize) -> Result<Self, Error> {
+        Self::temp_with_flags(path, size, 0)
+    }
+
+    /// A temporary file opened with extra flags, eg. O_DIRECT
+    pub unsafe fn temp_with_flags(path: &str, size: usize, flags: i32) -> Result<Self, Error> {
         let tmp = std::ffi::CString::new(path)?;
 
         debug!(target: "ufo_malloc", "open anonymous temporary file at {}", path);
         let fd = check_return_nonneg(libc::open(
             tmp.as_ptr(),
-            libc::O_RDWR | libc::O_TMPFILE,
+            libc::O_RDWR | libc::O_TMPFILE | flags,
             0o600,
         ))?;
 
@@ -205,6 +284,34 @@ impl OpenFile {
         Ok(f)
     }
 
+    /// An anonymous file in memory (memfd_create), zero filled to `size`
+    pub fn memfd(name: &str, size: usize) -> Result<Self, Error> {
+        let name = std::ffi::CString::new(name)?;
+
+        let fd = check_return_nonneg(unsafe { libc::memfd_create(name.as_ptr(), libc::MFD_CLOEXEC) })?;
+        let f = OpenFile { fd };
+        debug!(target: "ufo_malloc", "created memfd {}", fd);
+
+        check_return_zero(unsafe { libc::ftruncate64(fd, size as i64) })?;
+        Ok(f)
+    }
+
+    /// A named file, `flags` as for open(2)
+    pub fn open(path: &str, flags: i32) -> Result<Self, Error> {
+        let name = std::ffi::CString::new(path)?;
+
+        debug!(target: "ufo_malloc", "open file at {}", path);
+        let fd = check_return_nonneg(unsafe { libc::open(name.as_ptr(), flags, 0o600) })?;
+        Ok(OpenFile { fd })
+    }
+
+    /// A duplicate of a descriptor someone else owns, closed on exec. The original stays open
+    pub fn dup(fd: RawFd) -> Result<Self, Error> {
+        let fd = check_return_nonneg(unsafe { libc::fcntl(fd, libc::F_DUPFD_CLOEXEC, 0) })?;
+        debug!(target: "ufo_malloc", "duplicated file {}", fd);
+        Ok(OpenFile { fd })
+    }
+
     pub fn as_fd(&self) -> RawFd {
         self.fd
     }
@@ -256,3 +363,53 @@ impl Mmap for MmapFd {
         Ok(self)
     }
 }
+
+/// Memory in the page cache of a memfd, mapped a second time where it can be written without
+/// faulting on the mappings userfaultfd watches
+pub struct SharedMemory {
+    file: OpenFile,
+    alias: BaseMmap,
+}
+
+impl SharedMemory {
+    pub fn new(size: usize) -> Result<SharedMemory, Error> {
+        let file = OpenFile::memfd("ufo", size)?;
+        let alias = BaseMmap::map_file(
+            size,
+            &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
+            &[MmapFlag::Shared],
+            &file,
+            0,
+        )?;
+        Ok(SharedMemory { file, alias })
+    }
+
+    pub fn file(&self) -> &OpenFile {
+        &self.file
+    }
+
+    /// Where `offset` lies in the alias mapping
+    pub fn as_ptr(&self, offset: usize) -> *mut u8 {
+        assert!(offset <= self.alias.length());
+        unsafe { self.alias.as_ptr().add(offset) }
+    }
+
+    /// Put zeroed pages in the page cache without writing to them
+    pub fn allocate(&self, offset: usize, len: usize) -> Result<(), Error> {
+        check_return_zero(unsafe {
+            libc::fallocate64(self.file.as_fd(), 0, offset as i64, len as i64)
+        })
+    }
+
+    /// Drop the pages from the page cache, and so from every mapping of them
+    pub fn punch(&self, offset: usize, len: usize) -> Result<(), Error> {
+        check_return_zero(unsafe {
+            libc::fallocate64(
+                self.file.as_fd(),
+                libc::FALLOC_FL_PUNCH_HOLE | libc::FALLOC_FL_KEEP_SIZE,
+                offset as i64,
+                len as i64,
+            )
+        })
+    }
+}
@@ -0,0 +1,201 @@
+use std::convert::TryInto;
+
+use anyhow::Result;
+use log::debug;
+
+use crate::mmap_wrapers::OpenFile;
+use crate::return_checks::check_return_zero;
+use crate::writeback_log::{read_exact_at, write_all_at};
+
+const MAGIC: &[u8; 8] = b"UFOSTORE";
+const VERSION: u32 = 1;
+// header first, then the written bitmap, then every chunk at a fixed offset
+const HEADER_BYTES: usize = 4096;
+const FIXED_HEADER_BYTES: usize = 8 + 4 + 4 + 8 + 8 + 8 + 4;
+const MAX_IDENTITY_BYTES: usize = HEADER_BYTES - FIXED_HEADER_BYTES;
+const PAGE: usize = 4096;
+
+/// Where a persistent UFO keeps its chunks, and what it was made from
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct UfoPersistence {
+    pub path: String,
+    /// Describes the source, a file opened for a different source is refused
+    pub identity: String,
+    /// For the client to tell what sort of object is stored, eg. the type of an R vector
+    pub tag: u32,
+}
+
+/// What the header of a persistent file records
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct PersistentHeader {
+    pub identity: String,
+    pub tag: u32,
+    pub stride: usize,
+    pub element_ct: usize,
+    pub elements_per_chunk: usize,
+}
+
+impl PersistentHeader {
+    fn chunk_ct(&self) -> usize {
+        self.element_ct.div_ceil(self.elements_per_chunk)
+    }
+
+    fn bitmap_bytes(&self) -> usize {
+        (self.chunk_ct().div_ceil(64) * 8).div_ceil(PAGE) * PAGE
+    }
+
+    fn encode(&self) -> Vec<u8> {
+        let mut header = Vec::with_capacity(HEADER_BYTES);
+        header.extend_from_slice(MAGIC);
+        header.extend_from_slice(&VERSION.to_le_bytes());
+        header.extend_from_slice(&self.tag.to_le_bytes());
+        header.extend_from_slice(&(self.stride as u64).to_le_bytes());
+        header.extend_from_slice(&(self.element_ct as u64).to_le_bytes());
+        header.extend_from_slice(&(self.elements_per_chunk as u64).to_le_bytes());
+        header.extend_from_slice(&(self.identity.len() as u32).to_le_bytes());
+        header.extend_from_slice(self.identity.as_bytes());
+        header.resize(HEADER_BYTES, 0);
+        header
+    }
+
+    fn decode(header: &[u8]) -> Result<PersistentHeader> {
+        let u32_at = |at: usize| u32::from_le_bytes(header[at..at + 4].try_into().unwrap());
+        let u64_at = |at: usize| u64::from_le_bytes(header[at..at + 8].try_into().unwrap());
+
+        anyhow::ensure!(&header[0..8] == MAGIC, "not a persistent UFO");
+        anyhow::ensure!(u32_at(8) == VERSION, "persistent UFO version {} unknown", u32_at(8));
+        let identity_len = u32_at(40) as usize;
+        anyhow::ensure!(identity_len <= MAX_IDENTITY_BYTES, "persistent UFO header corrupt");
+        let header = PersistentHeader {
+            tag: u32_at(12),
+            stride: u64_at(16) as usize,
+            element_ct: u64_at(24) as usize,
+            elements_per_chunk: u64_at(32) as usize,
+            identity: String::from_utf8(
+                header[FIXED_HEADER_BYTES..FIXED_HEADER_BYTES + identity_len].to_vec(),
+            )?,
+        };
+        anyhow::ensure!(
+            header.stride > 0 && header.elements_per_chunk > 0,
+            "persistent UFO header corrupt"
+        );
+        Ok(header)
+    }
+}
+
+/// What a persistent file holds, as of its last checkpoint
+#[derive(Debug, Clone)]
+pub struct PersistentInfo {
+    pub header: PersistentHeader,
+    pub chunk_ct: usize,
+    pub held_chunks: usize,
+}
+
+/// Read a persistent file without opening it for a UFO, eg. to find out what to open it as
+pub fn persistent_info(path: &str) -> Result<PersistentInfo> {
+    let file = OpenFile::open(path, libc::O_RDONLY | libc::O_CLOEXEC)?;
+    let mut header = vec![0u8; HEADER_BYTES];
+    read_exact_at(&file, &mut header, 0)?;
+    let header = PersistentHeader::decode(&header)?;
+
+    let mut bitmap = vec![0u8; header.chunk_ct().div_ceil(64) * 8];
+    read_exact_at(&file, &mut bitmap, HEADER_BYTES as u64)?;
+    let held_chunks = bitmap.iter().map(|b| b.count_ones() as usize).sum();
+    Ok(PersistentInfo {
+        chunk_ct: header.chunk_ct(),
+        held_chunks,
+        header,
+    })
+}
+
+/// A file holding every chunk of one UFO at a fixed offset, plus a bitmap of the chunks it holds.
+/// Only a checkpoint writes to it, chunks written back in between go to the writeback log, so the
+/// next session reads back what the UFO held at its last checkpoint
+pub(crate) struct PersistentFile {
+    file: OpenFile,
+    header: PersistentHeader,
+    chunk_bytes: usize,
+}
+
+impl PersistentFile {
+    /// Open the file for a UFO laid out like `expected`, creating it if need be, and lock it for
+    /// that UFO. Returns the file and the bitmap of the chunks it holds
+    pub fn open(persistence: &UfoPersistence, expected: PersistentHeader) -> Result<(PersistentFile, Vec<u64>)> {
+        anyhow::ensure!(
+            expected.identity.len() <= MAX_IDENTITY_BYTES,
+            "persistent UFO identity too long"
+        );
+        let file = OpenFile::open(&persistence.path, libc::O_RDWR | libc::O_CREAT | libc::O_CLOEXEC)?;
+        // one UFO at a time, two would write over each other's chunks. Held until the file closes
+        if unsafe { libc::flock(file.as_fd(), libc::LOCK_EX | libc::LOCK_NB) } != 0 {
+            anyhow::bail!("{} is open for another UFO", persistence.path);
+        }
+        let chunk_bytes = expected.elements_per_chunk * expected.stride;
+        let bitmap_words = expected.chunk_ct().div_ceil(64);
+
+        let mut size: libc::stat64 = unsafe { std::mem::zeroed() };
+        check_return_zero(unsafe { libc::fstat64(file.as_fd(), &mut size) })?;
+
+        let store = PersistentFile {
+            file,
+            header: expected,
+            chunk_bytes,
+        };
+        if size.st_size == 0 {
+            debug!(target: "ufo_object", "new persistent UFO at {}", persistence.path);
+            write_all_at(&store.file, &store.header.encode(), 0)?;
+            // sparse, chunks take up space as they are written
+            let total = store.data_offset() + store.header.chunk_ct() * chunk_bytes;
+            check_return_zero(unsafe { libc::ftruncate64(store.file.as_fd(), total as i64) })?;
+            return Ok((store, vec![0; bitmap_words]));
+        }
+
+        let mut header = vec![0u8; HEADER_BYTES];
+        read_exact_at(&store.file, &mut header, 0)?;
+        let found = PersistentHeader::decode(&header)?;
+        anyhow::ensure!(
+            found == store.header,
+            "{} holds {:?}, not {:?}",
+            persistence.path,
+            found,
+            store.header
+        );
+
+        let mut bitmap = vec![0u8; bitmap_words * 8];
+        read_exact_at(&store.file, &mut bitmap, HEADER_BYTES as u64)?;
+        let words = bitmap
+            .chunks_exact(8)
+            .map(|w| u64::from_le_bytes(w.try_into().unwrap()))
+            .collect();
+        debug!(target: "ufo_object", "reopened persistent UFO at {}", persistence.path);
+        Ok((store, words))
+    }
+
+    fn data_offset(&self) -> usize {
+        HEADER_BYTES + self.header.bitmap_bytes()
+    }
+
+    fn chunk_offset(&self, chunk_number: usize) -> u64 {
+        (self.data_offset() + chunk_number * self.chunk_bytes) as u64
+    }
+
+    pub fn write_chunk(&self, chunk_number: usize, data: &[u8]) -> Result<()> {
+        anyhow::ensure!(data.len() <= self.chunk_bytes, "chunk too large");
+        write_all_at(&self.file, data, self.chunk_offset(chunk_number))
+    }
+
+    pub fn read_chunk(&self, chunk_number: usize, out: &mut [u8]) -> Result<()> {
+        anyhow::ensure!(out.len() <= self.chunk_bytes, "chunk too large");
+        read_exact_at(&self.file, out, self.chunk_offset(chunk_number))
+    }
+
+    /// Record which chunks the file holds and make sure it all reaches the disk
+    pub fn checkpoint(&self, written: &[u64]) -> Result<()> {
+        let bitmap: Vec<u8> = written.iter().flat_map(|w| w.to_le_bytes()).collect();
+        // the chunks have to be on disk before the bitmap saying they are
+        check_return_zero(unsafe { libc::fdatasync(self.file.as_fd()) })?;
+        write_all_at(&self.file, &bitmap, HEADER_BYTES as u64)?;
+        check_return_zero(unsafe { libc::fdatasync(self.file.as_fd()) })?;
+        Ok(())
+    }
+}
@@ -1,9 +1,20 @@
-use std::sync::{Arc, Condvar, Mutex};
+use std::sync::{Arc, Condvar, Mutex, Weak};
+use std::time::{Duration, Instant};
+
+use log::trace;
+
+use crate::affinity::pin_current_thread;
+
+// Every worker in a populate function for this long, with faults left unread, is taken to be
+// waiting on a fault only another worker can serve (the source reads other UFOs)
+const STUCK_AFTER: Duration = Duration::from_millis(50);
 
 #[derive(Debug, PartialEq)]
 pub enum ShouldRun {
     Running,
     Shutdown,
+    /// Waited out the idle timeout while other workers were waiting too, the thread should end
+    Idle,
 }
 
 pub(crate) trait RequestWorker {
@@ -11,23 +22,93 @@ pub(crate) trait RequestWorker {
     fn request_worker(&self);
 }
 
+#[derive(Debug, Clone, Default)]
+pub(crate) struct PoolConfig {
+    /// 0 is no limit
+    pub max_workers: usize,
+    /// Workers started from now on are pinned to these, empty lets them run anywhere
+    pub cpus: Arc<Vec<usize>>,
+    pub idle_timeout: Option<Duration>,
+}
+
+/// What a worker pool is up to
+#[derive(Debug, Clone, Copy, Default)]
+pub struct PoolStats {
+    pub running: u32,
+    pub idle: u32,
+    /// Requests no worker has picked up yet
+    pub queued: u32,
+    pub peak_running: u32,
+    pub spawned: u64,
+    pub retired: u64,
+    /// Workers started past max_workers because every worker was stuck in a populate function
+    pub spilled: u64,
+}
+
 struct PoolState {
     workers_waiting: u32,
     workers_requested: u32,
+    workers_running: u32,
+    // workers inside a populate function, and when the last of them went in
+    workers_populating: u32,
+    populating_since: Instant,
     should_run: bool,
+    config: PoolConfig,
+    stats: PoolStats,
 }
+
 pub(crate) struct PopulateWorkers<F> {
     name: String,
     state: Mutex<PoolState>,
     awake: Condvar,
+    // wakes the watchdog on shutdown
+    watching: Condvar,
     work: F,
 }
 
+/// Held by a worker while it is in a populate function, see PopulateWorkers::populating
+pub(crate) struct Populating<'a> {
+    state: &'a Mutex<PoolState>,
+}
+
+impl Drop for Populating<'_> {
+    fn drop(&mut self) {
+        self.state.lock().unwrap().workers_populating -= 1;
+    }
+}
+
 impl<F> PopulateWorkers<F> {
     pub fn shutdown(&self) {
         let mut state = self.state.lock().unwrap();
         state.should_run = false;
         self.awake.notify_all();
+        self.watching.notify_all();
+    }
+
+    /// Count the calling worker as populating until the guard is dropped. Only for the workers of
+    /// this pool, the watchdog compares this to the workers running
+    pub fn populating(&self) -> Populating {
+        let mut state = self.state.lock().unwrap();
+        state.workers_populating += 1;
+        state.populating_since = Instant::now();
+        Populating { state: &self.state }
+    }
+
+    pub fn configure(&self, config: PoolConfig) {
+        let mut state = self.state.lock().unwrap();
+        state.config = config;
+        // waiting workers pick up the new timeout
+        self.awake.notify_all();
+    }
+
+    pub fn stats(&self) -> PoolStats {
+        let state = self.state.lock().unwrap();
+        PoolStats {
+            running: state.workers_running,
+            idle: state.workers_waiting,
+            queued: state.workers_requested,
+            ..state.stats
+        }
     }
 }
 
@@ -38,12 +119,40 @@ where
     fn await_work(&self) -> ShouldRun {
         let mut state = self.state.lock().unwrap();
 
+        // what the watchdog started past the limit goes again once it is done
+        let max_workers = state.config.max_workers;
+        if max_workers > 0 && state.workers_running as usize > max_workers {
+            state.stats.retired += 1;
+            return ShouldRun::Idle;
+        }
+
         state.workers_waiting += 1;
 
-        let mut state = self
-            .awake
-            .wait_while(state, |s| s.workers_requested == 0 && s.should_run)
-            .unwrap();
+        loop {
+            let waiting = |s: &mut PoolState| s.workers_requested == 0 && s.should_run;
+            match state.config.idle_timeout {
+                None => {
+                    state = self.awake.wait_while(state, waiting).unwrap();
+                    break;
+                }
+                Some(timeout) => {
+                    let (s, result) = self
+                        .awake
+                        .wait_timeout_while(state, timeout, waiting)
+                        .unwrap();
+                    state = s;
+                    if !result.timed_out() {
+                        break;
+                    }
+                    // always keep a spare so a burst of faults doesn't wait on a thread starting
+                    if state.workers_waiting > 1 {
+                        state.workers_waiting -= 1;
+                        state.stats.retired += 1;
+                        return ShouldRun::Idle;
+                    }
+                }
+            }
+        }
 
         state.workers_waiting -= 1;
 
@@ -53,8 +162,12 @@ where
 
         state.workers_requested -= 1;
 
-        if state.workers_waiting < 1 {
-            PopulateWorkers::spawn_worker(Arc::clone(self));
+        // at the limit requests wait for one of the running workers to come back around
+        let max_workers = state.config.max_workers;
+        if state.workers_waiting < 1
+            && (max_workers == 0 || (state.workers_running as usize) < max_workers)
+        {
+            PopulateWorkers::start_thread(Arc::clone(self), &mut state);
         }
 
         std::sync::Mutex::unlock(state);
@@ -71,23 +184,79 @@ impl<F> PopulateWorkers<F>
 where
     F: 'static + Send + Sync + Fn(&dyn RequestWorker),
 {
-    pub fn new(name: &str, work: F) -> Arc<PopulateWorkers<F>> {
+    pub fn new(name: &str, config: PoolConfig, work: F) -> Arc<PopulateWorkers<F>> {
         Arc::new(PopulateWorkers {
             name: name.to_string(),
             state: Mutex::new(PoolState {
                 workers_waiting: 0,
                 workers_requested: 1,
+                workers_running: 0,
+                workers_populating: 0,
+                populating_since: Instant::now(),
                 should_run: true,
+                config,
+                stats: PoolStats::default(),
             }),
             awake: Condvar::new(),
+            watching: Condvar::new(),
             work,
         })
     }
 
     pub fn spawn_worker(this: Arc<Self>) {
+        let state = &mut *this.state.lock().unwrap();
+        PopulateWorkers::start_thread(this.clone(), state);
+    }
+
+    /// With max_workers set, a source which reads other UFOs can have every worker waiting on a
+    /// fault that no worker is left to read. The watchdog starts one more worker past the limit
+    /// each time every worker has been in a populate function for STUCK_AFTER with requests
+    /// waiting, enough to serve any depth of nesting one level at a time
+    pub fn watch_populates(this: &Arc<Self>) {
+        let pool: Weak<Self> = Arc::downgrade(this);
+        std::thread::Builder::new()
+            .name(format!("{} Watchdog", this.name))
+            .spawn(move || loop {
+                let this = match pool.upgrade() {
+                    Some(this) => this,
+                    None => return,
+                };
+                let state = this.state.lock().unwrap();
+                let (mut state, _) = this.watching.wait_timeout(state, STUCK_AFTER).unwrap();
+                if !state.should_run {
+                    return;
+                }
+                let stuck = state.config.max_workers > 0
+                    && state.workers_requested > 0
+                    && state.workers_waiting == 0
+                    && state.workers_running > 0
+                    && state.workers_populating >= state.workers_running
+                    && state.populating_since.elapsed() >= STUCK_AFTER;
+                if stuck {
+                    trace!(target: "ufo_core", "{} workers all stuck populating, starting another", this.name);
+                    state.stats.spilled += 1;
+                    // one at a time, the next has to wait out STUCK_AFTER again
+                    state.populating_since = Instant::now();
+                    PopulateWorkers::start_thread(this.clone(), &mut state);
+                }
+            })
+            .unwrap();
+    }
+
+    fn start_thread(this: Arc<Self>, state: &mut PoolState) {
+        state.workers_running += 1;
+        state.stats.spawned += 1;
+        state.stats.peak_running = std::cmp::max(state.stats.peak_running, state.workers_running);
+        let cpus = state.config.cpus.clone();
         std::thread::Builder::new()
-            .name(this.name.clone())
-            .spawn(move || (this.work)(&this))
+            .name(format!("{} {}", this.name, state.stats.spawned))
+            .spawn(move || {
+                pin_current_thread(&cpus);
+                (this.work)(&this);
+                let mut state = this.state.lock().unwrap();
+                state.workers_running -= 1;
+                trace!(target: "ufo_core", "{} worker done, {} left", this.name, state.workers_running);
+            })
             .unwrap();
     }
 }
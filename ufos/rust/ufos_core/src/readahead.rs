@@ -0,0 +1,141 @@
+use std::sync::Weak;
+
+use crossbeam::sync::WaitGroup;
+
+use super::ufo_core::WrappedUfoObject;
+
+/// A chunk the prefetch workers should populate before anyone faults on it
+pub(crate) struct PrefetchJob {
+    pub ufo: Weak<std::sync::RwLock<super::ufo_objects::UfoObject>>,
+    pub generation: u64,
+    pub chunk_number: usize,
+    // explicit prefetches wait on this, it is dropped once the chunk is in
+    pub done: Option<WaitGroup>,
+}
+
+impl PrefetchJob {
+    pub fn new(ufo: &WrappedUfoObject, generation: u64, chunk_number: usize) -> Self {
+        PrefetchJob {
+            ufo: std::sync::Arc::downgrade(ufo),
+            generation,
+            chunk_number,
+            done: None,
+        }
+    }
+}
+
+// Faults on a UFO are watched for a constant stride (in chunks), once the same stride is seen twice
+// in a row the chunks ahead of the faulting thread are handed to the prefetch workers.
+//
+// Chunks which were prefetched never fault so the stream would go quiet as soon as readahead works.
+// Like the kernel page cache we leave one chunk in the middle of each window unrequested, the
+// trigger, when the reader faults on it we know the stream is still going and issue the next
+// (larger) window while the reader works through the second half of the current one.
+pub(crate) struct Readahead {
+    last_fault: Option<usize>,
+    stride: isize,
+    window: usize,
+    // where the stream was first recognized and the next chunk in it that has not been requested
+    start: isize,
+    next: isize,
+    trigger: Option<usize>,
+}
+
+impl Readahead {
+    pub fn new() -> Self {
+        Readahead {
+            last_fault: None,
+            stride: 0,
+            window: 0,
+            start: 0,
+            next: 0,
+            trigger: None,
+        }
+    }
+
+    pub fn reset(&mut self) {
+        *self = Readahead::new();
+    }
+
+    /// Record a fault on `chunk` and push any chunks which should be read ahead onto `prefetch`
+    pub fn record(
+        &mut self,
+        chunk: usize,
+        chunk_ct: usize,
+        depth: usize,
+        max_window: usize,
+        prefetch: &mut Vec<usize>,
+    ) {
+        if depth == 0 || self.last_fault == Some(chunk) {
+            // several threads waiting on the same chunk tell us nothing new
+            return;
+        }
+
+        let c = chunk as isize;
+        let continues = self.window > 0 && (Some(chunk) == self.trigger || c == self.next);
+        if !continues && self.window > 0 && self.is_requested(c) {
+            // racing a prefetch or one that was dropped, not a reason to drop the stream
+            return;
+        }
+
+        let stride = self.last_fault.map(|l| c - l as isize);
+        self.last_fault = Some(chunk);
+
+        if continues {
+            self.trigger = None;
+            self.window = std::cmp::min(self.window * 2, max_window);
+        } else {
+            match stride {
+                Some(s) if s != 0 && s == self.stride => {
+                    if self.window == 0 {
+                        self.window = std::cmp::min(depth, max_window);
+                        self.start = c;
+                        self.next = c + s;
+                    }
+                }
+                Some(s) => {
+                    // new pattern (or none at all), wait to see it again before reading ahead
+                    self.stride = s;
+                    self.window = 0;
+                    self.trigger = None;
+                    return;
+                }
+                None => return,
+            }
+        }
+
+        self.issue(chunk, chunk_ct, prefetch);
+    }
+
+    fn is_requested(&self, c: isize) -> bool {
+        let (low, high) = if self.stride > 0 {
+            (self.start, self.next)
+        } else {
+            (self.next, self.start)
+        };
+        low < c && c < high && (c - self.start) % self.stride == 0
+    }
+
+    fn issue(&mut self, chunk: usize, chunk_ct: usize, prefetch: &mut Vec<usize>) {
+        let stride = self.stride;
+        let end = chunk as isize + stride * self.window as isize;
+        let in_window = |c: isize| if stride > 0 { c <= end } else { c >= end };
+
+        // never request what the faulting thread is about to populate itself
+        if self.next == chunk as isize {
+            self.next += stride;
+        }
+
+        let first = prefetch.len();
+        while in_window(self.next) && self.next >= 0 && (self.next as usize) < chunk_ct {
+            prefetch.push(self.next as usize);
+            self.next += stride;
+        }
+
+        let issued = prefetch.len() - first;
+        if issued > 1 {
+            let trigger = prefetch.remove(first + issued / 2);
+            self.trigger = Some(trigger);
+        }
+    }
+}
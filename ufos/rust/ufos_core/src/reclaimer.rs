@@ -0,0 +1,66 @@
+use std::sync::{Arc, Condvar, Mutex};
+
+use crate::populate_workers::ShouldRun;
+
+struct ReclaimState {
+    requested: bool,
+    should_run: bool,
+}
+
+// A single thread which trims loaded chunks down to the low watermark once the background watermark
+// is crossed, faulting threads only free memory themselves when they hit the high watermark
+pub(crate) struct Reclaimer {
+    state: Mutex<ReclaimState>,
+    awake: Condvar,
+}
+
+impl Reclaimer {
+    pub fn new() -> Arc<Reclaimer> {
+        Arc::new(Reclaimer {
+            state: Mutex::new(ReclaimState {
+                requested: false,
+                should_run: true,
+            }),
+            awake: Condvar::new(),
+        })
+    }
+
+    pub fn spawn<F>(this: Arc<Self>, work: F)
+    where
+        F: 'static + Send + Fn(&Reclaimer),
+    {
+        std::thread::Builder::new()
+            .name("Ufo Reclaim".to_string())
+            .spawn(move || work(&this))
+            .unwrap();
+    }
+
+    pub fn request(&self) {
+        let mut state = self.state.lock().unwrap();
+        if !state.requested {
+            state.requested = true;
+            self.awake.notify_one();
+        }
+    }
+
+    pub fn await_work(&self) -> ShouldRun {
+        let state = self.state.lock().unwrap();
+        let mut state = self
+            .awake
+            .wait_while(state, |s| !s.requested && s.should_run)
+            .unwrap();
+
+        if !state.should_run {
+            return ShouldRun::Shutdown;
+        }
+        // requests made while we work start another pass
+        state.requested = false;
+        ShouldRun::Running
+    }
+
+    pub fn shutdown(&self) {
+        let mut state = self.state.lock().unwrap();
+        state.should_run = false;
+        self.awake.notify_all();
+    }
+}
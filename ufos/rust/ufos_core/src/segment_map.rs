@@ -0,0 +1,76 @@
+use std::ops::Range;
+
+// Every fault needs to find the UFO that owns an address but UFOs are only rarely allocated or
+// freed. A sorted array is cheap to binary search and sits behind a RwLock in the core so that
+// lookups never wait on each other, only on the (rare) writers
+
+struct Segment<V> {
+    start: usize,
+    end: usize,
+    value: V,
+}
+
+pub(crate) struct SegmentMap<V> {
+    segments: Vec<Segment<V>>,
+}
+
+impl<V> SegmentMap<V> {
+    pub fn new() -> Self {
+        SegmentMap {
+            segments: Vec::new(),
+        }
+    }
+
+    /// Index of the first segment which ends after the address
+    fn search(&self, addr: usize) -> usize {
+        self.segments.partition_point(|s| s.end <= addr)
+    }
+
+    pub fn get(&self, addr: &usize) -> Option<&V> {
+        let addr = *addr;
+        self.segments
+            .get(self.search(addr))
+            .filter(|s| s.start <= addr)
+            .map(|s| &s.value)
+    }
+
+    pub fn get_range(&self, addr: &usize) -> Option<Range<usize>> {
+        let addr = *addr;
+        self.segments
+            .get(self.search(addr))
+            .filter(|s| s.start <= addr)
+            .map(|s| s.start..s.end)
+    }
+
+    pub fn insert(&mut self, range: Range<usize>, value: V) -> anyhow::Result<()> {
+        anyhow::ensure!(range.start < range.end, "empty segment");
+        let idx = self.search(range.start);
+        if let Some(next) = self.segments.get(idx) {
+            anyhow::ensure!(
+                range.end <= next.start,
+                "segment {:#x}-{:#x} overlaps {:#x}-{:#x}",
+                range.start,
+                range.end,
+                next.start,
+                next.end
+            );
+        }
+        self.segments.insert(
+            idx,
+            Segment {
+                start: range.start,
+                end: range.end,
+                value,
+            },
+        );
+        Ok(())
+    }
+
+    pub fn remove_by_start(&mut self, start: &usize) -> Option<V> {
+        let idx = self.search(*start);
+        match self.segments.get(idx) {
+            Some(s) if s.start == *start => Some(self.segments.remove(idx).value),
+            _ => None,
+        }
+    }
+}
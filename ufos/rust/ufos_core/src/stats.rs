@@ -0,0 +1,274 @@
+use std::lazy::SyncOnceCell;
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+use std::time::Instant;
+
+/// The steps a chunk goes through on its way in and out of memory
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UfoStage {
+    /// Everything from taking the chunk lock to the data being in place, readback included
+    Load,
+    /// The UFO's populate function
+    Populate,
+    /// UFFDIO_COPY into the UFO
+    Copy,
+    /// Hashing a chunk, on load and again on free to see if it is dirty
+    Hash,
+    /// Taking a chunk out of memory, writeback included
+    Free,
+    /// Copying a dirty chunk to the writeback file, compressing it if asked to
+    Writeback,
+    /// A thread which wanted to load a chunk freeing memory first, to the watermarks or a budget
+    Reclaim,
+}
+
+pub const UFO_STAGES: [UfoStage; 7] = [
+    UfoStage::Load,
+    UfoStage::Populate,
+    UfoStage::Copy,
+    UfoStage::Hash,
+    UfoStage::Free,
+    UfoStage::Writeback,
+    UfoStage::Reclaim,
+];
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum Counter {
+    Faults,
+    PopulateCalls,
+    ReadbackHits,
+    ConstantChunks,
+    HugePageChunks,
+    SharedMemoryChunks,
+    Writebacks,
+    WritebackBytes,
+    WritebackStoredBytes,
+    FreedChunks,
+}
+
+const COUNTERS: usize = 10;
+
+// HdrHistogram style buckets: each power of two split in 4, so a recorded value is off by at most
+// a quarter. Past 2^40ns (about 18 minutes) everything lands in the last bucket
+const SUB_BUCKET_BITS: u32 = 2;
+const MAX_EXPONENT: u32 = 40;
+const BUCKETS: usize = ((MAX_EXPONENT - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) as usize;
+
+fn bucket_of(ns: u64) -> usize {
+    let ns = std::cmp::min(ns, (1 << MAX_EXPONENT) - 1);
+    if ns < (1 << SUB_BUCKET_BITS) {
+        return ns as usize;
+    }
+    let exponent = 63 - ns.leading_zeros();
+    let sub = (ns >> (exponent - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+    (((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) as u64 + sub) as usize
+}
+
+/// The largest value which lands in the bucket
+fn bucket_top(bucket: usize) -> u64 {
+    let bucket = bucket as u64;
+    if bucket < (1 << SUB_BUCKET_BITS) {
+        return bucket;
+    }
+    let exponent = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS as u64 - 1;
+    let sub = bucket & ((1 << SUB_BUCKET_BITS) - 1);
+    let step = 1u64 << (exponent - SUB_BUCKET_BITS as u64);
+    (1 << exponent) + (sub + 1) * step - 1
+}
+
+struct Histogram {
+    buckets: Vec<AtomicU64>,
+    count: AtomicU64,
+    total_ns: AtomicU64,
+    max_ns: AtomicU64,
+}
+
+impl Histogram {
+    fn new() -> Self {
+        Histogram {
+            buckets: (0..BUCKETS).map(|_| AtomicU64::new(0)).collect(),
+            count: AtomicU64::new(0),
+            total_ns: AtomicU64::new(0),
+            max_ns: AtomicU64::new(0),
+        }
+    }
+
+    fn record(&self, ns: u64) {
+        self.buckets[bucket_of(ns)].fetch_add(1, Relaxed);
+        self.count.fetch_add(1, Relaxed);
+        self.total_ns.fetch_add(ns, Relaxed);
+        self.max_ns.fetch_max(ns, Relaxed);
+    }
+
+    fn reset(&self) {
+        self.buckets.iter().for_each(|b| b.store(0, Relaxed));
+        self.count.store(0, Relaxed);
+        self.total_ns.store(0, Relaxed);
+        self.max_ns.store(0, Relaxed);
+    }
+
+    /// Not a consistent cut while others are recording, but never off by more than those few records
+    fn snapshot(&self) -> LatencySnapshot {
+        let buckets: Vec<u64> = self.buckets.iter().map(|b| b.load(Relaxed)).collect();
+        let count: u64 = buckets.iter().sum();
+        let max_ns = self.max_ns.load(Relaxed);
+        let percentile = |p: f64| {
+            if count == 0 {
+                return 0;
+            }
+            let rank = std::cmp::max(1, (count as f64 * p).ceil() as u64);
+            let mut seen = 0;
+            for (bucket, n) in buckets.iter().enumerate() {
+                seen += n;
+                if seen >= rank {
+                    return std::cmp::min(bucket_top(bucket), max_ns);
+                }
+            }
+            max_ns
+        };
+        LatencySnapshot {
+            count: self.count.load(Relaxed),
+            total_ns: self.total_ns.load(Relaxed),
+            p50_ns: percentile(0.50),
+            p90_ns: percentile(0.90),
+            p99_ns: percentile(0.99),
+            max_ns,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LatencySnapshot {
+    pub count: u64,
+    pub total_ns: u64,
+    pub p50_ns: u64,
+    pub p90_ns: u64,
+    pub p99_ns: u64,
+    pub max_ns: u64,
+}
+
+impl LatencySnapshot {
+    pub fn mean_ns(&self) -> u64 {
+        self.total_ns.checked_div(self.count).unwrap_or(0)
+    }
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct UfoStats {
+    /// Page faults read from the userfaultfd
+    pub faults: u64,
+    pub populate_calls: u64,
+    /// Chunks loaded from the writeback file rather than populated again
+    pub readback_hits: u64,
+    /// Chunks the source said were zero or a constant, loaded without populating
+    pub constant_chunks: u64,
+    /// Chunks mapped as transparent huge pages once loaded
+    pub huge_page_chunks: u64,
+    /// Chunks loaded straight into shared memory and mapped without copying (UfoBacking::SharedMemory)
+    pub shared_memory_chunks: u64,
+    pub writebacks: u64,
+    pub writeback_bytes: u64,
+    /// What the writebacks took up on disk, less than writeback_bytes when compressing
+    pub writeback_stored_bytes: u64,
+    pub freed_chunks: u64,
+    pub resident_bytes: u64,
+    latencies: [LatencySnapshot; UFO_STAGES.len()],
+}
+
+impl UfoStats {
+    pub fn latency(&self, stage: UfoStage) -> &LatencySnapshot {
+        &self.latencies[stage as usize]
+    }
+
+    /// Bytes written back for every byte stored, 1 when nothing was written back
+    pub fn compression_ratio(&self) -> f64 {
+        if self.writeback_stored_bytes == 0 {
+            return 1.0;
+        }
+        self.writeback_bytes as f64 / self.writeback_stored_bytes as f64
+    }
+}
+
+/// Counters and latency histograms, one set for the core and one for every UFO. Everything is
+/// updated with relaxed atomics so recording never waits on anyone
+pub(crate) struct StatsRecorder {
+    counters: [AtomicU64; COUNTERS],
+    // a few KiB each, a UFO only gets them once it is actually used
+    histograms: SyncOnceCell<Vec<Histogram>>,
+}
+
+impl StatsRecorder {
+    pub fn new() -> Self {
+        StatsRecorder {
+            counters: Default::default(),
+            histograms: SyncOnceCell::new(),
+        }
+    }
+
+    fn histogram(&self, stage: UfoStage) -> &Histogram {
+        &self
+            .histograms
+            .get_or_init(|| UFO_STAGES.iter().map(|_| Histogram::new()).collect())[stage as usize]
+    }
+
+    pub fn add(&self, counter: Counter, n: u64) {
+        self.counters[counter as usize].fetch_add(n, Relaxed);
+    }
+
+    pub fn record(&self, stage: UfoStage, ns: u64) {
+        self.histogram(stage).record(ns);
+    }
+
+    pub fn reset(&self) {
+        self.counters.iter().for_each(|c| c.store(0, Relaxed));
+        if let Some(histograms) = self.histograms.get() {
+            histograms.iter().for_each(Histogram::reset);
+        }
+    }
+
+    pub fn snapshot(&self, resident_bytes: usize) -> UfoStats {
+        let counter = |c: Counter| self.counters[c as usize].load(Relaxed);
+        let mut latencies = [LatencySnapshot::default(); UFO_STAGES.len()];
+        if let Some(histograms) = self.histograms.get() {
+            latencies
+                .iter_mut()
+                .zip(histograms)
+                .for_each(|(l, h)| *l = h.snapshot());
+        }
+        UfoStats {
+            faults: counter(Counter::Faults),
+            populate_calls: counter(Counter::PopulateCalls),
+            readback_hits: counter(Counter::ReadbackHits),
+            constant_chunks: counter(Counter::ConstantChunks),
+            huge_page_chunks: counter(Counter::HugePageChunks),
+            shared_memory_chunks: counter(Counter::SharedMemoryChunks),
+            writebacks: counter(Counter::Writebacks),
+            writeback_bytes: counter(Counter::WritebackBytes),
+            writeback_stored_bytes: counter(Counter::WritebackStoredBytes),
+            freed_chunks: counter(Counter::FreedChunks),
+            resident_bytes: resident_bytes as u64,
+            latencies,
+        }
+    }
+}
+
+/// Count towards both the core and the UFO
+#[derive(Clone, Copy)]
+pub(crate) struct Recorders<'a> {
+    pub core: &'a StatsRecorder,
+    pub ufo: &'a StatsRecorder,
+}
+
+impl<'a> Recorders<'a> {
+    pub fn add(&self, counter: Counter, n: u64) {
+        self.core.add(counter, n);
+        self.ufo.add(counter, n);
+    }
+
+    /// Record the time since `started`
+    pub fn record(&self, stage: UfoStage, started: Instant) -> u64 {
+        let ns = started.elapsed().as_nanos() as u64;
+        self.core.record(stage, ns);
+        self.ufo.record(stage, ns);
+        ns
+    }
+}
@@ -0,0 +1,60 @@
+use std::path::{Path, PathBuf};
+
+use log::debug;
+
+// Where the memory we may use is decided: the cgroup v2 limits on our group (and every group
+// above it) and what the kernel says is available right now. Anything we can't read is no limit.
+
+fn read_bytes(file: &Path) -> Option<usize> {
+    let value = std::fs::read_to_string(file).ok()?;
+    // "max" is no limit
+    value.trim().parse::<usize>().ok()
+}
+
+fn own_cgroup() -> Option<PathBuf> {
+    let groups = std::fs::read_to_string("/proc/self/cgroup").ok()?;
+    // the unified hierarchy is the only one listed as "0::"
+    let path = groups.lines().find_map(|l| l.strip_prefix("0::"))?;
+    Some(Path::new("/sys/fs/cgroup").join(path.trim_start_matches('/')))
+}
+
+/// Room left under the tightest memory.max or memory.high on the way from our cgroup up to the root
+pub fn cgroup_headroom() -> Option<usize> {
+    let root = Path::new("/sys/fs/cgroup");
+    let mut group = own_cgroup()?;
+    let mut headroom: Option<usize> = None;
+    loop {
+        let current = read_bytes(&group.join("memory.current")).unwrap_or(0);
+        for file in ["memory.max", "memory.high"] {
+            if let Some(limit) = read_bytes(&group.join(file)) {
+                let room = limit.saturating_sub(current);
+                headroom = Some(headroom.map_or(room, |h| std::cmp::min(h, room)));
+            }
+        }
+        if group == root || !group.pop() {
+            break;
+        }
+    }
+    headroom
+}
+
+/// MemAvailable from /proc/meminfo in bytes
+pub fn available_memory() -> Option<usize> {
+    let meminfo = std::fs::read_to_string("/proc/meminfo").ok()?;
+    let line = meminfo
+        .lines()
+        .find_map(|l| l.strip_prefix("MemAvailable:"))?;
+    let kb: usize = line.trim().trim_end_matches("kB").trim().parse().ok()?;
+    Some(kb * 1024)
+}
+
+/// What the UFOs in this process may load at most, None if nothing could be read
+pub fn memory_limit() -> Option<usize> {
+    let cgroup = cgroup_headroom();
+    let available = available_memory();
+    debug!(target: "ufo_core", "cgroup limit {:?}, available {:?}", cgroup, available);
+    match (cgroup, available) {
+        (Some(c), Some(a)) => Some(std::cmp::min(c, a)),
+        (c, a) => c.or(a),
+    }
+}
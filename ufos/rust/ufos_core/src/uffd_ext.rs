@@ -0,0 +1,323 @@
+use std::ffi::c_void;
+use std::os::unix::io::AsRawFd;
+
+use userfaultfd::Uffd;
+
+// The userfaultfd crate only hands us one event per read, these are the raw kernel structures so
+// that we can drain many events with a single syscall
+
+const UFFD_EVENT_PAGEFAULT: u8 = 0x12;
+const UFFD_PAGEFAULT_FLAG_WRITE: u64 = 1 << 0;
+const UFFD_PAGEFAULT_FLAG_WP: u64 = 1 << 1;
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct UffdMsg {
+    event: u8,
+    _reserved1: u8,
+    _reserved2: u16,
+    _reserved3: u32,
+    // for pagefaults this is { flags, address, ptid }
+    arg: [u64; 3],
+}
+
+const UFFD_MSG_SIZE: usize = std::mem::size_of::<UffdMsg>();
+
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Pagefault {
+    pub addr: usize,
+    /// The access was a write (to a missing or a write protected page)
+    pub write: bool,
+    /// A write to a page we populated write protected, nothing to load
+    pub write_protect: bool,
+}
+
+pub(crate) struct UffdEventBuffer {
+    msgs: Vec<UffdMsg>,
+}
+
+impl UffdEventBuffer {
+    pub fn new(capacity: usize) -> Self {
+        let capacity = std::cmp::max(1, capacity);
+        UffdEventBuffer {
+            msgs: vec![
+                UffdMsg {
+                    event: 0,
+                    _reserved1: 0,
+                    _reserved2: 0,
+                    _reserved3: 0,
+                    arg: [0; 3],
+                };
+                capacity
+            ],
+        }
+    }
+
+    /// Block until at least one event is available then read as many as are pending (up to the
+    /// capacity of the buffer). Errors mirror the ones produced by `Uffd::read_event`
+    pub fn read_pagefaults(
+        &mut self,
+        uffd: &Uffd,
+        faults: &mut Vec<Pagefault>,
+    ) -> Result<(), userfaultfd::Error> {
+        faults.clear();
+        let read = unsafe {
+            libc::read(
+                uffd.as_raw_fd(),
+                self.msgs.as_mut_ptr().cast(),
+                self.msgs.len() * UFFD_MSG_SIZE,
+            )
+        };
+
+        match read {
+            0 => return Err(userfaultfd::Error::ReadEof),
+            x if x < 0 => {
+                return Err(userfaultfd::Error::SystemError(nix::Error::Sys(
+                    nix::errno::Errno::last(),
+                )))
+            }
+            _ => {}
+        }
+
+        let read = read as usize;
+        assert_eq!(0, read % UFFD_MSG_SIZE, "partial uffd message");
+
+        for msg in &self.msgs[0..read / UFFD_MSG_SIZE] {
+            match msg.event {
+                UFFD_EVENT_PAGEFAULT => faults.push(Pagefault {
+                    addr: msg.arg[1] as usize,
+                    write: msg.arg[0] & UFFD_PAGEFAULT_FLAG_WRITE != 0,
+                    write_protect: msg.arg[0] & UFFD_PAGEFAULT_FLAG_WP != 0,
+                }),
+                e => panic!("Recieved an event we did not register for {:?}", e),
+            }
+        }
+
+        Ok(())
+    }
+}
+
+/// True when a copy failed because some other worker already populated the range
+pub(crate) fn is_already_populated(err: &userfaultfd::Error) -> bool {
+    match err {
+        userfaultfd::Error::CopyFailed(errno) => *errno == nix::errno::Errno::EEXIST,
+        userfaultfd::Error::SystemError(e) => e.as_errno() == Some(nix::errno::Errno::EEXIST),
+        _ => false,
+    }
+}
+
+// Write protection (Linux 5.7+ for anonymous memory) is not wrapped by the userfaultfd crate either
+
+#[repr(C)]
+struct UffdioRange {
+    start: u64,
+    len: u64,
+}
+
+#[repr(C)]
+struct UffdioRegister {
+    range: UffdioRange,
+    mode: u64,
+    ioctls: u64,
+}
+
+#[repr(C)]
+struct UffdioCopy {
+    dst: u64,
+    src: u64,
+    len: u64,
+    mode: u64,
+    copy: i64,
+}
+
+#[repr(C)]
+struct UffdioContinue {
+    range: UffdioRange,
+    mode: u64,
+    mapped: i64,
+}
+
+#[repr(C)]
+struct UffdioWriteprotect {
+    range: UffdioRange,
+    mode: u64,
+}
+
+const fn iowr(nr: u64, size: usize) -> u64 {
+    (3 << 30) | ((size as u64) << 16) | (0xAA << 8) | nr
+}
+
+const UFFDIO_REGISTER: u64 = iowr(0x00, std::mem::size_of::<UffdioRegister>());
+const UFFDIO_COPY: u64 = iowr(0x03, std::mem::size_of::<UffdioCopy>());
+const UFFDIO_WRITEPROTECT: u64 = iowr(0x06, std::mem::size_of::<UffdioWriteprotect>());
+const UFFDIO_CONTINUE: u64 = iowr(0x07, std::mem::size_of::<UffdioContinue>());
+
+const UFFDIO_REGISTER_MODE_MISSING: u64 = 1 << 0;
+const UFFDIO_REGISTER_MODE_WP: u64 = 1 << 1;
+const UFFDIO_REGISTER_MODE_MINOR: u64 = 1 << 2;
+const UFFDIO_COPY_MODE_DONTWAKE: u64 = 1 << 0;
+const UFFDIO_COPY_MODE_WP: u64 = 1 << 1;
+const UFFDIO_WRITEPROTECT_MODE_WP: u64 = 1 << 0;
+const UFFDIO_CONTINUE_MODE_DONTWAKE: u64 = 1 << 0;
+// bit in the ioctls the kernel says it allows on a registered range
+const UFFDIO_WRITEPROTECT_IOCTL: u64 = 1 << 0x06;
+const UFFDIO_CONTINUE_IOCTL: u64 = 1 << 0x07;
+
+fn last_error() -> userfaultfd::Error {
+    userfaultfd::Error::SystemError(nix::Error::Sys(nix::errno::Errno::last()))
+}
+
+/// Register for missing and write protect faults, false if the kernel cannot write protect this
+/// range. The range is left unregistered either way
+pub(crate) fn register_write_protect(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+) -> Result<bool, userfaultfd::Error> {
+    let mut register = UffdioRegister {
+        range: UffdioRange {
+            start: start as u64,
+            len: len as u64,
+        },
+        mode: UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP,
+        ioctls: 0,
+    };
+    let r = unsafe { libc::ioctl(uffd.as_raw_fd(), UFFDIO_REGISTER as _, &mut register) };
+    if r != 0 {
+        return match nix::errno::Errno::last() {
+            nix::errno::Errno::EINVAL => Ok(false),
+            _ => Err(last_error()),
+        };
+    }
+    if register.ioctls & UFFDIO_WRITEPROTECT_IOCTL == 0 {
+        uffd.unregister(start, len)?;
+        return Ok(false);
+    }
+    Ok(true)
+}
+
+// Minor faults (Linux 5.14+ for shmem) are not wrapped either
+
+/// Register a shared memory mapping for missing and minor faults, false if the kernel cannot
+/// report minor faults on it. The range is left unregistered then
+pub(crate) fn register_minor(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+) -> Result<bool, userfaultfd::Error> {
+    let mut register = UffdioRegister {
+        range: UffdioRange {
+            start: start as u64,
+            len: len as u64,
+        },
+        mode: UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_MINOR,
+        ioctls: 0,
+    };
+    let r = unsafe { libc::ioctl(uffd.as_raw_fd(), UFFDIO_REGISTER as _, &mut register) };
+    if r != 0 {
+        return match nix::errno::Errno::last() {
+            nix::errno::Errno::EINVAL => Ok(false),
+            _ => Err(last_error()),
+        };
+    }
+    if register.ioctls & UFFDIO_CONTINUE_IOCTL == 0 {
+        uffd.unregister(start, len)?;
+        return Ok(false);
+    }
+    Ok(true)
+}
+
+/// UFFDIO_CONTINUE, map pages already in the page cache into a range registered with
+/// register_minor. Fails with EEXIST like a copy when someone else mapped them first
+pub(crate) fn continue_range(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+    wake: bool,
+) -> Result<(), userfaultfd::Error> {
+    let mut cont = UffdioContinue {
+        range: UffdioRange {
+            start: start as u64,
+            len: len as u64,
+        },
+        mode: if wake { 0 } else { UFFDIO_CONTINUE_MODE_DONTWAKE },
+        mapped: 0,
+    };
+    let r = unsafe { libc::ioctl(uffd.as_raw_fd(), UFFDIO_CONTINUE as _, &mut cont) };
+    if r != 0 {
+        return Err(last_error());
+    }
+    Ok(())
+}
+
+/// UFFDIO_COPY without waking, optionally leaving the pages write protected
+pub(crate) unsafe fn copy(
+    uffd: &Uffd,
+    src: *const c_void,
+    dst: *mut c_void,
+    len: usize,
+    write_protect: bool,
+) -> Result<(), userfaultfd::Error> {
+    if !write_protect {
+        return uffd.copy(src, dst, len, false).map(|_| ());
+    }
+    let mut copy = UffdioCopy {
+        dst: dst as u64,
+        src: src as u64,
+        len: len as u64,
+        mode: UFFDIO_COPY_MODE_DONTWAKE | UFFDIO_COPY_MODE_WP,
+        copy: 0,
+    };
+    if libc::ioctl(uffd.as_raw_fd(), UFFDIO_COPY as _, &mut copy) != 0 {
+        return Err(last_error());
+    }
+    Ok(())
+}
+
+/// UFFDIO_ZEROPAGE without waking. The zero page cannot be mapped write protected, the first
+/// write to it is resolved by the kernel without telling us
+pub(crate) unsafe fn zeropage(
+    uffd: &Uffd,
+    dst: *mut c_void,
+    len: usize,
+) -> Result<(), userfaultfd::Error> {
+    uffd.zeropage(dst, len, false).map(|_| ())
+}
+
+/// Let writes through to the range and wake whoever was waiting on them
+pub(crate) fn remove_write_protection(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+) -> Result<(), userfaultfd::Error> {
+    set_write_protection(uffd, start, len, 0)
+}
+
+/// Write protect a loaded range again, the next write to it faults
+pub(crate) fn write_protect(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+) -> Result<(), userfaultfd::Error> {
+    set_write_protection(uffd, start, len, UFFDIO_WRITEPROTECT_MODE_WP)
+}
+
+fn set_write_protection(
+    uffd: &Uffd,
+    start: *mut c_void,
+    len: usize,
+    mode: u64,
+) -> Result<(), userfaultfd::Error> {
+    let mut wp = UffdioWriteprotect {
+        range: UffdioRange {
+            start: start as u64,
+            len: len as u64,
+        },
+        mode,
+    };
+    let r = unsafe { libc::ioctl(uffd.as_raw_fd(), UFFDIO_WRITEPROTECT as _, &mut wp) };
+    if r != 0 {
+        return Err(last_error());
+    }
+    Ok(())
+}
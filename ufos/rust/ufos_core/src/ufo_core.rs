@@ -1,8 +1,14 @@
+use std::cell::Cell;
+use std::lazy::SyncOnceCell;
 use std::result::Result;
-use std::sync::{Arc, Mutex, RwLock};
+use std::sync::{
+    atomic::{AtomicBool, Ordering},
+    Arc, Mutex, RwLock, Weak,
+};
+use std::time::{Duration, Instant};
 use std::{alloc, ffi::c_void};
 use std::{
-    cmp::min,
+    cmp::{max, min},
     ops::{Deref, Range},
     vec::Vec,
 };
@@ -11,29 +17,48 @@ use std::{
     sync::MutexGuard,
 };
 
-use log::{debug, info, trace, warn};
+use log::{debug, error, info, trace, warn};
 
-use btree_interval_map::IntervalMap;
-use crossbeam::channel::{Receiver, Sender};
+use crossbeam::channel::{Receiver, Sender, TrySendError};
 use crossbeam::sync::WaitGroup;
 use rayon::iter::{IntoParallelIterator, ParallelIterator};
 use userfaultfd::Uffd;
 
+use crate::affinity::{check_cpus, pin_current_thread};
+use crate::arena::{ArenaSegment, UfoArena, UfoMapping};
+use crate::budget::{UfoBudget, UfoBudgetReservation};
+use crate::compression::UfoCompression;
+use crate::eviction::{
+    new_policy, EvictionHistory, EvictionPolicy, EvictionStats, UfoEvictionPolicy,
+};
 use crate::once_await::OnceFulfiller;
-use crate::populate_workers::{PopulateWorkers, RequestWorker, ShouldRun};
+use crate::persistent::PersistentFile;
+use crate::populate_workers::{PoolConfig, PoolStats, PopulateWorkers, RequestWorker, ShouldRun};
+use crate::readahead::{PrefetchJob, Readahead};
+use crate::reclaimer::Reclaimer;
+use crate::segment_map::SegmentMap;
+use crate::stats::{Counter, Recorders, StatsRecorder, UfoStage, UfoStats};
+use crate::uffd_ext::{
+    continue_range, copy, is_already_populated, register_minor, register_write_protect,
+    remove_write_protection, write_protect, zeropage, Pagefault, UffdEventBuffer,
+};
+use crate::writeback_log::{WritebackLog, WritebackLogStats};
 
 use super::errors::*;
+use super::math::down_to_nearest;
 use super::mmap_wrapers::*;
 use super::ufo_objects::*;
 
 pub enum UfoInstanceMsg {
     Shutdown(WaitGroup),
     Allocate(promissory::Fulfiller<WrappedUfoObject>, UfoObjectConfig),
+    AllocateBatch(promissory::Fulfiller<Vec<WrappedUfoObject>>, Vec<UfoObjectConfig>),
     Reset(WaitGroup, UfoId),
     Free(WaitGroup, UfoId),
+    Prefetch(WaitGroup, UfoId, Range<usize>),
 }
 
-struct UfoWriteBuffer {
+pub(crate) struct UfoWriteBuffer {
     ptr: *mut u8,
     size: usize,
 }
@@ -48,7 +73,7 @@ impl UfoWriteBuffer {
         }
     }
 
-    unsafe fn ensure_capcity(&mut self, capacity: usize) -> *mut u8 {
+    pub(crate) unsafe fn ensure_capcity(&mut self, capacity: usize) -> *mut u8 {
         if self.size < capacity {
             let layout = alloc::Layout::from_size_align(self.size, *PAGE_SIZE).unwrap();
             let new_ptr = alloc::realloc(self.ptr, layout, capacity);
@@ -66,9 +91,9 @@ impl UfoWriteBuffer {
     unsafe fn slice(&self) -> &[u8] {
         std::slice::from_raw_parts(self.ptr, self.size)
     }
-    // unsafe fn slice_mut(&self) -> &mut [u8] {
-    //     std::slice::from_raw_parts_mut(self.ptr, self.size)
-    // }
+    pub(crate) unsafe fn slice_mut(&mut self) -> &mut [u8] {
+        std::slice::from_raw_parts_mut(self.ptr, self.size)
+    }
 }
 
 impl Drop for UfoWriteBuffer {
@@ -83,90 +108,642 @@ impl Drop for UfoWriteBuffer {
 }
 
 struct UfoChunks {
-    loaded_chunks: VecDeque<UfoChunk>,
+    loaded_chunks: Box<dyn EvictionPolicy>,
+    history: EvictionHistory,
+    stats: EvictionStats,
     used_memory: usize,
-    config: Arc<UfoCoreConfig>,
+    policy: UfoEvictionPolicy,
 }
 
 impl UfoChunks {
-    fn new(config: Arc<UfoCoreConfig>) -> UfoChunks {
+    fn new(policy: UfoEvictionPolicy) -> UfoChunks {
         UfoChunks {
-            loaded_chunks: VecDeque::new(),
+            loaded_chunks: new_policy(policy),
+            history: EvictionHistory::new(),
+            stats: EvictionStats::default(),
             used_memory: 0,
-            config,
+            policy,
         }
     }
 
-    fn add(&mut self, chunk: UfoChunk) {
+    /// Hand every loaded chunk over to a new policy, whatever the old one learned about them is lost
+    fn set_policy(&mut self, policy: UfoEvictionPolicy) {
+        if policy == self.policy {
+            return;
+        }
+        let chunks = self.loaded_chunks.drain();
+        self.loaded_chunks = new_policy(policy);
+        chunks.into_iter().for_each(|c| self.loaded_chunks.add(c));
+        self.policy = policy;
+    }
+
+    /// Chunks are charged to their budget against the reservations made for them first
+    fn add(&mut self, mut chunk: UfoChunk, reservations: &mut [UfoBudgetReservation]) {
+        self.stats.loaded_chunks += 1;
+        if let Some(refaults) = self.history.loaded(&chunk) {
+            self.stats.refaulted_chunks += 1;
+            chunk.set_refaults(refaults);
+        }
         self.used_memory += chunk.size();
-        self.loaded_chunks.push_back(chunk);
+        if let Some(budget) = chunk.budget() {
+            let unreserved = reservations
+                .iter_mut()
+                .fold(chunk.size(), |bytes, r| r.settle(budget, bytes));
+            budget.charge(unreserved);
+        }
+        self.loaded_chunks.add(chunk);
     }
 
     fn drop_ufo_chunks(&mut self, ufo_id: UfoId) {
-        let chunks = &mut self.loaded_chunks;
-        chunks
-            .iter_mut()
-            .filter(|c| c.ufo_id() == ufo_id)
-            .for_each(UfoChunk::mark_freed);
-        self.used_memory = chunks.iter().map(UfoChunk::size).sum();
+        let mut dropped = 0;
+        self.loaded_chunks.retain(&mut |c| {
+            if c.ufo_id() == ufo_id {
+                dropped += c.size();
+                if let Some(budget) = c.budget() {
+                    budget.refund(c.size());
+                }
+                false
+            } else {
+                true
+            }
+        });
+        self.used_memory -= dropped;
     }
 
-    fn free_until_low_water_mark(&mut self) -> anyhow::Result<usize> {
-        debug!(target: "ufo_core", "Freeing memory");
-        let low_water_mark = self.config.low_watermark;
-
-        let mut to_free = Vec::new();
-        let mut will_free_bytes = 0;
-
-        while self.used_memory - will_free_bytes > low_water_mark {
-            match self.loaded_chunks.pop_front() {
-                None => anyhow::bail!("nothing to free"),
+    /// Pick eligible chunks to evict until `more` is satisfied and account for them as already
+    /// gone, the caller frees them after releasing the lock so faults elsewhere are not held up by
+    /// the writeback
+    fn take_while(
+        &mut self,
+        eligible: &dyn Fn(&UfoChunk) -> bool,
+        more: &dyn Fn(&UfoChunks) -> bool,
+        to_free: &mut Vec<UfoChunk>,
+    ) {
+        while more(self) {
+            match self.loaded_chunks.evict(&mut self.stats, eligible) {
+                None => return,
                 Some(chunk) => {
-                    let size = chunk.size(); // chunk.free_and_writeback_dirty()?;
-                    will_free_bytes += size;
+                    self.used_memory -= chunk.size();
+                    if let Some(budget) = chunk.budget() {
+                        budget.refund(chunk.size());
+                    }
+                    self.history.evicted(&chunk);
+                    self.stats.evicted_chunks += 1;
                     to_free.push(chunk);
-                    // self.used_memory -= size;
                 }
             }
         }
+    }
+
+    fn take_until(&mut self, target: usize) -> anyhow::Result<Vec<UfoChunk>> {
+        let mut to_free = Vec::new();
+        let over_target = |chunks: &UfoChunks| chunks.used_memory > target;
+
+        // spare chunks which budgets hold in reserve unless there is nothing else left
+        let unreserved = |c: &UfoChunk| c.budget().map_or(true, |b| !b.within_reservation());
+        self.take_while(&unreserved, &over_target, &mut to_free);
+        self.take_while(&|_| true, &over_target, &mut to_free);
+
+        anyhow::ensure!(self.used_memory <= target, "nothing to free");
+        Ok(to_free)
+    }
+
+    fn take_from_budget(&mut self, budget: &Arc<UfoBudget>, target: usize) -> Vec<UfoChunk> {
+        let mut to_free = Vec::new();
+        self.take_while(
+            &|c| c.budget().map_or(false, |b| Arc::ptr_eq(b, budget)),
+            &|_| budget.used() > target,
+            &mut to_free,
+        );
+        to_free
+    }
+
+    fn rebudget(&mut self, ufo_id: UfoId, budget: &Option<Arc<UfoBudget>>) {
+        self.loaded_chunks.retain(&mut |c| {
+            if c.ufo_id() == ufo_id {
+                if let Some(old) = c.budget() {
+                    old.refund(c.size());
+                }
+                if let Some(new) = budget {
+                    new.charge(c.size());
+                }
+                c.set_budget(budget.clone());
+            }
+            true
+        });
+    }
+
+    fn free_chunks(stats: &StatsRecorder, to_free: Vec<UfoChunk>) -> anyhow::Result<usize> {
+        debug!(target: "ufo_core", "Freeing memory");
 
         let freed_memory = to_free
             .into_par_iter()
-            .map_init(ChunkFreer::new, |f, mut c| f.free_chunk(&mut c))
+            .map_init(|| ChunkFreer::new(stats), |f, mut c| f.free_chunk(&mut c))
             .reduce(|| Ok(0), |a, b| Ok(a? + b?))?;
 
         debug!(target: "ufo_core", "Done freeing memory");
 
-        self.used_memory -= freed_memory;
-        assert!(self.used_memory <= low_water_mark);
+        Ok(freed_memory)
+    }
+}
+
+/// Populate the chunk containing `addr` without waking anyone. `publish` is called with the UFO
+/// still read locked once the data is in place, unless the chunk was already resident
+fn populate_chunk(
+    core: &UfoCore,
+    buffer: &mut UfoWriteBuffer,
+    ufo_arc: &WrappedUfoObject,
+    addr: usize,
+    write: bool,
+    expect_generation: Option<u64>,
+    publish: impl FnOnce(UfoChunk, &Range<usize>),
+) -> Result<Range<usize>, UfoPopulateError> {
+    let ufo = ufo_arc.read().unwrap();
+    let stats = Recorders {
+        core: &core.stats,
+        ufo: &ufo.stats,
+    };
+
+    let fault_offset = UfoOffset::from_addr(ufo.deref(), addr as *mut c_void);
+
+    let config = &ufo.config;
+
+    let load_size = config.elements_loaded_at_once * config.stride;
+
+    let populate_offset = fault_offset.down_to_nearest_n_relative_to_header(load_size);
+
+    let start = populate_offset.as_index_floor();
+    let end = start + config.elements_loaded_at_once;
+    let pop_end = min(end, config.element_ct);
+
+    let populate_size = min(
+        load_size,
+        config.true_size - populate_offset.absolute_offset(),
+    );
+
+    debug!(target: "ufo_core", "fault at {}, populate {} bytes at {:#x}",
+        start, (pop_end-start) * config.stride, populate_offset.as_ptr_int());
+
+    let mut chunk = UfoChunk::new(ufo_arc, &ufo, populate_offset, populate_size);
+    let populate_range = Range {
+        start: chunk.offset().as_ptr_int(),
+        end: chunk.offset().as_ptr_int() + populate_size,
+    };
+    trace!("spin locking {:?}.{}", ufo.id, chunk.offset());
+    let chunk_lock = ufo
+        .writeback_util
+        .chunk_locks
+        .spinlock(chunk.offset().chunk_number())
+        .map_err(|_| UfoPopulateError)?;
+
+    if expect_generation.map_or(false, |g| g != ufo.generation) {
+        // prefetching a UFO which has since been reset or freed
+        return Ok(populate_range);
+    }
 
-        Ok(self.used_memory)
+    if ufo.resident_chunks.get(chunk.offset().chunk_number()) {
+        // a prefetch got here while we waited for the lock
+        ufo.referenced_chunks.set(chunk.offset().chunk_number());
+        trace!(target: "ufo_core", "{:?} chunk {} already resident", ufo.id, chunk.offset().chunk_number());
+        return Ok(populate_range);
     }
+
+    let load_started = Instant::now();
+    // chunks written back hold whatever was written to them, only the source can say otherwise
+    let fill = match &config.fill {
+        Some(fill) if !ufo.writeback_util.is_written(chunk.offset()) => match fill(start, pop_end) {
+            UfoChunkFill::Constant(element) if element.iter().all(|b| *b == 0) => UfoChunkFill::Zero,
+            UfoChunkFill::Constant(element) if element.len() != config.stride => {
+                warn!(target: "ufo_core", "{:?} constant of {} bytes, stride is {}",
+                    ufo.id, element.len(), config.stride);
+                UfoChunkFill::Data
+            }
+            fill => fill,
+        },
+        _ => UfoChunkFill::Data,
+    };
+    // shared memory is loaded straight into the page cache, then mapped without copying
+    let page_cache = ufo.shared_memory.as_ref().map(|shared_memory| unsafe {
+        let alias = shared_memory.as_ptr(chunk.offset().absolute_offset());
+        std::slice::from_raw_parts_mut(alias, populate_size)
+    });
+    let template: Arc<[u8]>;
+    let raw_data: &[u8] = if fill != UfoChunkFill::Data {
+        trace!(target: "ufo_core", "constant {:?}", fill);
+        stats.add(Counter::ConstantChunks, 1);
+        template = match &fill {
+            UfoChunkFill::Constant(element) => ufo.constant_template(element),
+            _ => Arc::from(Vec::new()),
+        };
+        match (page_cache, &ufo.shared_memory) {
+            (Some(page_cache), Some(shared_memory)) => {
+                if fill == UfoChunkFill::Zero {
+                    // there is no zero page to share, zeroed pages cost no more
+                    shared_memory.allocate(chunk.offset().absolute_offset(), populate_size)
+                } else {
+                    page_cache.copy_from_slice(&template[0..populate_size]);
+                    Ok(())
+                }
+                .map_err(|e| {
+                    error!(target: "ufo_core", "shared memory fill failed {:?}: {}", ufo.id, e);
+                    UfoPopulateError
+                })?;
+                &*page_cache
+            }
+            _ => &template[..],
+        }
+    } else if ufo.writeback_util.is_written(chunk.offset()) {
+        stats.add(Counter::ReadbackHits, 1);
+        // compressed chunks are inflated on the populate worker, into the buffer or the page cache
+        match page_cache {
+            Some(page_cache) => {
+                match ufo.writeback_util.read_chunk(chunk.offset().chunk_number(), page_cache) {
+                    Ok(()) => Ok(&*page_cache),
+                    Err(e) => Err(e),
+                }
+            }
+            None => ufo.writeback_util.readback(chunk.offset(), buffer),
+        }
+        .map_err(|e| {
+            error!(target: "ufo_core", "readback failed {:?}: {}", ufo.id, e);
+            UfoPopulateError
+        })?
+    } else {
+        trace!(target: "ufo_core", "calculate");
+        stats.add(Counter::PopulateCalls, 1);
+        let populate_started = Instant::now();
+        let data = unsafe {
+            match page_cache {
+                Some(page_cache) => {
+                    let populated = core.populate(config, start, pop_end, page_cache.as_mut_ptr());
+                    if populated.is_err() {
+                        // nothing half written is left for a zero fill to find later
+                        let shared_memory = ufo.shared_memory.as_ref().expect("shared memory");
+                        let _ = shared_memory.punch(chunk.offset().absolute_offset(), populate_size);
+                    }
+                    populated?;
+                    &*page_cache
+                }
+                None => {
+                    buffer.ensure_capcity(load_size);
+                    core.populate(config, start, pop_end, buffer.ptr)?;
+                    &buffer.slice()[0..load_size]
+                }
+            }
+        };
+        stats.record(UfoStage::Populate, populate_started);
+        data
+    };
+    trace!(target: "ufo_core", "data ready");
+    chunk.set_populate_cost_ns(load_started.elapsed().as_nanos() as u64);
+
+    // a write fault would only come straight back as a write protect fault, call it dirty now
+    let write_protect = match &ufo.dirty_chunks {
+        Some(dirty) if write => {
+            dirty.set(chunk.offset().chunk_number());
+            false
+        }
+        Some(dirty) => {
+            dirty.clear(chunk.offset().chunk_number());
+            true
+        }
+        None => false,
+    };
+
+    // once mapped the page cache can be written to right away, so it is hashed before rather than after
+    let mut hashed = None;
+    if ufo.shared_memory.is_some() && fill == UfoChunkFill::Data && config.should_try_writeback() {
+        let hash_started = Instant::now();
+        hashed = Some(hash_function(&raw_data[0..populate_size]));
+        stats.record(UfoStage::Hash, hash_started);
+    }
+
+    let copy_started = Instant::now();
+    let copied = unsafe {
+        match fill {
+            _ if ufo.shared_memory.is_some() => continue_range(
+                &core.uffd,
+                populate_range.start as *mut c_void,
+                populate_size,
+                false,
+            ),
+            // shares the zero page until written, eviction compares the data to tell
+            UfoChunkFill::Zero => zeropage(
+                &core.uffd,
+                populate_range.start as *mut c_void,
+                populate_size,
+            ),
+            _ => copy(
+                &core.uffd,
+                raw_data.as_ptr().cast(),
+                populate_range.start as *mut c_void,
+                populate_size,
+                write_protect,
+            ),
+        }
+    };
+    stats.record(UfoStage::Copy, copy_started);
+    if copied.is_ok() {
+        // the zero page cannot be collapsed, it stays shared until written
+        if config.huge_pages && fill != UfoChunkFill::Zero {
+            core.collapse(stats, populate_range.start as *mut u8, populate_size);
+        }
+        if fill != UfoChunkFill::Data {
+            ufo.constant_chunks.set(chunk.offset().chunk_number());
+        }
+        if ufo.shared_memory.is_some() {
+            stats.add(Counter::SharedMemoryChunks, 1);
+        }
+        ufo.resident_chunks.set(chunk.offset().chunk_number());
+        stats.record(UfoStage::Load, load_started);
+    }
+    // hold the chunk lock over the copy so a racing worker sees all of the chunk or none of it
+    trace!("unlock populate {:?}.{}", ufo.id, chunk.offset());
+    chunk_lock.unlock();
+
+    match copied {
+        Err(e) if is_already_populated(&e) => {
+            // several threads faulted on this chunk and another worker got to it first
+            debug!(target: "ufo_core", "{:?} chunk {} already populated",
+                ufo.id, chunk.offset().chunk_number());
+            ufo.referenced_chunks.set(chunk.offset().chunk_number());
+            return Ok(populate_range);
+        }
+        copied => {
+            copied.expect("unable to populate range");
+        }
+    }
+    trace!(target: "ufo_core", "populated");
+
+    let constant = fill != UfoChunkFill::Data;
+    assert!(constant || raw_data.len() >= populate_size);
+    let hash_fulfiller = chunk.hash_fulfiller();
+    chunk.set_fill(fill);
+
+    // the chunk must be visible to resets and eviction before the faulting threads are woken
+    publish(chunk, &populate_range);
+
+    if !config.should_try_writeback() || ufo.dirty_chunks.is_some() || constant {
+        hash_fulfiller.try_init(None);
+    } else if hashed.is_some() {
+        hash_fulfiller.try_init(hashed);
+    } else {
+        // Make sure to take a slice of the raw data. the kernel operates in page sized chunks but the UFO ends where it ends
+        let hash_started = Instant::now();
+        let calculated_hash = hash_function(&raw_data[0..populate_size]);
+        stats.record(UfoStage::Hash, hash_started);
+        hash_fulfiller.try_init(Some(calculated_hash));
+    }
+
+    Ok(populate_range)
 }
 
+/// How the core tells whether a chunk was written to before it writes it back
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UfoDirtyTracking {
+    /// Hash chunks when they are loaded and again when they are freed
+    Hash,
+    /// Load chunks write protected and take note of the first write to each (userfaultfd write
+    /// protection, Linux 5.7+). UFOs fall back to hashing where the kernel does not support it
+    WriteProtect,
+}
+
+/// What the body of a UFO is made of
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UfoBacking {
+    /// Private anonymous memory, chunks are copied in with UFFDIO_COPY
+    Anonymous,
+    /// A memfd, chunks are populated and read back straight into its page cache and then mapped
+    /// with UFFDIO_CONTINUE, nothing is copied (userfaultfd minor faults, Linux 5.14+). Dirty
+    /// chunks are found by hashing. Huge page UFOs fall back to anonymous memory, and on kernels
+    /// without minor faults on shared memory the core's config says Anonymous instead
+    SharedMemory,
+}
+
+#[derive(Debug, Clone)]
 pub struct UfoCoreConfig {
     pub writeback_temp_path: String,
     pub high_watermark: usize,
     pub low_watermark: usize,
+    /// Most faults a populate worker drains from the userfaultfd in one read
+    pub fault_batch_size: usize,
+    /// Chunks read ahead once a UFO is seen being walked with a constant stride, 0 disables readahead
+    pub readahead_depth: usize,
+    /// The readahead window doubles while the walk continues but never covers more than this many bytes
+    pub readahead_max_bytes: usize,
+    pub eviction_policy: UfoEvictionPolicy,
+    /// Loaded chunks past this are trimmed to the low watermark in the background, defaults to half
+    /// way between the low and high watermarks
+    pub background_watermark: Option<usize>,
+    /// Most threads in each of the populate and prefetch pools, 0 is no limit. When every populate
+    /// worker is stuck in a populate function, as for UFOs populated from other UFOs, one more is
+    /// started past the limit to read the faults they wait on (see PopulateWorkers::watch_populates)
+    pub max_workers: usize,
+    /// Worker threads are pinned to these cpus (see affinity::numa_node_cpus), empty runs them anywhere
+    pub worker_cpus: Vec<usize>,
+    /// Spare workers which had nothing to do for this long exit, None keeps them around
+    pub worker_idle_timeout: Option<Duration>,
+    /// Applies to UFOs allocated from now on
+    pub dirty_tracking: UfoDirtyTracking,
+    /// How evicted dirty chunks are compressed on their way to disk, applies to UFOs allocated from
+    /// now on
+    pub writeback_compression: UfoCompression,
+    /// Evicted chunks queued up for the writer thread to write out in batches, 0 has the evicting
+    /// thread write each chunk itself. Applies to UFOs allocated from now on
+    pub writeback_queue_depth: usize,
+    /// Write back with O_DIRECT, past the page cache the populate functions are reading through.
+    /// Applies to UFOs allocated from now on
+    pub writeback_direct_io: bool,
+    /// UFOs with a body at least this large are loaded as transparent huge pages (see
+    /// UfoObjectConfig::with_huge_pages), 0 leaves it to each UFO. Applies to UFOs allocated from
+    /// now on
+    pub huge_page_min_bytes: usize,
+    /// Applies to UFOs allocated from now on
+    pub backing: UfoBacking,
+    /// Address space reserved and registered with the kernel once, for UFOs of up to a sixteenth of
+    /// it to be carved out of rather than mapped and registered one by one. 0 maps every UFO on
+    /// its own. Fixed by the first UFO that goes in the arena
+    pub arena_bytes: usize,
+}
+
+// Below this the watermarks leave too little room between them to be useful
+const MIN_HIGH_WATERMARK: usize = 64 * 1024 * 1024;
+
+impl UfoCoreConfig {
+    fn pool_config(&self) -> PoolConfig {
+        PoolConfig {
+            max_workers: self.max_workers,
+            cpus: Arc::new(self.worker_cpus.clone()),
+            idle_timeout: self.worker_idle_timeout,
+        }
+    }
+
+    /// Size the watermarks to the memory we can actually get (see system_limits), leaving half of it
+    /// to whoever else lives in this process. Keeps the current watermarks if nothing can be read
+    pub fn with_system_watermarks(mut self) -> Self {
+        if let Some(limit) = crate::system_limits::memory_limit() {
+            self.high_watermark = std::cmp::max(limit / 2, MIN_HIGH_WATERMARK);
+            self.low_watermark = self.high_watermark / 2;
+            self.background_watermark = None;
+        }
+        self
+    }
+
+    /// Whether a core can run like this with chunks of up to `largest_chunk` bytes. Between them the
+    /// watermarks have to fit the largest chunk on its own and a full fault batch of the smallest
+    fn validate(&self, largest_chunk: usize) -> anyhow::Result<()> {
+        anyhow::ensure!(
+            self.low_watermark < self.high_watermark,
+            "low watermark {} must be below the high watermark {}",
+            self.low_watermark,
+            self.high_watermark
+        );
+        anyhow::ensure!(self.fault_batch_size > 0, "fault batch size must be positive");
+        let room = self.high_watermark - self.low_watermark;
+        let needed = max(self.fault_batch_size.saturating_mul(*PAGE_SIZE), largest_chunk);
+        anyhow::ensure!(
+            room > needed,
+            "the watermarks are {} bytes apart, loading needs more than {}",
+            room,
+            needed
+        );
+        if let Some(mark) = self.background_watermark {
+            anyhow::ensure!(
+                self.low_watermark <= mark && mark <= self.high_watermark,
+                "background watermark {} must be between the low and high watermarks",
+                mark
+            );
+        }
+        check_cpus(&self.worker_cpus)
+    }
+
+    pub fn start_reclaim_at(&self) -> usize {
+        self.background_watermark
+            .unwrap_or(self.low_watermark + (self.high_watermark - self.low_watermark) / 2)
+            .clamp(self.low_watermark, self.high_watermark)
+    }
+}
+
+impl Default for UfoCoreConfig {
+    fn default() -> Self {
+        UfoCoreConfig {
+            writeback_temp_path: "/tmp".to_string(),
+            high_watermark: 2 * 1024 * 1024 * 1024,
+            low_watermark: 1024 * 1024 * 1024,
+            fault_batch_size: 64,
+            readahead_depth: 4,
+            readahead_max_bytes: 64 * 1024 * 1024,
+            eviction_policy: UfoEvictionPolicy::Clock,
+            background_watermark: None,
+            max_workers: 0,
+            worker_cpus: Vec::new(),
+            worker_idle_timeout: Some(Duration::from_secs(10)),
+            dirty_tracking: UfoDirtyTracking::WriteProtect,
+            writeback_compression: UfoCompression::None,
+            writeback_queue_depth: 64,
+            writeback_direct_io: false,
+            huge_page_min_bytes: 0,
+            backing: UfoBacking::Anonymous,
+            arena_bytes: 0,
+        }
+    }
 }
 
 pub type WrappedUfoObject = Arc<RwLock<UfoObject>>;
 
+// Readahead requests beyond this are dropped, the chunks will simply be faulted in
+const PREFETCH_QUEUE_DEPTH: usize = 64;
+
+thread_local! {
+    // set on the threads of the populate pool, which the watchdog has to see stuck in a populate
+    static POPULATE_WORKER: Cell<bool> = Cell::new(false);
+}
+
+type WorkerPool = PopulateWorkers<Box<dyn Fn(&dyn RequestWorker) + Send + Sync>>;
+
+struct Prefetcher {
+    send: Sender<PrefetchJob>,
+    recv: Receiver<PrefetchJob>,
+    workers: Arc<WorkerPool>,
+    // asked for with ufo_prefetch but not yet in the queue, moved there as the workers take jobs
+    pending: Mutex<VecDeque<PrefetchJob>>,
+}
+
+impl Prefetcher {
+    /// Queue a job which must not be dropped, it waits in line when the queue is full
+    fn submit(&self, job: PrefetchJob) {
+        let pending = &mut *self.pending.lock().unwrap();
+        if !pending.is_empty() {
+            pending.push_back(job);
+            return;
+        }
+        match self.send.try_send(job) {
+            Ok(()) => self.workers.request_worker(),
+            Err(TrySendError::Full(job)) => pending.push_back(job),
+            Err(TrySendError::Disconnected(_)) => (),
+        }
+    }
+
+    /// Move jobs waiting in line to the queue while there is room
+    fn refill(&self) {
+        let pending = &mut *self.pending.lock().unwrap();
+        while let Some(job) = pending.pop_front() {
+            match self.send.try_send(job) {
+                Ok(()) => self.workers.request_worker(),
+                Err(TrySendError::Full(job)) => {
+                    pending.push_front(job);
+                    return;
+                }
+                Err(TrySendError::Disconnected(_)) => {
+                    pending.clear();
+                    return;
+                }
+            }
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct WorkerStats {
+    pub populate: PoolStats,
+    pub prefetch: PoolStats,
+    /// Chunks waiting in the prefetch queue, or in line for it
+    pub prefetch_queue_depth: usize,
+}
+
 pub struct UfoCoreState {
     object_id_gen: UfoIdGen,
 
     objects_by_id: HashMap<UfoId, WrappedUfoObject>,
-    objects_by_segment: IntervalMap<usize, WrappedUfoObject>,
-
-    loaded_chunks: UfoChunks,
 }
 
+// Lock order: state, then a UFO, then segments or loaded_chunks
+// never wait on a UFO lock while holding the segments or loaded_chunks
 pub struct UfoCore {
     uffd: Uffd,
-    pub config: Arc<UfoCoreConfig>,
+    // swapped out whole by reconfigure, take a copy of the Arc rather than holding the lock
+    config: RwLock<Arc<UfoCoreConfig>>,
+    // the populate workers own the core, not the other way around
+    populate_workers: SyncOnceCell<Weak<WorkerPool>>,
 
     pub msg_send: Sender<UfoInstanceMsg>,
     state: Mutex<UfoCoreState>,
+    // read on every fault, only written on allocate and free
+    segments: RwLock<SegmentMap<WrappedUfoObject>>,
+    loaded_chunks: Mutex<UfoChunks>,
+    prefetcher: SyncOnceCell<Prefetcher>,
+    reclaimer: Arc<Reclaimer>,
+    stats: StatsRecorder,
+    // shared by every writable UFO, replaced when the writeback path is reconfigured
+    writeback_log: Mutex<Option<Arc<WritebackLog>>>,
+    // cleared once the kernel says it has no MADV_COLLAPSE, huge page chunks are left to khugepaged
+    collapse_huge_pages: AtomicBool,
+    // splits up the chunks of UFOs populated in parallel, started for the first of them
+    populate_pool: SyncOnceCell<rayon::ThreadPool>,
+    // small UFOs are carved out of this, reserved for the first of them. None if that failed
+    arena: SyncOnceCell<Option<Arc<UfoArena>>>,
+    // whether the kernel tells us about minor faults on shared memory, tried the first time asked
+    shared_memory_minor_faults: SyncOnceCell<bool>,
 }
 
 impl UfoCore {
@@ -207,6 +784,10 @@ impl UfoCore {
     // }
 
     pub fn new(config: UfoCoreConfig) -> Result<Arc<UfoCore>, std::io::Error> {
+        config
+            .validate(0)
+            .map_err(|e| std::io::Error::new(std::io::ErrorKind::InvalidInput, e.to_string()))?;
+
         // If this fails then there is nothing we should even try to do about it honestly
         let uffd = userfaultfd::UffdBuilder::new()
             .close_on_exec(true)
@@ -214,7 +795,9 @@ impl UfoCore {
             .create()
             .unwrap();
 
-        let config = Arc::new(config);
+        let pool_config = config.pool_config();
+        let policy = config.eviction_policy;
+        let config = RwLock::new(Arc::new(config));
         // We want zero capacity so that when we shut down there isn't a chance of any messages being lost
         // TODO CMYK 2021.03.04: find a way to close the channel but still clear the queue
         let (send, recv) = crossbeam::channel::bounded(0);
@@ -222,26 +805,66 @@ impl UfoCore {
         let state = Mutex::new(UfoCoreState {
             object_id_gen: UfoIdGen::new(),
 
-            loaded_chunks: UfoChunks::new(Arc::clone(&config)),
             objects_by_id: HashMap::new(),
-            objects_by_segment: IntervalMap::new(),
         });
 
         let core = Arc::new(UfoCore {
             uffd,
+            loaded_chunks: Mutex::new(UfoChunks::new(policy)),
             config,
+            populate_workers: SyncOnceCell::new(),
             msg_send: send,
             // msg_recv: recv,
             state,
+            segments: RwLock::new(SegmentMap::new()),
+            prefetcher: SyncOnceCell::new(),
+            reclaimer: Reclaimer::new(),
+            stats: StatsRecorder::new(),
+            writeback_log: Mutex::new(None),
+            collapse_huge_pages: AtomicBool::new(true),
+            populate_pool: SyncOnceCell::new(),
+            arena: SyncOnceCell::new(),
+            shared_memory_minor_faults: SyncOnceCell::new(),
         });
+        let supported = core.supported(core.config().as_ref().clone());
+        *core.config.write().unwrap() = Arc::new(supported);
 
         trace!(target: "ufo_core", "starting threads");
         let pop_core = core.clone();
-        let pop_workers = PopulateWorkers::new("Ufo Core", move |request_worker| {
-            UfoCore::populate_loop(pop_core.clone(), request_worker)
-        });
+        let pop_work: Box<dyn Fn(&dyn RequestWorker) + Send + Sync> =
+            Box::new(move |request_worker| {
+                UfoCore::populate_loop(pop_core.clone(), request_worker)
+            });
+        let pop_workers = PopulateWorkers::new("Ufo Core", pool_config.clone(), pop_work);
+        core.populate_workers
+            .set(Arc::downgrade(&pop_workers))
+            .ok()
+            .expect("populate workers already started");
         pop_workers.request_worker();
         PopulateWorkers::spawn_worker(pop_workers.clone());
+        PopulateWorkers::watch_populates(&pop_workers);
+
+        // the prefetch workers only hold a weak reference, they would otherwise keep the core alive
+        let (prefetch_send, prefetch_recv) = crossbeam::channel::bounded(PREFETCH_QUEUE_DEPTH);
+        let prefetch_core = Arc::downgrade(&core);
+        let prefetch_work: Box<dyn Fn(&dyn RequestWorker) + Send + Sync> =
+            Box::new(move |request_worker| UfoCore::prefetch_loop(&prefetch_core, request_worker));
+        let prefetch_workers = PopulateWorkers::new("Ufo Prefetch", pool_config, prefetch_work);
+        PopulateWorkers::spawn_worker(prefetch_workers.clone());
+        core.prefetcher
+            .set(Prefetcher {
+                send: prefetch_send,
+                recv: prefetch_recv,
+                workers: prefetch_workers,
+                pending: Mutex::new(VecDeque::new()),
+            })
+            .ok()
+            .expect("prefetcher already started");
+
+        let reclaim_core = Arc::downgrade(&core);
+        Reclaimer::spawn(core.reclaimer.clone(), move |reclaimer| {
+            UfoCore::reclaim_loop(&reclaim_core, reclaimer)
+        });
 
         // std::thread::Builder::new()
         //     .name("Ufo Core".to_string())
@@ -259,6 +882,7 @@ impl UfoCore {
         &self,
         object_config: UfoObjectConfig,
     ) -> Result<WrappedUfoObject, UfoAllocateErr> {
+        let object_config = self.prepare_config(object_config)?;
         let (fulfiller, awaiter) = promissory::promissory();
         self.msg_send
             .send(UfoInstanceMsg::Allocate(fulfiller, object_config))
@@ -267,6 +891,87 @@ impl UfoCore {
         Ok(awaiter.await_value()?)
     }
 
+    /// Allocate many UFOs in one round trip to the msg loop, in the order of `object_configs`.
+    /// Either every one of them is allocated or, if any config is refused, none are
+    pub fn allocate_ufos(
+        &self,
+        object_configs: Vec<UfoObjectConfig>,
+    ) -> Result<Vec<WrappedUfoObject>, UfoAllocateErr> {
+        if object_configs.is_empty() {
+            return Ok(Vec::new());
+        }
+        let object_configs = object_configs
+            .into_iter()
+            .map(|object_config| self.prepare_config(object_config))
+            .collect::<Result<Vec<_>, _>>()?;
+        let (fulfiller, awaiter) = promissory::promissory();
+        self.msg_send
+            .send(UfoInstanceMsg::AllocateBatch(fulfiller, object_configs))
+            .expect("Messages pipe broken");
+
+        Ok(awaiter.await_value()?)
+    }
+
+    /// What can go wrong with a config goes wrong here, on the allocating thread
+    fn prepare_config(
+        &self,
+        mut object_config: UfoObjectConfig,
+    ) -> Result<UfoObjectConfig, UfoAllocateErr> {
+        // before the persistent file is opened, the chunks may grow
+        let huge_page_min_bytes = self.config().huge_page_min_bytes;
+        if huge_page_min_bytes > 0
+            && object_config.element_ct * object_config.stride >= huge_page_min_bytes
+        {
+            object_config = object_config.with_huge_pages();
+        }
+
+        if let Some(persistence) = &object_config.persistence {
+            if !object_config.should_try_writeback() {
+                return Err(UfoAllocateErr::PersistenceError(
+                    "read only UFOs cannot be persistent".to_string(),
+                ));
+            }
+            let header = object_config.persistent_header(persistence);
+            let file = PersistentFile::open(persistence, header)
+                .map_err(|e| UfoAllocateErr::PersistenceError(e.to_string()))?;
+            object_config.persistent_file = Some(file);
+        }
+        Ok(object_config)
+    }
+
+    /// A new UFO holding what `parent` holds now, with its header. The clone is populated by the
+    /// parent's populate function and shares the chunks the parent wrote back, copy on write, so
+    /// only the chunks either of them changes afterwards take up space twice
+    pub fn clone_ufo(&self, parent: &WrappedUfoObject) -> Result<WrappedUfoObject, UfoAllocateErr> {
+        let lock_broken = |_| UfoAllocateErr::CloneError("Broken Ufo Lock".to_string());
+        let config = {
+            let parent = parent.read().map_err(lock_broken)?;
+            debug!(target: "ufo_core", "clone {:?}", parent.id);
+            let mut config = parent.config.clone_config();
+            config.shared_chunks = Some(
+                parent
+                    .share_chunks()
+                    .map_err(|e| UfoAllocateErr::CloneError(e.to_string()))?,
+            );
+            config
+        };
+
+        // not holding the parent, the msg loop may be waiting to free or reset it
+        let clone = self.allocate_ufo(config)?;
+        {
+            let parent = parent.read().map_err(lock_broken)?;
+            let clone = clone.read().map_err(lock_broken)?;
+            unsafe {
+                std::ptr::copy_nonoverlapping(
+                    parent.header_ptr().cast::<u8>(),
+                    clone.header_ptr().cast::<u8>(),
+                    parent.config.header_size,
+                );
+            }
+        }
+        Ok(clone)
+    }
+
     fn get_locked_state(&self) -> anyhow::Result<MutexGuard<UfoCoreState>> {
         match self.state.lock() {
             Err(_) => Err(anyhow::Error::msg("broken lock")),
@@ -274,11 +979,561 @@ impl UfoCore {
         }
     }
 
-    fn ensure_capcity(config: &UfoCoreConfig, state: &mut UfoCoreState, to_load: usize) {
-        assert!(to_load + config.low_watermark < config.high_watermark);
-        if to_load + state.loaded_chunks.used_memory > config.high_watermark {
-            state.loaded_chunks.free_until_low_water_mark().unwrap();
+    pub fn config(&self) -> Arc<UfoCoreConfig> {
+        self.config.read().unwrap().clone()
+    }
+
+    /// Change the configuration of a running core. Smaller watermarks are enforced straight away,
+    /// the writeback path only applies to UFOs allocated from now on, the fault batch size and cpu
+    /// affinity to workers started from now on
+    pub fn reconfigure(&self, config: UfoCoreConfig) -> anyhow::Result<()> {
+        let largest_chunk = {
+            let state = self.get_locked_state()?;
+            state
+                .objects_by_id
+                .values()
+                .map(|ufo| {
+                    let ufo = ufo.read().unwrap();
+                    ufo.config.elements_loaded_at_once * ufo.config.stride
+                })
+                .max()
+                .unwrap_or(0)
+        };
+        config.validate(largest_chunk)?;
+        let config = self.supported(config);
+        debug!(target: "ufo_core", "reconfigure {:?}", config);
+
+        if let Some(workers) = self.populate_workers.get().and_then(Weak::upgrade) {
+            workers.configure(config.pool_config());
+        }
+        if let Some(prefetcher) = self.prefetcher.get() {
+            prefetcher.workers.configure(config.pool_config());
+        }
+        self.get_locked_chunks()?.set_policy(config.eviction_policy);
+        *self.config.write().unwrap() = Arc::new(config);
+        self.ensure_capcity(0);
+        Ok(())
+    }
+
+    pub fn worker_stats(&self) -> WorkerStats {
+        let prefetcher = self.prefetcher.get();
+        WorkerStats {
+            populate: self
+                .populate_workers
+                .get()
+                .and_then(Weak::upgrade)
+                .map(|w| w.stats())
+                .unwrap_or_default(),
+            prefetch: prefetcher.map(|p| p.workers.stats()).unwrap_or_default(),
+            prefetch_queue_depth: prefetcher
+                .map_or(0, |p| p.recv.len() + p.pending.lock().unwrap().len()),
+        }
+    }
+
+    /// Bytes in all the chunks currently loaded
+    pub fn loaded_memory(&self) -> usize {
+        self.get_locked_chunks().unwrap().used_memory
+    }
+
+    /// Counters and latencies over every UFO, see UfoObject::stats for a single one
+    pub fn stats(&self) -> UfoStats {
+        self.stats.snapshot(self.loaded_memory())
+    }
+
+    /// Start counting from zero again, for the core and every UFO
+    pub fn reset_stats(&self) -> anyhow::Result<()> {
+        self.stats.reset();
+        let ufos: Vec<WrappedUfoObject> = self
+            .get_locked_state()?
+            .objects_by_id
+            .values()
+            .cloned()
+            .collect();
+        for ufo in ufos {
+            ufo.read()
+                .map_err(|_| anyhow::anyhow!("lock poisoned"))?
+                .stats
+                .reset();
         }
+        Ok(())
+    }
+
+    fn readahead_max_window(&self, chunk_size: usize, budget: Option<&Arc<UfoBudget>>) -> usize {
+        let config = self.config();
+        // a window larger than what is trimmed on each reclaim would only evict itself
+        let max_bytes = min(
+            config.readahead_max_bytes,
+            (config.start_reclaim_at() - config.low_watermark) / 2,
+        );
+        let max_bytes = budget.map_or(max_bytes, |b| min(max_bytes, b.cap / 4));
+        std::cmp::max(1, max_bytes / chunk_size)
+    }
+
+    fn get_locked_chunks(&self) -> anyhow::Result<MutexGuard<UfoChunks>> {
+        match self.loaded_chunks.lock() {
+            Err(_) => Err(anyhow::Error::msg("broken chunk lock")),
+            Ok(l) => Ok(l),
+        }
+    }
+
+    fn ensure_capcity(&self, to_load: usize) {
+        let config = self.config();
+        let started = Instant::now();
+        // a group sized against watermarks which have since shrunk may not fit between them, then
+        // make as much room as it takes (at worst everything) rather than refuse to load it
+        let low_watermark = min(
+            config.low_watermark,
+            config.high_watermark.saturating_sub(to_load),
+        );
+        let to_free = {
+            let chunks = &mut *self.get_locked_chunks().unwrap();
+            let will_use = to_load + chunks.used_memory;
+            if will_use > config.start_reclaim_at() {
+                self.reclaimer.request();
+            }
+            if will_use <= config.high_watermark {
+                return;
+            }
+            // the reclaimer fell behind, make room ourselves
+            chunks.stats.direct_reclaims += 1;
+            chunks.take_until(low_watermark).unwrap()
+        };
+        UfoChunks::free_chunks(&self.stats, to_free).unwrap();
+        self.stats
+            .record(UfoStage::Reclaim, started.elapsed().as_nanos() as u64);
+    }
+
+    /// Keep a UFO budget under its cap by evicting from that budget alone, and reserve what is
+    /// about to be loaded in the same step so concurrent loads cannot all pass the check before
+    /// any of them is charged. Only loads in flight together beyond the cap can overshoot it
+    fn ensure_budget(&self, budget: &Arc<UfoBudget>, to_load: usize) -> UfoBudgetReservation {
+        let started = Instant::now();
+        let (to_free, reservation) = {
+            let chunks = &mut *self.get_locked_chunks().unwrap();
+            if budget.used() + to_load <= budget.cap {
+                return budget.reserve(to_load);
+            }
+            chunks.stats.budget_reclaims += 1;
+            let to_free = chunks.take_from_budget(budget, budget.trim_target(to_load));
+            (to_free, budget.reserve(to_load))
+        };
+        UfoChunks::free_chunks(&self.stats, to_free).unwrap();
+        self.stats
+            .record(UfoStage::Reclaim, started.elapsed().as_nanos() as u64);
+        reservation
+    }
+
+    /// Hand back what the loads did not use of their reservations. A load which overshot a cap,
+    /// because others in flight at the same time held the room, trims its budget once it is done
+    fn settle_budgets(&self, reservations: Vec<UfoBudgetReservation>) {
+        for reservation in reservations {
+            let budget = reservation.budget().clone();
+            drop(reservation);
+            if budget.used() > budget.cap {
+                drop(self.ensure_budget(&budget, 0));
+            }
+        }
+    }
+
+    /// Move a UFO, and the chunks it already has loaded, to a different budget (or none)
+    pub fn set_budget(&self, ufo: &WrappedUfoObject, budget: Option<Arc<UfoBudget>>) {
+        {
+            // the write lock waits out populates which may still be charging the old budget
+            let mut ufo = ufo.write().unwrap();
+            ufo.config.budget = budget.clone();
+            self.get_locked_chunks().unwrap().rebudget(ufo.id, &budget);
+        }
+        if let Some(budget) = budget {
+            drop(self.ensure_budget(&budget, 0));
+        }
+    }
+
+    /// Write the dirty chunks of a UFO through to its source (UfoObjectConfig::with_write_through)
+    /// without waiting for them to be evicted
+    pub fn flush(&self, ufo: &WrappedUfoObject) -> anyhow::Result<()> {
+        let ufo = ufo.read().map_err(|_| anyhow::anyhow!("Broken Ufo Lock"))?;
+        let protect = |ptr: *mut u8, len: usize| {
+            write_protect(&self.uffd, ptr.cast(), len).map_err(anyhow::Error::from)
+        };
+        // without write protection every resident chunk is written, there is nothing to re-arm
+        let protect: Option<&dyn Fn(*mut u8, usize) -> anyhow::Result<()>> =
+            ufo.dirty_chunks.as_ref().map(|_| &protect as _);
+        ufo.flush(protect)
+    }
+
+    /// Write protect part of a UFO again, so that its next write is seen
+    pub(crate) fn protect_again(&self, ptr: *mut u8, len: usize) -> anyhow::Result<()> {
+        write_protect(&self.uffd, ptr.cast(), len).map_err(anyhow::Error::from)
+    }
+
+    /// Populate elements start..end of a UFO into `out`, file sources are read from their file.
+    /// Sources which allow it are split into a range for each thread of the populate pool, at
+    /// least a page of elements each
+    pub(crate) fn populate(
+        &self,
+        config: &UfoObjectConfig,
+        start: usize,
+        end: usize,
+        out: *mut u8,
+    ) -> Result<(), UfoPopulateError> {
+        if let Some(file_source) = &config.file_source {
+            // one pread, no call out to the source
+            let out = unsafe { std::slice::from_raw_parts_mut(out, (end - start) * config.stride) };
+            return file_source
+                .read((start * config.stride) as u64, out)
+                .map_err(|e| {
+                    error!(target: "ufo_core", "reading {}-{} from the file source: {}", start, end, e);
+                    UfoPopulateError
+                });
+        }
+
+        // the source may read other UFOs, a populate worker waits on their faults in here
+        let pool = POPULATE_WORKER
+            .with(Cell::get)
+            .then(|| self.populate_workers.get().and_then(Weak::upgrade))
+            .flatten();
+        let _populating = pool.as_ref().map(|pool| pool.populating());
+
+        let per_page = max(1, *PAGE_SIZE / config.stride);
+        if !config.parallel_populate || end - start < 2 * per_page {
+            return (config.populate)(start, end, out);
+        }
+
+        // sized and pinned like the workers as they were when the first parallel UFO was populated,
+        // 0 threads is one per cpu
+        let pool = self.populate_pool.get_or_init(|| {
+            let core_config = self.config();
+            let cpus = core_config.worker_cpus.clone();
+            let threads = match (core_config.max_workers, cpus.len()) {
+                (0, n) | (n, 0) => n,
+                (a, b) => min(a, b),
+            };
+            rayon::ThreadPoolBuilder::new()
+                .num_threads(threads)
+                .thread_name(|i| format!("Ufo Populate {}", i))
+                .start_handler(move |_| pin_current_thread(&cpus))
+                .build()
+                .expect("unable to start the populate pool")
+        });
+        let parts = min(pool.current_num_threads(), (end - start) / per_page);
+        let per_part = (end - start).div_ceil(parts);
+        trace!(target: "ufo_core", "populate {}-{} in {} parts", start, end, parts);
+
+        let populate = &config.populate;
+        let stride = config.stride;
+        let out = out as usize;
+        pool.install(|| {
+            (0..parts).into_par_iter().try_for_each(|part| {
+                let from = start + part * per_part;
+                let to = min(from + per_part, end);
+                if from >= to {
+                    return Ok(());
+                }
+                populate(from, to, (out + (from - start) * stride) as *mut u8)
+            })
+        })
+    }
+
+    /// A segment of the arena for a UFO of `size` bytes. None for UFOs too large for it, when it is
+    /// full, or when there is no arena. The arena keeps the size it was made with
+    fn arena_segment(&self, size: usize) -> Option<ArenaSegment> {
+        let config = self.config();
+        if config.arena_bytes == 0 {
+            return None;
+        }
+        let arena = self.arena.get_or_init(|| {
+            let arena_bytes = down_to_nearest(config.arena_bytes, get_page_size());
+            let write_protect = config.dirty_tracking == UfoDirtyTracking::WriteProtect;
+            match UfoArena::new(&self.uffd, arena_bytes, write_protect) {
+                Ok(arena) => Some(arena),
+                Err(e) => {
+                    warn!(target: "ufo_core", "no arena, UFOs are mapped one by one: {}", e);
+                    None
+                }
+            }
+        });
+        let arena = arena.as_ref()?;
+        if size > arena.length() / 16 {
+            return None;
+        }
+        arena.take(size)
+    }
+
+    /// A fault on registered memory no UFO holds. Touching a freed part of the arena used to be a
+    /// segfault, now the page is zero filled (or let be written) and whoever touched it woken,
+    /// rather than leaving them waiting or bringing down the worker. Anything else is memory of a
+    /// UFO being allocated or freed, which must not be filled in under it: whoever touched it is
+    /// only woken, to fault again once the UFO can be looked up or the memory is free
+    fn answer_stray_fault(&self, fault: &Pagefault) {
+        let page = down_to_nearest(fault.addr, get_page_size());
+        warn!(target: "ufo_core", "fault at {:#x} outside of any UFO", fault.addr);
+        let answer = || {
+            let answered = if fault.write_protect {
+                remove_write_protection(&self.uffd, page as *mut c_void, get_page_size())
+            } else {
+                match unsafe { self.uffd.zeropage(page as *mut c_void, get_page_size(), true) } {
+                    Err(e) if is_already_populated(&e) => {
+                        self.uffd.wake(page as *mut c_void, get_page_size())
+                    }
+                    answered => answered.map(|_| ()),
+                }
+            };
+            if let Err(e) = answered {
+                error!(target: "ufo_core", "could not answer the fault at {:#x}: {}", fault.addr, e);
+            }
+        };
+        let answered = match self.arena.get().and_then(Option::as_ref) {
+            Some(arena) if arena.contains(page) => arena.answer_stray(page, answer),
+            _ => false,
+        };
+        if !answered {
+            if let Err(e) = self.uffd.wake(page as *mut c_void, get_page_size()) {
+                error!(target: "ufo_core", "could not wake the fault at {:#x}: {}", fault.addr, e);
+            }
+        }
+    }
+
+    /// The config as new UFOs will actually get it, so that what it says can be relied on: shared
+    /// memory is anonymous memory where the kernel cannot tell us about minor faults on it
+    fn supported(&self, mut config: UfoCoreConfig) -> UfoCoreConfig {
+        if config.backing == UfoBacking::SharedMemory && !self.shared_memory_supported() {
+            info!(target: "ufo_core", "no minor faults on shared memory, UFOs stay anonymous memory");
+            config.backing = UfoBacking::Anonymous;
+        }
+        config
+    }
+
+    /// Tried on a page of shared memory the first time it is asked for
+    fn shared_memory_supported(&self) -> bool {
+        *self.shared_memory_minor_faults.get_or_init(|| {
+            let try_minor_faults = || -> anyhow::Result<bool> {
+                let size = get_page_size();
+                let shared_memory = SharedMemory::new(size)?;
+                let mmap = BaseMmap::map_file(
+                    size,
+                    &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
+                    &[MmapFlag::Shared],
+                    shared_memory.file(),
+                    0,
+                )?;
+                let supported = register_minor(&self.uffd, mmap.as_ptr().cast(), size)?;
+                if supported {
+                    self.uffd.unregister(mmap.as_ptr().cast(), size)?;
+                }
+                Ok(supported)
+            };
+            try_minor_faults().unwrap_or_else(|e| {
+                warn!(target: "ufo_core", "could not try out minor faults on shared memory: {}", e);
+                false
+            })
+        })
+    }
+
+    /// The body of a new UFO in shared memory, registered for minor faults. None when the kernel
+    /// cannot tell us about minor faults on it, the UFO is anonymous memory then
+    fn map_shared_memory(
+        &self,
+        id: UfoId,
+        size: usize,
+    ) -> anyhow::Result<Option<(BaseMmap, SharedMemory)>> {
+        let shared_memory = SharedMemory::new(size)?;
+        let mmap = BaseMmap::map_file(
+            size,
+            &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
+            &[MmapFlag::Shared],
+            shared_memory.file(),
+            0,
+        )?;
+        if !register_minor(&self.uffd, mmap.as_ptr().cast(), size)? {
+            info!(target: "ufo_core", "{:?} no minor faults on shared memory, anonymous instead", id);
+            return Ok(None);
+        }
+        Ok(Some((mmap, shared_memory)))
+    }
+
+    /// Map a chunk just loaded as huge pages, under the chunk lock before anyone is woken to use it
+    fn collapse(&self, stats: Recorders, start: *mut u8, len: usize) {
+        // the last chunk of a UFO may end part way into its huge page, that one stays small
+        let len = down_to_nearest(len, get_huge_page_size());
+        if len == 0 || !self.collapse_huge_pages.load(Ordering::Relaxed) {
+            return;
+        }
+        match collapse_huge_pages(start, len) {
+            Ok(()) => stats.add(Counter::HugePageChunks, 1),
+            Err(e) if e.raw_os_error() == Some(libc::EINVAL) => {
+                info!(target: "ufo_core", "cannot collapse huge pages, leaving it to khugepaged: {}", e);
+                self.collapse_huge_pages.store(false, Ordering::Relaxed);
+            }
+            // no huge page to be had right now, the chunk stays in small pages
+            Err(e) => trace!(target: "ufo_core", "huge page collapse failed: {}", e),
+        }
+    }
+
+    fn reclaim_loop(this: &Weak<UfoCore>, reclaimer: &Reclaimer) {
+        trace!(target: "ufo_core", "Started reclaim loop");
+        while ShouldRun::Running == reclaimer.await_work() {
+            let core = match this.upgrade() {
+                Some(core) => core,
+                None => return,
+            };
+            core.reclaim();
+        }
+    }
+
+    /// Trim down to the low watermark a slice at a time so faults never wait long for the chunk lock
+    /// and never much memory is in the middle of being freed
+    fn reclaim(&self) {
+        let config = self.config();
+        let step = std::cmp::max(1, (config.start_reclaim_at() - config.low_watermark) / 8);
+        debug!(target: "ufo_core", "background reclaim");
+        loop {
+            let to_free = {
+                let chunks = &mut *self.get_locked_chunks().unwrap();
+                if chunks.used_memory <= config.low_watermark {
+                    return;
+                }
+                chunks.stats.background_reclaims += 1;
+                let target = std::cmp::max(
+                    config.low_watermark,
+                    chunks.used_memory.saturating_sub(step),
+                );
+                chunks.take_until(target).unwrap()
+            };
+            UfoChunks::free_chunks(&self.stats, to_free).unwrap();
+        }
+    }
+
+    /// Hand chunks to the prefetch workers, anything that doesn't fit in the queue is dropped
+    fn prefetch(&self, jobs: impl Iterator<Item = PrefetchJob>) {
+        let prefetcher = self.prefetcher.get().expect("prefetcher not started");
+        for job in jobs {
+            match prefetcher.send.try_send(job) {
+                Ok(()) => prefetcher.workers.request_worker(),
+                Err(_) => {
+                    trace!(target: "ufo_core", "prefetch queue full");
+                    return;
+                }
+            }
+        }
+    }
+
+    fn prefetch_loop(this: &Weak<UfoCore>, request_worker: &dyn RequestWorker) {
+        trace!(target: "ufo_core", "Started prefetch loop");
+        let mut buffer = UfoWriteBuffer::new();
+
+        loop {
+            if ShouldRun::Running != request_worker.await_work() {
+                return;
+            }
+            let core = match this.upgrade() {
+                Some(core) => core,
+                None => return,
+            };
+            // every request comes with a job, except the one a new pool starts with
+            let prefetcher = core.prefetcher.get().unwrap();
+            if let Ok(job) = prefetcher.recv.try_recv() {
+                prefetcher.refill();
+                core.prefetch_chunk(&mut buffer, job)
+                    .expect("Error during prefetch");
+            }
+        }
+    }
+
+    fn prefetch_chunk(
+        &self,
+        buffer: &mut UfoWriteBuffer,
+        job: PrefetchJob,
+    ) -> Result<(), UfoPopulateError> {
+        let ufo_arc = match job.ufo.upgrade() {
+            Some(ufo) => ufo,
+            None => return Ok(()),
+        };
+
+        let (addr, load_size, budget) = {
+            let ufo = ufo_arc.read().unwrap();
+            if ufo.generation != job.generation {
+                return Ok(());
+            }
+            if ufo.resident_chunks.get(job.chunk_number) {
+                // being read ahead again means someone is walking over it
+                ufo.referenced_chunks.set(job.chunk_number);
+                return Ok(());
+            }
+            let load_size = ufo.config.elements_loaded_at_once * ufo.config.stride;
+            (
+                ufo.body_ptr() as usize + job.chunk_number * load_size,
+                load_size,
+                ufo.config.budget.clone(),
+            )
+        };
+        trace!(target: "ufo_core", "prefetch chunk {} at {:#x}", job.chunk_number, addr);
+
+        // Never make room with a UFO lock held, eviction may need it. The reservation is refunded
+        // if the load fails or finds the chunk already there
+        let mut reservations: Vec<UfoBudgetReservation> = budget
+            .map(|budget| self.ensure_budget(&budget, load_size))
+            .into_iter()
+            .collect();
+        self.ensure_capcity(load_size);
+
+        // No wake, anyone who faulted on the chunk meanwhile is waiting on a populate worker
+        populate_chunk(
+            self,
+            buffer,
+            &ufo_arc,
+            addr,
+            false,
+            Some(job.generation),
+            |chunk, _| {
+                self.get_locked_chunks()
+                    .unwrap()
+                    .add(chunk, &mut reservations);
+            },
+        )?;
+        self.settle_budgets(reservations);
+
+        Ok(())
+    }
+
+    pub fn eviction_stats(&self) -> EvictionStats {
+        self.get_locked_chunks().unwrap().stats
+    }
+
+    /// The log new UFOs write back to, UFOs allocated before the writeback settings changed keep theirs
+    fn writeback_log(&self) -> Result<Arc<WritebackLog>, std::io::Error> {
+        let config = self.config();
+        let (dir, depth, direct) = (
+            &config.writeback_temp_path,
+            config.writeback_queue_depth,
+            config.writeback_direct_io,
+        );
+        let log = &mut *self.writeback_log.lock().unwrap();
+        match log {
+            Some(log) if log.matches(dir, depth, direct) => Ok(log.clone()),
+            _ => {
+                let new_log = WritebackLog::new(dir, depth, direct)?;
+                *log = Some(new_log.clone());
+                Ok(new_log)
+            }
+        }
+    }
+
+    fn compact_writeback_log(&self) -> anyhow::Result<()> {
+        let log = self.writeback_log.lock().unwrap().clone();
+        match log {
+            Some(log) => log.compact(),
+            None => Ok(()),
+        }
+    }
+
+    /// Space taken up by the writeback log of the current writeback path
+    pub fn writeback_log_stats(&self) -> WritebackLogStats {
+        self.writeback_log
+            .lock()
+            .unwrap()
+            .as_ref()
+            .map(|log| log.stats())
+            .unwrap_or_default()
     }
 
     pub fn get_ufo_by_id(&self, id: UfoId) -> Result<WrappedUfoObject, UfoLookupErr> {
@@ -292,135 +1547,269 @@ impl UfoCore {
     }
 
     pub fn get_ufo_by_address(&self, ptr: usize) -> Result<WrappedUfoObject, UfoLookupErr> {
-        self.get_locked_state()
+        self.segments
+            .read()
             .map_err(|e| UfoLookupErr::CoreBroken(format!("{:?}", e)))?
-            .objects_by_segment
             .get(&ptr)
             .cloned()
             .map(Ok)
             .unwrap_or_else(|| Err(UfoLookupErr::UfoNotFound))
     }
 
+    /// The first write to a chunk loaded write protected, note it down and let the writer through
+    fn mark_dirty(&self, faults: &[Pagefault]) {
+        for fault in faults {
+            let ufo_arc = self.segments.read().unwrap().get(&fault.addr).cloned();
+            let ufo_arc = match ufo_arc {
+                Some(ufo_arc) => ufo_arc,
+                None => {
+                    self.answer_stray_fault(fault);
+                    continue;
+                }
+            };
+            let ufo = ufo_arc.read().unwrap();
+            ufo.stats.add(Counter::Faults, 1);
+
+            let load_size = ufo.config.elements_loaded_at_once * ufo.config.stride;
+            let offset = UfoOffset::from_addr(ufo.deref(), fault.addr as *mut c_void)
+                .down_to_nearest_n_relative_to_header(load_size);
+            let size = min(load_size, ufo.config.true_size - offset.absolute_offset());
+            trace!(target: "ufo_core", "{:?} chunk {} dirtied", ufo.id, offset.chunk_number());
+
+            // Racing an eviction is fine, at worst the chunk is written back once for nothing.
+            // Dirty before unprotecting so that whoever frees the chunk cannot miss the write
+            ufo.dirty_chunks
+                .as_ref()
+                .expect("write protect fault on a UFO without dirty tracking")
+                .set(offset.chunk_number());
+            remove_write_protection(&self.uffd, offset.as_ptr_int() as *mut c_void, size)
+                .expect("unable to remove write protection");
+        }
+    }
+
     fn populate_loop(this: Arc<UfoCore>, request_worker: &dyn RequestWorker) {
         trace!(target: "ufo_core", "Started pop loop");
-        fn populate_impl(
+        POPULATE_WORKER.with(|w| w.set(true));
+
+        // A chunk that one or more faults in a batch resolve to
+        struct ChunkFault {
+            ufo: WrappedUfoObject,
+            ufo_id: UfoId,
+            chunk_number: usize,
+            fault_addr: usize,
+            write: bool,
+        }
+
+        fn populate_batch(
             core: &UfoCore,
             buffer: &mut UfoWriteBuffer,
-            addr: *mut c_void,
+            faults: &[Pagefault],
         ) -> Result<(), UfoPopulateError> {
-            // fn droplockster<T>(_: T){}
-            let mut state = core.get_locked_state().unwrap();
-
-            let ptr_int = addr as usize;
-
-            // blindly unwrap here because if we get a message for an address we don't have then it is explodey time
-            // clone the arc so we aren't borrowing the state
-            let ufo_arc = state.objects_by_segment.get(&ptr_int).unwrap().clone();
-            let ufo = ufo_arc.read().unwrap();
-
-            let fault_offset = UfoOffset::from_addr(ufo.deref(), addr);
-
-            let config = &ufo.config;
-
-            let load_size = config.elements_loaded_at_once * config.stride;
-
-            let populate_offset = fault_offset.down_to_nearest_n_relative_to_header(load_size);
-
-            let start = populate_offset.as_index_floor();
-            let end = start + config.elements_loaded_at_once;
-            let pop_end = min(end, config.element_ct);
-
-            let populate_size = min(
-                load_size,
-                config.true_size - populate_offset.absolute_offset(),
-            );
-
-            debug!(target: "ufo_core", "fault at {}, populate {} bytes at {:#x}",
-                start, (pop_end-start) * config.stride, populate_offset.as_ptr_int());
+            let config = core.config();
+            let mut remaining = faults;
+            let mut readahead = Vec::new();
+            let mut prefetch_jobs = Vec::new();
+            while !remaining.is_empty() {
+                let mut chunks: Vec<ChunkFault> = Vec::with_capacity(remaining.len());
+
+                // Resolve every fault to its chunk, the segment lock is only held while we clone the arcs
+                let mut reservations: Vec<UfoBudgetReservation> = {
+                    let ufos: Vec<Option<WrappedUfoObject>> = {
+                        let segments = core.segments.read().unwrap();
+                        remaining
+                            .iter()
+                            .map(|fault| segments.get(&fault.addr).cloned())
+                            .collect()
+                    };
+                    let mut to_load = 0;
+                    let mut budgets: Vec<(Arc<UfoBudget>, usize)> = Vec::new();
+                    let mut consumed = 0;
+
+                    for (fault, ufo_arc) in remaining.iter().zip(ufos) {
+                        let ufo_arc = match ufo_arc {
+                            Some(ufo_arc) => ufo_arc,
+                            None => {
+                                core.answer_stray_fault(fault);
+                                consumed += 1;
+                                continue;
+                            }
+                        };
+                        let (ufo_id, chunk_number, load_size, budget) = {
+                            let ufo = ufo_arc.read().unwrap();
+                            ufo.stats.add(Counter::Faults, 1);
+                            let offset =
+                                UfoOffset::from_addr(ufo.deref(), fault.addr as *mut c_void);
+                            let load_size = ufo.config.elements_loaded_at_once * ufo.config.stride;
+
+                            let readahead_from = readahead.len();
+                            ufo.readahead.lock().unwrap().record(
+                                offset.chunk_number(),
+                                ufo.config.chunk_ct(),
+                                config.readahead_depth,
+                                core.readahead_max_window(load_size, ufo.config.budget.as_ref()),
+                                &mut readahead,
+                            );
+                            prefetch_jobs.extend(
+                                readahead
+                                    .drain(readahead_from..)
+                                    .map(|c| PrefetchJob::new(&ufo_arc, ufo.generation, c)),
+                            );
+
+                            (
+                                ufo.id,
+                                offset.chunk_number(),
+                                load_size,
+                                ufo.config.budget.clone(),
+                            )
+                        };
+
+                        let duplicate = chunks
+                            .iter_mut()
+                            .find(|c| c.ufo_id == ufo_id && c.chunk_number == chunk_number);
+                        if let Some(c) = duplicate {
+                            c.write |= fault.write;
+                        } else {
+                            // the whole group has to fit between the watermarks, leave the rest for the next round
+                            if !chunks.is_empty()
+                                && to_load + load_size + config.low_watermark
+                                    >= config.high_watermark
+                            {
+                                break;
+                            }
+                            to_load += load_size;
+                            if let Some(budget) = budget {
+                                match budgets.iter_mut().find(|(b, _)| Arc::ptr_eq(b, &budget)) {
+                                    Some((_, b_load)) => *b_load += load_size,
+                                    None => budgets.push((budget, load_size)),
+                                }
+                            }
+                            chunks.push(ChunkFault {
+                                ufo: ufo_arc,
+                                ufo_id,
+                                chunk_number,
+                                fault_addr: fault.addr,
+                                write: fault.write,
+                            });
+                        }
+                        consumed += 1;
+                    }
+                    remaining = &remaining[consumed..];
+
+                    // Before we perform the load ensure that there is capacity, budgets first so a
+                    // UFO over its own cap makes room at its own expense. Whatever the loads below
+                    // do not take of the reservations is refunded as they drop, errors included
+                    let reservations = budgets
+                        .iter()
+                        .map(|(budget, load)| core.ensure_budget(budget, *load))
+                        .collect();
+                    core.ensure_capcity(to_load);
+                    reservations
+                };
 
-            // Before we perform the load ensure that there is capacity
-            UfoCore::ensure_capcity(&core.config, &mut *state, load_size);
+                // get the readahead going while we take care of the faults
+                core.prefetch(prefetch_jobs.drain(..));
 
-            // drop the lock before loading so that UFOs can be recursive
-            Mutex::unlock(state);
+                chunks.sort_by_key(|c| (c.ufo_id, c.chunk_number));
 
-            let config = &ufo.config;
-            let chunk = UfoChunk::new(&ufo_arc, &ufo, populate_offset, populate_size);
-            trace!("spin locking {:?}.{}", ufo.id, chunk.offset());
-            let chunk_lock = ufo
-                .writeback_util
-                .chunk_locks
-                .spinlock(chunk.offset().chunk_number())
-                .map_err(|_| UfoPopulateError)?;
+                // A lone chunk is published and woken straight away so the hash is calculated off the
+                // fault path, otherwise each UFO gets one ranged wake once the whole group is saved
+                let wake = |range: &Range<usize>| {
+                    trace!(target: "ufo_core", "wake {:#x}-{:#x}", range.start, range.end);
+                    core.uffd
+                        .wake(range.start as *mut c_void, range.end - range.start)
+                        .expect("unable to wake range");
+                };
 
-            let raw_data = ufo
-                .writeback_util
-                .try_readback(&chunk.offset())
-                .map(Ok)
-                .unwrap_or_else(|| {
-                    trace!(target: "ufo_core", "calculate");
-                    unsafe {
-                        buffer.ensure_capcity(load_size);
-                        (config.populate)(start, pop_end, buffer.ptr)?;
-                        Ok(&buffer.slice()[0..load_size])
+                if let [c] = chunks.as_slice() {
+                    let mut woken = false;
+                    let range = populate_chunk(
+                        core,
+                        buffer,
+                        &c.ufo,
+                        c.fault_addr,
+                        c.write,
+                        None,
+                        |chunk, range| {
+                            core.get_locked_chunks()
+                                .unwrap()
+                                .add(chunk, &mut reservations);
+                            trace!(target: "ufo_core", "chunk saved");
+                            wake(range);
+                            woken = true;
+                        },
+                    )?;
+                    if !woken {
+                        wake(&range);
                     }
-                })?;
-            trace!(target: "ufo_core", "data ready");
-            trace!("unlock populate {:?}.{}", ufo.id, chunk.offset());
-            chunk_lock.unlock(); // once we've loaded the data the rest is non critical
-
-            unsafe {
-                core.uffd
-                    .copy(
-                        raw_data.as_ptr().cast(),
-                        chunk.offset().as_ptr_int() as *mut c_void,
-                        populate_size,
-                        true,
-                    )
-                    .expect("unable to populate range");
-            }
-            trace!(target: "ufo_core", "populated");
-
-            assert!(raw_data.len() == load_size);
-            let hash_fulfiller = chunk.hash_fulfiller();
+                    core.settle_budgets(reservations);
+                    continue;
+                }
 
-            let mut state = core.get_locked_state().unwrap();
-            state.loaded_chunks.add(chunk);
-            trace!(target: "ufo_core", "chunk saved");
+                let mut wake_ranges: Vec<(UfoId, Range<usize>)> = Vec::new();
+                let mut populated = Vec::with_capacity(chunks.len());
+
+                for c in chunks.iter() {
+                    let range = populate_chunk(
+                        core,
+                        buffer,
+                        &c.ufo,
+                        c.fault_addr,
+                        c.write,
+                        None,
+                        |chunk, _| populated.push(chunk),
+                    )?;
+
+                    // chunks are sorted so neighbours in the same UFO just grow the range
+                    // waking pages between chunks is harmless, anyone waiting there simply faults again
+                    match wake_ranges.last_mut() {
+                        Some((id, r)) if *id == c.ufo_id => r.end = range.end,
+                        _ => wake_ranges.push((c.ufo_id, range)),
+                    }
+                }
 
-            // release the lock before calculating the hash so other workers can proceed
-            Mutex::unlock(state);
+                {
+                    // if a UFO was reset since we populated it these chunks are stale, eviction skips
+                    // over those so it is fine that we cannot check without the UFO lock
+                    let mut chunks = core.get_locked_chunks().unwrap();
+                    populated
+                        .into_iter()
+                        .for_each(|c| chunks.add(c, &mut reservations));
+                    trace!(target: "ufo_core", "chunks saved");
+                }
 
-            if !config.should_try_writeback() {
-                hash_fulfiller.try_init(None);
-            } else {
-                // Make sure to take a slice of the raw data. the kernel operates in page sized chunks but the UFO ends where it ends
-                let calculated_hash = hash_function(&raw_data[0..populate_size]);
-                hash_fulfiller.try_init(Some(calculated_hash));
+                wake_ranges.iter().for_each(|(_, range)| wake(range));
+                core.settle_budgets(reservations);
             }
 
             Ok(())
         }
 
         let uffd = &this.uffd;
-        // Per-worker buffer
+        // Per-worker buffers
         let mut buffer = UfoWriteBuffer::new();
+        let fault_batch_size = this.config().fault_batch_size;
+        let mut events = UffdEventBuffer::new(fault_batch_size);
+        let mut faults = Vec::with_capacity(fault_batch_size);
+        let mut dirtied = Vec::new();
 
         loop {
-            if ShouldRun::Shutdown == request_worker.await_work() {
+            if ShouldRun::Running != request_worker.await_work() {
                 return;
             }
-            match uffd.read_event() {
-                Ok(Some(event)) => match event {
-                    userfaultfd::Event::Pagefault { rw: _, addr } => {
-                        request_worker.request_worker(); // while we work someone else waits
-                        populate_impl(&*this, &mut buffer, addr).expect("Error during populate");
-                    }
-                    e => panic!("Recieved an event we did not register for {:?}", e),
-                },
-                Ok(None) => {
-                    /*huh*/
-                    warn!(target: "ufo_core", "huh")
+            match events.read_pagefaults(uffd, &mut faults) {
+                Ok(()) => {
+                    request_worker.request_worker(); // while we work someone else waits
+                    trace!(target: "ufo_core", "read {} faults", faults.len());
+                    this.stats.add(Counter::Faults, faults.len() as u64);
+                    dirtied.clear();
+                    faults.retain(|f: &Pagefault| {
+                        if f.write_protect {
+                            dirtied.push(*f);
+                        }
+                        !f.write_protect
+                    });
+                    this.mark_dirty(&dirtied);
+                    populate_batch(&*this, &mut buffer, &faults).expect("Error during populate");
                 }
                 Err(userfaultfd::Error::SystemError(e))
                     if e.as_errno() == Some(nix::errno::Errno::EBADF) =>
@@ -447,7 +1836,7 @@ impl UfoCore {
         trace!(target: "ufo_core", "Started msg loop");
         fn allocate_impl(
             this: &Arc<UfoCore>,
-            config: UfoObjectConfig,
+            mut config: UfoObjectConfig,
         ) -> anyhow::Result<WrappedUfoObject> {
             info!(target: "ufo_object", "new Ufo {{
                 header_size: {},
@@ -468,6 +1857,14 @@ impl UfoCore {
                 config.element_ct,
             );
 
+            let load_size = config.elements_loaded_at_once * config.stride;
+            let core_config = this.config();
+            anyhow::ensure!(
+                load_size < core_config.high_watermark - core_config.low_watermark,
+                "chunks of {} bytes do not fit between the watermarks",
+                load_size
+            );
+
             let ufo = {
                 let state = &mut *this.get_locked_state()?;
 
@@ -488,13 +1885,46 @@ impl UfoCore {
                     config.stride * config.element_ct,
                 );
 
-                let mmap = BaseMmap::new(
-                    config.true_size,
-                    &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
-                    &[MmapFlag::Anonymous, MmapFlag::Private, MmapFlag::NoReserve],
-                    None,
-                )
-                .expect("Mmap Error");
+                // shared memory is registered as it is mapped, to know whether the kernel takes it
+                let shared = if this.config().backing == UfoBacking::SharedMemory && !config.huge_pages {
+                    this.map_shared_memory(id, config.true_size)?
+                } else {
+                    None
+                };
+                let arena_segment = if shared.is_none() && !config.huge_pages {
+                    this.arena_segment(config.true_size)
+                } else {
+                    None
+                };
+                let (mmap, shared_memory) = match (shared, arena_segment) {
+                    (Some((mmap, shared_memory)), _) => (UfoMapping::Mmap(mmap), Some(shared_memory)),
+                    (None, Some(segment)) => (UfoMapping::Arena(segment), None),
+                    (None, None) => {
+                        let protection = [MemoryProtectionFlag::Read, MemoryProtectionFlag::Write];
+                        let flags = [MmapFlag::Anonymous, MmapFlag::Private, MmapFlag::NoReserve];
+                        let mmap = if config.huge_pages {
+                            // the body starts on a huge page, so does every chunk
+                            BaseMmap::new_aligned(
+                                config.true_size,
+                                config.header_size_with_padding,
+                                get_huge_page_size(),
+                                &protection,
+                                &flags,
+                            )
+                        } else {
+                            BaseMmap::new(config.true_size, &protection, &flags, None)
+                        }
+                        .expect("Mmap Error");
+                        if config.huge_pages {
+                            let body_size = config.true_size - config.header_size_with_padding;
+                            let body = unsafe { mmap.as_ptr().add(config.header_size_with_padding) };
+                            if let Err(e) = advise_huge_pages(body, body_size) {
+                                debug!(target: "ufo_core", "{:?} no transparent huge pages: {}", id, e);
+                            }
+                        }
+                        (UfoMapping::Mmap(mmap), None)
+                    }
+                };
 
                 let mmap_ptr = mmap.as_ptr();
                 let true_size = config.true_size;
@@ -506,15 +1936,47 @@ impl UfoCore {
 
                 debug!(target: "ufo_core", "mmapped {:#x} - {:#x}", mmap_base, mmap_base + true_size);
 
-                let writeback = UfoFileWriteback::new(id, &config, this)?;
-                this.uffd.register(mmap_ptr.cast(), true_size)?;
+                let persistent_file = config.persistent_file.take();
+                let shared_chunks = config.shared_chunks.take();
+                let writeback = UfoFileWriteback::new(
+                    id,
+                    &config,
+                    this.writeback_log()?,
+                    this.config().writeback_compression,
+                    persistent_file,
+                    shared_chunks,
+                );
+                // read only UFOs are never written back so there is nothing to track, write
+                // protected pages cannot be collapsed into huge pages
+                let write_protect = config.should_try_writeback()
+                    && !config.huge_pages
+                    && shared_memory.is_none()
+                    && this.config().dirty_tracking == UfoDirtyTracking::WriteProtect;
+                // the arena was registered once, for write protection if the kernel could
+                let track_dirty = match &mmap {
+                    UfoMapping::Arena(segment) => write_protect && segment.write_protect(),
+                    UfoMapping::Mmap(_) => {
+                        write_protect && register_write_protect(&this.uffd, mmap_ptr.cast(), true_size)?
+                    }
+                };
+                if !track_dirty && shared_memory.is_none() && !mmap.in_arena() {
+                    this.uffd.register(mmap_ptr.cast(), true_size)?;
+                }
+                debug!(target: "ufo_core", "{:?} dirty tracking by {}", id,
+                    if track_dirty { "write protection" } else { "hashing" });
 
                 //Pre-zero the header, that isn't part of our populate duties
-                if config.header_size_with_padding > 0 {
-                    unsafe {
-                        this.uffd
-                            .zeropage(mmap_ptr.cast(), config.header_size_with_padding, true)
-                    }?;
+                let header_size = config.header_size_with_padding;
+                if header_size > 0 {
+                    match &shared_memory {
+                        Some(shared_memory) => {
+                            shared_memory.allocate(0, header_size)?;
+                            continue_range(&this.uffd, mmap_ptr.cast(), header_size, true)?;
+                        }
+                        None => unsafe {
+                            this.uffd.zeropage(mmap_ptr.cast(), header_size, true)?;
+                        },
+                    }
                 }
 
                 // let header_offset = config.header_size_with_padding - config.header_size;
@@ -522,16 +1984,27 @@ impl UfoCore {
                 let ufo = UfoObject {
                     id,
                     core: Arc::downgrade(this),
+                    resident_chunks: ChunkBitmap::new(config.chunk_ct()),
+                    dirty_chunks: Some(ChunkBitmap::new(config.chunk_ct())).filter(|_| track_dirty),
+                    referenced_chunks: Arc::new(ChunkBitmap::new(config.chunk_ct())),
+                    constant_chunks: ChunkBitmap::new(config.chunk_ct()),
+                    constant_template: Mutex::new(None),
+                    checkpointed: Mutex::new(HashMap::new()),
                     config,
                     mmap,
+                    shared_memory,
+                    readahead: Mutex::new(Readahead::new()),
                     writeback_util: writeback,
+                    generation: 0,
+                    stats: StatsRecorder::new(),
                 };
 
                 let ufo = Arc::new(RwLock::new(ufo));
 
                 state.objects_by_id.insert(id, ufo.clone());
-                state
-                    .objects_by_segment
+                this.segments
+                    .write()
+                    .map_err(|_| anyhow::anyhow!("segments lock poisoned"))?
                     .insert(segment, ufo.clone())
                     .expect("non-overlapping ufos");
                 Ok(ufo)
@@ -544,21 +2017,20 @@ impl UfoCore {
 
         fn reset_impl(this: &Arc<UfoCore>, ufo_id: UfoId) -> anyhow::Result<()> {
             {
-                let state = &mut *this.get_locked_state()?;
-
-                let ufo = &mut *(state
+                let ufo = this
+                    .get_locked_state()?
                     .objects_by_id
                     .get(&ufo_id)
+                    .cloned()
                     .map(Ok)
-                    .unwrap_or_else(|| Err(anyhow::anyhow!("unknown ufo")))?
-                    .write()
-                    .map_err(|_| anyhow::anyhow!("lock poisoned"))?);
+                    .unwrap_or_else(|| Err(anyhow::anyhow!("unknown ufo")))?;
+                let ufo = &mut *ufo.write().map_err(|_| anyhow::anyhow!("lock poisoned"))?;
 
                 debug!(target: "ufo_core", "resetting {:?}", ufo.id);
 
                 ufo.reset_internal()?;
 
-                state.loaded_chunks.drop_ufo_chunks(ufo_id);
+                this.get_locked_chunks()?.drop_ufo_chunks(ufo_id);
             }
 
             // this.assert_segment_map();
@@ -575,35 +2047,57 @@ impl UfoCore {
                     .remove(&ufo_id)
                     .map(Ok)
                     .unwrap_or_else(|| Err(anyhow::anyhow!("No such Ufo")))?;
-                let ufo = ufo
+                let mut ufo = ufo
                     .write()
                     .map_err(|_| anyhow::anyhow!("Broken Ufo Lock"))?;
 
                 debug!(target: "ufo_core", "freeing {:?} @ {:?}", ufo.id, ufo.mmap.as_ptr());
 
+                // what is loaded is about to go, keep it while the pages are still there
+                if ufo.is_persistent() {
+                    if let Err(e) = ufo.checkpoint() {
+                        error!(target: "ufo_core", "could not checkpoint {:?}: {}", ufo.id, e);
+                    }
+                }
+                if ufo.writes_through() {
+                    if let Err(e) = ufo.flush(None) {
+                        error!(target: "ufo_core", "could not flush {:?}: {}", ufo.id, e);
+                    }
+                }
+
                 let mmap_base = ufo.mmap.as_ptr() as usize;
-                let segment = state
-                    .objects_by_segment
-                    .get_entry(&mmap_base)
+                let mut segments = this
+                    .segments
+                    .write()
+                    .map_err(|_| anyhow::anyhow!("segments lock poisoned"))?;
+                let segment = segments
+                    .get_range(&mmap_base)
                     .map(Ok)
                     .unwrap_or_else(|| Err(anyhow::anyhow!("memory segment missing")))?;
 
                 debug_assert_eq!(
-                    mmap_base, *segment.start,
+                    mmap_base, segment.start,
                     "mmap lower bound not equal to segment lower bound"
                 );
                 debug_assert_eq!(
                     mmap_base + ufo.mmap.length(),
-                    *segment.end,
+                    segment.end,
                     "mmap upper bound not equal to segment upper bound"
                 );
 
-                this.uffd
-                    .unregister(ufo.mmap.as_ptr().cast(), ufo.config.true_size)?;
-                let start_addr = segment.start.clone();
-                state.objects_by_segment.remove_by_start(&start_addr);
-
-                state.loaded_chunks.drop_ufo_chunks(ufo_id);
+                // the arena stays registered, the segment goes back to it once the UFO is dropped
+                if !ufo.mmap.in_arena() {
+                    this.uffd
+                        .unregister(ufo.mmap.as_ptr().cast(), ufo.config.true_size)?;
+                }
+                segments.remove_by_start(&segment.start);
+                drop(segments);
+
+                // chunks already picked for eviction see the new generation and leave the UFO be
+                ufo.generation += 1;
+                this.get_locked_chunks()?.drop_ufo_chunks(ufo_id);
+                // chunks still on their way out may write back again, dropping the UFO releases those
+                ufo.writeback_util.reset()?;
             }
 
             // this.assert_segment_map();
@@ -611,6 +2105,54 @@ impl UfoCore {
             Ok(())
         }
 
+        fn prefetch_impl(
+            this: &Arc<UfoCore>,
+            done: WaitGroup,
+            ufo_id: UfoId,
+            elements: Range<usize>,
+        ) -> anyhow::Result<()> {
+            let ufo_arc = this
+                .get_locked_state()?
+                .objects_by_id
+                .get(&ufo_id)
+                .cloned()
+                .map(Ok)
+                .unwrap_or_else(|| Err(anyhow::anyhow!("unknown ufo")))?;
+
+            let jobs: Vec<PrefetchJob> = {
+                let ufo = ufo_arc
+                    .read()
+                    .map_err(|_| anyhow::anyhow!("lock poisoned"))?;
+                let per_chunk = ufo.config.elements_loaded_at_once;
+                let end = min(elements.end, ufo.config.element_ct);
+                let chunks = (elements.start / per_chunk)..end.div_ceil(per_chunk);
+                debug!(target: "ufo_core", "prefetch {:?} chunks {:?}", ufo_id, chunks);
+
+                chunks
+                    .filter(|c| {
+                        let resident = ufo.resident_chunks.get(*c);
+                        if resident {
+                            ufo.referenced_chunks.set(*c);
+                        }
+                        !resident
+                    })
+                    .map(|c| PrefetchJob {
+                        done: Some(done.clone()),
+                        ..PrefetchJob::new(&ufo_arc, ufo.generation, c)
+                    })
+                    .collect()
+            };
+
+            // unlike readahead these must not be dropped, those that do not fit in the queue wait
+            // in line rather than holding up the msg loop
+            let prefetcher = this.prefetcher.get().expect("prefetcher not started");
+            for job in jobs {
+                prefetcher.submit(job);
+            }
+
+            Ok(())
+        }
+
         fn shutdown_impl<F>(this: &Arc<UfoCore>, populate_pool: Arc<PopulateWorkers<F>>) {
             info!(target: "ufo_core", "shutting down");
             let keys: Vec<UfoId> = {
@@ -621,6 +2163,12 @@ impl UfoCore {
             keys.iter()
                 .for_each(|k| free_impl(this, *k).expect("err on free"));
             populate_pool.shutdown();
+            if let Some(prefetcher) = this.prefetcher.get() {
+                // releases whoever waits on them
+                prefetcher.pending.lock().unwrap().clear();
+                prefetcher.workers.shutdown();
+            }
+            this.reclaimer.shutdown();
         }
 
         loop {
@@ -631,11 +2179,24 @@ impl UfoCore {
                             .fulfill(allocate_impl(&this, cfg).expect("Allocate Error"))
                             .unwrap_or(());
                     }
+                    UfoInstanceMsg::AllocateBatch(fulfiller, cfgs) => {
+                        debug!(target: "ufo_core", "allocate a batch of {}", cfgs.len());
+                        let ufos = cfgs
+                            .into_iter()
+                            .map(|cfg| allocate_impl(&this, cfg).expect("Allocate Error"))
+                            .collect();
+                        fulfiller.fulfill(ufos).unwrap_or(());
+                    }
                     UfoInstanceMsg::Reset(_, ufo_id) => {
-                        reset_impl(&this, ufo_id).expect("Reset Error")
+                        reset_impl(&this, ufo_id).expect("Reset Error");
+                        this.compact_writeback_log().expect("Compaction Error")
                     }
                     UfoInstanceMsg::Free(_, ufo_id) => {
-                        free_impl(&this, ufo_id).expect("Free Error")
+                        free_impl(&this, ufo_id).expect("Free Error");
+                        this.compact_writeback_log().expect("Compaction Error")
+                    }
+                    UfoInstanceMsg::Prefetch(done, ufo_id, elements) => {
+                        prefetch_impl(&this, done, ufo_id, elements).expect("Prefetch Error")
                     }
                     UfoInstanceMsg::Shutdown(_) => {
                         shutdown_impl(&this, populate_pool);
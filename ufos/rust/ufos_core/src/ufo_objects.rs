@@ -1,21 +1,32 @@
+use std::collections::HashMap;
 use std::io::Error;
 use std::lazy::SyncLazy;
 use std::num::NonZeroUsize;
+use std::ops::Range;
 use std::sync::{
-    atomic::{AtomicU8, Ordering},
-    Arc, RwLock, RwLockReadGuard, Weak,
+    atomic::{AtomicU64, AtomicU8, Ordering},
+    Arc, Mutex, RwLock, RwLockReadGuard, Weak,
 };
+use std::time::Instant;
 
 use anyhow::Result;
 use crossbeam::sync::WaitGroup;
 use thiserror::Error;
 
-use log::{debug, error, trace};
+use log::{debug, error, trace, warn};
 
+use crate::arena::UfoMapping;
 use crate::bitwise_spinlock::Bitlock;
+use crate::budget::UfoBudget;
+use crate::compression::UfoCompression;
+use crate::file_source::UfoFileSource;
 use crate::mmap_wrapers;
 use crate::once_await::OnceAwait;
 use crate::once_await::OnceFulfiller;
+use crate::persistent::{PersistentFile, PersistentHeader, UfoPersistence};
+use crate::readahead::Readahead;
+use crate::stats::{Counter, Recorders, StatsRecorder, UfoStage, UfoStats};
+use crate::writeback_log::{ExtentId, WritebackLog};
 
 use super::errors::*;
 use super::math::*;
@@ -118,7 +129,8 @@ impl UfoObjectConfigPrototype {
 }
 
 pub struct UfoObjectConfig {
-    pub(crate) populate: Box<UfoPopulateFn>,
+    // shared with clones of the UFO
+    pub(crate) populate: Arc<UfoPopulateFn>,
 
     pub(crate) header_size_with_padding: usize,
     pub(crate) header_size: usize,
@@ -128,6 +140,18 @@ pub struct UfoObjectConfig {
     pub(crate) element_ct: usize,
     pub(crate) true_size: usize,
     pub(crate) read_only: bool,
+    pub(crate) huge_pages: bool,
+    pub(crate) parallel_populate: bool,
+    // read instead of calling populate, shared with clones
+    pub(crate) file_source: Option<Arc<UfoFileSource>>,
+    pub(crate) budget: Option<Arc<UfoBudget>>,
+    pub(crate) persistence: Option<UfoPersistence>,
+    // opened by allocate_ufo so that a bad path is an error rather than a dead core
+    pub(crate) persistent_file: Option<(PersistentFile, Vec<u64>)>,
+    pub(crate) write_through: Option<Box<UfoWriteThroughFn>>,
+    pub(crate) fill: Option<Arc<UfoFillFn>>,
+    // the chunks a clone starts out with, taken by allocate_ufo like the persistent file
+    pub(crate) shared_chunks: Option<SharedChunks>,
 }
 
 impl UfoObjectConfig {
@@ -163,10 +187,126 @@ impl UfoObjectConfig {
             elements_loaded_at_once,
             element_ct,
 
-            populate,
+            populate: Arc::from(populate),
+            huge_pages: false,
+            parallel_populate: false,
+            file_source: None,
+            budget: None,
+            persistence: None,
+            persistent_file: None,
+            write_through: None,
+            fill: None,
+            shared_chunks: None,
+        }
+    }
+
+    /// The same layout, source and budget, for a clone of the UFO made from this config. Clones
+    /// are writable, their changes are written back to the log, and neither persistent nor write
+    /// through whatever the parent is
+    pub(crate) fn clone_config(&self) -> UfoObjectConfig {
+        UfoObjectConfig {
+            populate: self.populate.clone(),
+            header_size_with_padding: self.header_size_with_padding,
+            header_size: self.header_size,
+            stride: self.stride,
+            elements_loaded_at_once: self.elements_loaded_at_once,
+            element_ct: self.element_ct,
+            true_size: self.true_size,
+            read_only: false,
+            huge_pages: self.huge_pages,
+            parallel_populate: self.parallel_populate,
+            file_source: self.file_source.clone(),
+            budget: self.budget.clone(),
+            persistence: None,
+            persistent_file: None,
+            write_through: None,
+            fill: self.fill.clone(),
+            shared_chunks: None,
         }
     }
 
+    /// Charge the chunks of this UFO to a budget, budgets can be shared to cap a group of UFOs
+    pub fn with_budget(mut self, budget: Option<Arc<UfoBudget>>) -> Self {
+        self.budget = budget;
+        self
+    }
+
+    /// Keep the chunks of this UFO in a file which outlives it, see UfoObject::checkpoint. An
+    /// existing file is reattached to if it was made from the same source with the same layout
+    pub fn with_persistence(mut self, persistence: Option<UfoPersistence>) -> Self {
+        self.persistence = persistence;
+        self
+    }
+
+    /// Hand dirty chunks back to the source as they are evicted or flushed (UfoCore::flush), so
+    /// they are populated from there again rather than kept in the writeback log
+    pub fn with_write_through(mut self, write_through: Option<Box<UfoWriteThroughFn>>) -> Self {
+        self.write_through = write_through;
+        self
+    }
+
+    /// Let the core split each chunk into ranges populated at the same time on several threads, for
+    /// sources which are expensive to populate and safe to call concurrently. A source reading from
+    /// other UFOs populated in parallel should not be populated in parallel itself
+    pub fn with_parallel_populate(mut self, parallel: bool) -> Self {
+        self.parallel_populate = parallel;
+        self
+    }
+
+    /// Read the body straight from a file rather than calling the populate function, see
+    /// UfoFileSource. Chunks past the end of the file fail to populate
+    pub fn with_file_source(mut self, file_source: Option<UfoFileSource>) -> Self {
+        self.file_source = file_source.map(Arc::new);
+        self
+    }
+
+    /// Load the body in chunks of whole transparent huge pages, aligned to them, and have the kernel
+    /// map each chunk as huge pages once it is in (MADV_COLLAPSE, Linux 6.1+, khugepaged may still
+    /// do so on older kernels). Chunks the kernel will not collapse stay in small pages. Dirty
+    /// chunks of these UFOs are found by hashing, write protected pages cannot be collapsed
+    pub fn with_huge_pages(mut self) -> Self {
+        if self.huge_pages {
+            return self;
+        }
+        let huge_page_size = mmap_wrapers::get_huge_page_size();
+        let chunk_bytes = num::integer::lcm(
+            huge_page_size,
+            self.stride * self.elements_loaded_at_once,
+        );
+        self.elements_loaded_at_once = chunk_bytes / self.stride;
+        // the last chunk is a whole huge page too
+        let body_size_with_padding = up_to_nearest(self.stride * self.element_ct, huge_page_size);
+        self.true_size = self.header_size_with_padding + body_size_with_padding;
+        self.huge_pages = true;
+        self
+    }
+
+    /// Ask the source what a chunk holds before populating it. Zero chunks are mapped to the zero
+    /// page and constant chunks copied from a template, neither is written back unless it changed
+    pub fn with_fill(mut self, fill: Option<Box<UfoFillFn>>) -> Self {
+        self.fill = fill.map(Arc::from);
+        self
+    }
+
+    pub(crate) fn persistent_header(&self, persistence: &UfoPersistence) -> PersistentHeader {
+        PersistentHeader {
+            identity: persistence.identity.clone(),
+            tag: persistence.tag,
+            stride: self.stride,
+            element_ct: self.element_ct,
+            elements_per_chunk: self.elements_loaded_at_once,
+        }
+    }
+
+    /// Bytes per element
+    pub fn stride(&self) -> usize {
+        self.stride
+    }
+
+    pub(crate) fn chunk_ct(&self) -> usize {
+        self.element_ct.div_ceil(self.elements_loaded_at_once)
+    }
+
     pub(crate) fn should_try_writeback(&self) -> bool {
         // this may get more complex in the future, for example we may implement ALWAYS writeback
         !self.read_only
@@ -254,13 +394,75 @@ impl std::fmt::Display for UfoOffset {
     }
 }
 
-pub(crate) struct ChunkFreer {
+/// One bit per chunk, readable and writable with only the UFO read lock held
+pub(crate) struct ChunkBitmap {
+    words: Vec<AtomicU64>,
+}
+
+impl ChunkBitmap {
+    pub fn new(chunk_ct: usize) -> Self {
+        ChunkBitmap {
+            words: (0..chunk_ct.div_ceil(64))
+                .map(|_| AtomicU64::new(0))
+                .collect(),
+        }
+    }
+
+    pub fn get(&self, chunk_number: usize) -> bool {
+        self.words[chunk_number >> 6].load(Ordering::Acquire) & (1 << (chunk_number & 63)) != 0
+    }
+
+    pub fn set(&self, chunk_number: usize) {
+        self.words[chunk_number >> 6].fetch_or(1 << (chunk_number & 63), Ordering::AcqRel);
+    }
+
+    pub fn clear(&self, chunk_number: usize) {
+        self.words[chunk_number >> 6].fetch_and(!(1 << (chunk_number & 63)), Ordering::AcqRel);
+    }
+
+    /// Clear the bit and report whether it was set
+    pub fn take(&self, chunk_number: usize) -> bool {
+        let bit = 1 << (chunk_number & 63);
+        self.words[chunk_number >> 6].fetch_and(!bit, Ordering::AcqRel) & bit != 0
+    }
+
+    pub fn clear_all(&self) {
+        self.words
+            .iter()
+            .for_each(|w| w.store(0, Ordering::Release));
+    }
+
+    pub fn snapshot(&self) -> Vec<u64> {
+        self.words
+            .iter()
+            .map(|w| w.load(Ordering::Acquire))
+            .collect()
+    }
+
+    pub fn store(&self, words: &[u64]) {
+        assert_eq!(words.len(), self.words.len());
+        self.words
+            .iter()
+            .zip(words)
+            .for_each(|(w, v)| w.store(*v, Ordering::Release));
+    }
+
+    pub fn count(&self) -> usize {
+        self.words
+            .iter()
+            .map(|w| w.load(Ordering::Relaxed).count_ones() as usize)
+            .sum()
+    }
+}
+
+pub(crate) struct ChunkFreer<'a> {
     pivot: Option<BaseMmap>,
+    stats: &'a StatsRecorder,
 }
 
-impl ChunkFreer {
-    pub fn new() -> Self {
-        ChunkFreer { pivot: None }
+impl<'a> ChunkFreer<'a> {
+    pub fn new(stats: &'a StatsRecorder) -> Self {
+        ChunkFreer { pivot: None, stats }
     }
 
     fn ensure_capcity(&mut self, to_fit: &UfoChunk) -> Result<&BaseMmap> {
@@ -292,7 +494,8 @@ impl ChunkFreer {
         if 0 == chunk.size() {
             return Ok(0);
         }
-        chunk.free_and_writeback_dirty(self.ensure_capcity(chunk)?)
+        let stats = self.stats;
+        chunk.free_and_writeback_dirty(self.ensure_capcity(chunk)?, stats)
     }
 }
 
@@ -306,10 +509,18 @@ impl SizeInPages {
 
 pub(crate) struct UfoChunk {
     ufo_id: UfoId,
+    generation: u64,
     object: Weak<RwLock<UfoObject>>,
     offset: UfoOffset,
     length: Option<NonZeroUsize>,
     hash: Arc<OnceAwait<Option<DataHash>>>,
+    // what the eviction policies know about the chunk
+    referenced: Arc<ChunkBitmap>,
+    populate_cost_ns: u64,
+    refaults: u8,
+    budget: Option<Arc<UfoBudget>>,
+    // what the chunk was loaded as, constant chunks are compared against it rather than hashed
+    fill: UfoChunkFill,
 }
 
 impl UfoChunk {
@@ -328,10 +539,16 @@ impl UfoChunk {
         );
         UfoChunk {
             ufo_id: object.id,
+            generation: object.generation,
             object: Arc::downgrade(arc),
             offset,
             length: NonZeroUsize::new(length),
             hash: Arc::new(OnceAwait::new()),
+            referenced: object.referenced_chunks.clone(),
+            populate_cost_ns: 0,
+            refaults: 0,
+            budget: object.config.budget.clone(),
+            fill: UfoChunkFill::Data,
         }
     }
 
@@ -339,15 +556,35 @@ impl UfoChunk {
         &self.offset
     }
 
+    pub(crate) fn set_fill(&mut self, fill: UfoChunkFill) {
+        self.fill = fill;
+    }
+
     pub fn hash_fulfiller(&self) -> impl OnceFulfiller<Option<DataHash>> {
         self.hash.clone()
     }
 
-    pub fn free_and_writeback_dirty(&mut self, pivot: &BaseMmap) -> Result<usize> {
+    pub fn free_and_writeback_dirty(
+        &mut self,
+        pivot: &BaseMmap,
+        core_stats: &StatsRecorder,
+    ) -> Result<usize> {
         match (self.length, self.object.upgrade()) {
             (Some(length), Some(obj)) => {
                 let length_bytes = length.get();
                 let obj = obj.read().unwrap();
+                let started = Instant::now();
+                let stats = Recorders {
+                    core: core_stats,
+                    ufo: &obj.stats,
+                };
+
+                if obj.generation != self.generation {
+                    // the UFO was reset or freed after this chunk was loaded, there is nothing of ours left
+                    trace!(target: "ufo_object", "stale chunk {:?}@{}", self.ufo_id, self.offset.absolute_offset());
+                    self.length = None;
+                    return Ok(0);
+                }
 
                 trace!(target: "ufo_object", "free chunk {:?}@{} ({}b)",
                     self.ufo_id, self.offset.absolute_offset() , length_bytes
@@ -355,15 +592,24 @@ impl UfoChunk {
 
                 if !obj.config.should_try_writeback() {
                     trace!(target: "ufo_object", "no writeback {:?}", self.ufo_id);
+                    // clear the bit first, anyone who sees it set must find the data still there
+                    obj.resident_chunks.clear(self.offset.chunk_number());
                     // Not doing writebacks, punch it out and leave
-                    unsafe {
-                        let data_ptr = obj.mmap.as_ptr().add(self.offset.absolute_offset());
-                        check_return_zero(libc::madvise(
-                            data_ptr.cast(),
-                            length_bytes,
-                            libc::MADV_DONTNEED,
-                        ))?;
+                    match &obj.shared_memory {
+                        Some(shared_memory) => {
+                            shared_memory.punch(self.offset.absolute_offset(), length_bytes)?
+                        }
+                        None => unsafe {
+                            let data_ptr = obj.mmap.as_ptr().add(self.offset.absolute_offset());
+                            check_return_zero(libc::madvise(
+                                data_ptr.cast(),
+                                length_bytes,
+                                libc::MADV_DONTNEED,
+                            ))?;
+                        },
                     }
+                    stats.add(Counter::FreedChunks, 1);
+                    stats.record(UfoStage::Free, started);
                     return Ok(length_bytes);
                 }
 
@@ -376,44 +622,91 @@ impl UfoChunk {
                     .writeback_util
                     .chunk_locks
                     .lock_uncontended(chunk_number)?;
-                unsafe {
-                    let length_page_multiple = self.size_in_pages().size_as_multiple_of_pages();
-                    anyhow::ensure!(length_page_multiple <= pivot.length(), "Pivot too small");
-                    let data_ptr = obj.mmap.as_ptr().add(self.offset.absolute_offset());
-                    let pivot_ptr = pivot.as_ptr();
-                    check_ptr_nonneg(libc::mremap(
-                        data_ptr.cast(),
-                        length_page_multiple,
-                        length_page_multiple,
-                        libc::MREMAP_FIXED | libc::MREMAP_MAYMOVE | libc::MREMAP_DONTUNMAP,
-                        pivot_ptr,
-                    ))?;
-                    trace!(target: "ufo_object", "{:?} mremaped data to pivot", self.ufo_id);
-                }
-
-                if let Some(hash) = self.hash.get() {
-                    let calculated_hash = pivot.with_slice(0, length_bytes, hash_function).unwrap(); // it should never be possible for this to fail
+                let length_page_multiple = self.size_in_pages().size_as_multiple_of_pages();
+                let data_ptr = unsafe { obj.mmap.as_ptr().add(self.offset.absolute_offset()) };
+                let data = match &obj.shared_memory {
+                    // unmapped the pages stay in the page cache, where we read them from
+                    Some(shared_memory) => unsafe {
+                        check_return_zero(libc::madvise(
+                            data_ptr.cast(),
+                            length_page_multiple,
+                            libc::MADV_DONTNEED,
+                        ))?;
+                        trace!(target: "ufo_object", "{:?} unmapped shared memory", self.ufo_id);
+                        let alias = shared_memory.as_ptr(self.offset.absolute_offset());
+                        std::slice::from_raw_parts(alias, length_bytes)
+                    },
+                    None => unsafe {
+                        anyhow::ensure!(length_page_multiple <= pivot.length(), "Pivot too small");
+                        let pivot_ptr = pivot.as_ptr();
+                        check_ptr_nonneg(libc::mremap(
+                            data_ptr.cast(),
+                            length_page_multiple,
+                            length_page_multiple,
+                            libc::MREMAP_FIXED | libc::MREMAP_MAYMOVE | libc::MREMAP_DONTUNMAP,
+                            pivot_ptr,
+                        ))?;
+                        trace!(target: "ufo_object", "{:?} mremaped data to pivot", self.ufo_id);
+                        std::slice::from_raw_parts(pivot_ptr, length_bytes)
+                    },
+                };
+                obj.resident_chunks.clear(chunk_number);
+
+                let write_back = |data: &[u8]| {
+                    let writeback_started = Instant::now();
+                    let stored = if obj.write_through(chunk_number, data) {
+                        data.len()
+                    } else {
+                        obj.writeback_util.writeback(&self.offset, data)?
+                    };
+                    stats.record(UfoStage::Writeback, writeback_started);
+                    stats.add(Counter::Writebacks, 1);
+                    stats.add(Counter::WritebackBytes, length_bytes as u64);
+                    stats.add(Counter::WritebackStoredBytes, stored as u64);
+                    Ok::<(), anyhow::Error>(())
+                };
+
+                if self.fill != UfoChunkFill::Data {
+                    // zero pages are not write protected, whether the chunk was written is in the data
+                    if let Some(dirty) = &obj.dirty_chunks {
+                        dirty.take(chunk_number);
+                    }
+                    obj.constant_chunks.clear(chunk_number);
+                    let unchanged = self.fill.matches(data);
+                    trace!(target: "ufo_object", "constant chunk unchanged {}", unchanged);
+                    if !unchanged {
+                        write_back(data)?;
+                    }
+                } else if let Some(dirty) = &obj.dirty_chunks {
+                    // the pages are gone from the UFO, any write after this faults the chunk back in
+                    if dirty.take(chunk_number) {
+                        trace!(target: "ufo_object", "writeback dirty {:?}", self.ufo_id);
+                        write_back(data)?;
+                    }
+                } else if let Some(hash) = self.hash.get() {
+                    let hash_started = Instant::now();
+                    let calculated_hash = hash_function(data);
+                    stats.record(UfoStage::Hash, hash_started);
                     trace!(target: "ufo_object", "writeback hash matches {}", hash == &calculated_hash);
                     if hash != &calculated_hash {
-                        pivot.with_slice(0, length_bytes, |data| {
-                            obj.writeback_util.writeback(&self.offset, data)
-                        });
+                        write_back(data)?;
                     }
                 }
+                if let Some(shared_memory) = &obj.shared_memory {
+                    shared_memory.punch(self.offset.absolute_offset(), length_page_multiple)?;
+                }
 
                 self.length = None;
                 trace!("unlock free {:?}.{}", obj.id, self.offset());
                 chunk_lock.unlock();
+                stats.add(Counter::FreedChunks, 1);
+                stats.record(UfoStage::Free, started);
                 Ok(length_bytes)
             }
             _ => Ok(0),
         }
     }
 
-    pub fn mark_freed(&mut self) {
-        self.length = None;
-    }
-
     pub fn ufo_id(&self) -> UfoId {
         self.ufo_id
     }
@@ -422,6 +715,39 @@ impl UfoChunk {
         self.length.map(NonZeroUsize::get).unwrap_or(0)
     }
 
+    /// Whether the chunk was seen in use since the last time we asked
+    pub(crate) fn take_referenced(&self) -> bool {
+        self.referenced.take(self.offset.chunk_number())
+    }
+
+    pub(crate) fn populate_cost_ns(&self) -> u64 {
+        self.populate_cost_ns
+    }
+
+    pub(crate) fn set_populate_cost_ns(&mut self, cost: u64) {
+        self.populate_cost_ns = cost;
+    }
+
+    pub(crate) fn refaults(&self) -> u8 {
+        self.refaults
+    }
+
+    pub(crate) fn set_refaults(&mut self, refaults: u8) {
+        self.refaults = refaults;
+    }
+
+    pub(crate) fn budget(&self) -> Option<&Arc<UfoBudget>> {
+        self.budget.as_ref()
+    }
+
+    pub(crate) fn set_budget(&mut self, budget: Option<Arc<UfoBudget>>) {
+        self.budget = budget;
+    }
+
+    pub(crate) fn history_key(&self) -> (UfoId, usize, u64) {
+        (self.ufo_id, self.offset.chunk_number(), self.generation)
+    }
+
     pub(self) fn size_in_pages(&self) -> SizeInPages {
         SizeInPages(self.size())
     }
@@ -433,165 +759,318 @@ pub struct UfoPopulateError;
 
 pub type UfoPopulateFn =
     dyn Fn(usize, usize, *mut u8) -> Result<(), UfoPopulateError> + Sync + Send;
+
+#[derive(Error, Debug)]
+#[error("Internal Ufo Error when writing through to the source")]
+pub struct UfoWriteThroughError;
+
+/// Given elements start..end and their data, write them back to wherever populate reads them from
+pub type UfoWriteThroughFn =
+    dyn Fn(usize, usize, *const u8) -> Result<(), UfoWriteThroughError> + Sync + Send;
+
+/// What a source knows a range of elements holds without populating it
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum UfoChunkFill {
+    /// Anything, populate it
+    Data,
+    /// Every byte is zero
+    Zero,
+    /// Every element is these stride bytes
+    Constant(Vec<u8>),
+}
+
+impl UfoChunkFill {
+    /// Whether `data` still holds only the fill
+    pub(crate) fn matches(&self, data: &[u8]) -> bool {
+        match self {
+            UfoChunkFill::Data => false,
+            UfoChunkFill::Zero => data.iter().all(|b| *b == 0),
+            UfoChunkFill::Constant(element) => data
+                .chunks(element.len())
+                .all(|e| e == &element[0..e.len()]),
+        }
+    }
+}
+
+/// Given elements start..end, what they hold if the source can tell without populating them
+pub type UfoFillFn = dyn Fn(usize, usize) -> UfoChunkFill + Sync + Send;
 pub(crate) struct UfoFileWriteback {
     ufo_id: UfoId,
-    mmap: MmapFd,
     chunk_ct: usize,
-    pub(crate) chunk_locks: Bitlock,
     chunk_size: usize,
-    total_bytes: usize,
-    header_bytes: usize,
-    // bitlock_bytes: usize,
-    // bitmap_bytes: usize,
+    body_bytes: usize,
+    pub(crate) chunk_locks: Bitlock,
+    // what chunk_locks points into
+    _lock_bits: Box<[AtomicU8]>,
+    written: ChunkBitmap,
+    // where each written chunk lives in the log
+    chunk_extents: Mutex<Vec<Option<ChunkExtent>>>,
+    log: Arc<WritebackLog>,
+    compression: UfoCompression,
+    // the chunks of a persistent UFO as of its last checkpoint, those written back since stay in
+    // the log until the next checkpoint copies them in
+    persistent: Option<PersistentFile>,
+    // what the persistent file holds, the chunks a reset goes back to
+    checkpointed: ChunkBitmap,
 }
 
-// someday make this atomic_from_mut
-fn atomic_bitset(target: &mut u8, mask: u8) {
-    unsafe {
-        let t = &mut *(target as *mut u8 as *mut AtomicU8);
-        t.fetch_update(Ordering::Relaxed, Ordering::Relaxed, |x| Some(x | mask))
-            .unwrap();
-    }
+#[derive(Clone, Copy)]
+struct ChunkExtent {
+    id: ExtentId,
+    len: usize,
+    compressed: bool,
 }
 
 impl UfoFileWriteback {
     pub fn new(
         ufo_id: UfoId,
         cfg: &UfoObjectConfig,
-        core: &Arc<UfoCore>,
-    ) -> Result<UfoFileWriteback, Error> {
-        let page_size = *PAGE_SIZE;
-
+        log: Arc<WritebackLog>,
+        compression: UfoCompression,
+        persistent: Option<(PersistentFile, Vec<u64>)>,
+        shared: Option<SharedChunks>,
+    ) -> UfoFileWriteback {
         let chunk_ct = cfg.element_ct.div_ceil(cfg.elements_loaded_at_once);
         assert!(chunk_ct * cfg.elements_loaded_at_once >= cfg.element_ct);
 
         let chunk_size = cfg.elements_loaded_at_once * cfg.stride;
 
-        let bitmap_bytes = chunk_ct.div_ceil(8); /*8 bits per byte*/
-        // Now we want to get the bitmap bytes up to the next multiple of the page size
-        let bitmap_bytes = up_to_nearest(bitmap_bytes, page_size);
-        assert!(bitmap_bytes * 8 >= chunk_ct);
-        assert!(bitmap_bytes.trailing_zeros() >= page_size.trailing_zeros());
-
-        // the bitlock uses the same math as the bitmap
-        let bitlock_bytes = bitmap_bytes;
-
-        // round the mmap up to the nearest chunk size
-        // when loading we need to give back chunks this large so even though no useful user data may
-        // be in the last chunk we still need to have this available for in the readback chunk
-        let data_bytes = up_to_nearest(cfg.element_ct * cfg.stride, chunk_size);
-        let total_bytes = bitmap_bytes + bitlock_bytes + data_bytes;
-
-        let temp_file =
-            unsafe { OpenFile::temp(core.config.writeback_temp_path.as_str(), total_bytes) }?;
-
-        let mmap = MmapFd::new(
-            total_bytes,
-            &[MemoryProtectionFlag::Read, MemoryProtectionFlag::Write],
-            &[MmapFlag::Shared],
-            None,
-            temp_file,
-            0,
-        )?;
-
-        let chunk_locks = Bitlock::new(unsafe { mmap.as_ptr().add(bitmap_bytes) }, chunk_ct);
+        // the bitlock needs one bit per chunk, round up to whole words like the bitmaps
+        let lock_bits: Box<[AtomicU8]> = (0..chunk_ct.div_ceil(64) * 8)
+            .map(|_| AtomicU8::new(0))
+            .collect();
+        let chunk_locks = Bitlock::new(lock_bits.as_ptr() as *mut u8, chunk_ct);
+
+        let written = ChunkBitmap::new(chunk_ct);
+        let checkpointed = ChunkBitmap::new(chunk_ct);
+        let persistent = persistent.map(|(file, held)| {
+            written.store(&held);
+            checkpointed.store(&held);
+            file
+        });
+        // a clone reads the shared chunks back from its parent's log, however ours is configured
+        let (chunk_extents, log, compression) = match shared {
+            Some(mut shared) => {
+                assert_eq!(shared.extents.len(), chunk_ct);
+                written.store(&shared.written);
+                let extents = std::mem::take(&mut shared.extents);
+                (extents, shared.log.clone(), shared.compression)
+            }
+            None => (vec![None; chunk_ct], log, compression),
+        };
 
-        Ok(UfoFileWriteback {
+        UfoFileWriteback {
             ufo_id,
             chunk_ct,
             chunk_size,
+            // the last chunk is read back whole even though the UFO ends part way through it
+            body_bytes: up_to_nearest(cfg.element_ct * cfg.stride, chunk_size),
             chunk_locks,
-            mmap,
-            total_bytes,
-            header_bytes: bitmap_bytes + bitlock_bytes,
-        })
-    }
-
-    fn body_bytes(&self) -> usize {
-        self.total_bytes - self.header_bytes
+            _lock_bits: lock_bits,
+            written,
+            chunk_extents: Mutex::new(chunk_extents),
+            log,
+            compression,
+            persistent,
+            checkpointed,
+        }
     }
 
-    pub(self) fn writeback(&self, offset: &UfoOffset, data: &[u8]) -> Result<()> {
+    /// Returns the bytes written to disk, less than the chunk when compressing
+    pub(self) fn writeback(&self, offset: &UfoOffset, data: &[u8]) -> Result<usize> {
         let off_head = offset.offset_from_header();
-        if off_head > self.body_bytes() {
+        if off_head >= self.body_bytes {
             anyhow::bail!("{} outside of range", off_head);
         }
 
         let chunk_number = offset.chunk_number();
         assert!(chunk_number < self.chunk_ct);
         assert_eq!(off_head.div_floor(self.chunk_size), chunk_number);
-        let writeback_offset = self.header_bytes + off_head;
-
-        let chunk_byte = chunk_number >> 3;
-        let chunk_bit = 1u8 << (chunk_number & 0b111);
-        assert!(chunk_byte < (self.header_bytes >> 1));
-
-        debug!(target: "ufo_object", "writeback offset {:#x}", writeback_offset);
-
-        let bitmap_ptr: &mut u8 = unsafe { self.mmap.as_ptr().add(chunk_byte).as_mut().unwrap() };
-        let expected_size = std::cmp::min(self.chunk_size, self.total_bytes - writeback_offset);
 
+        // the last chunk ends with the UFO, short of the chunk size
+        let expected_size = std::cmp::min(self.chunk_size, self.body_bytes - off_head);
         anyhow::ensure!(
-            data.len() == expected_size,
+            data.len() <= expected_size,
             "given data does not match the expected size"
         );
 
-        // TODO: blocks CAN be loaded with the UFO lock held!! FIXME
-        // We aren't a mutable copy but writebacks never overlap and we hold the UFO read lock so a chunk cannot be loaded
-        let writeback_arr: &mut [u8] = unsafe {
-            std::slice::from_raw_parts_mut(self.mmap.as_ptr().add(writeback_offset), expected_size)
+        // compress before taking any locks, this is what the eviction threads spend their time on
+        let compressed = self.compression.compress(data)?;
+        let bytes = compressed.as_deref().unwrap_or(data);
+
+        // writebacks and readbacks of a chunk are serialized by its chunk lock
+        let id = {
+            let extents = &mut *self.chunk_extents.lock().unwrap();
+            let id = match extents[chunk_number] {
+                // a chunk shared with a clone is copied on write
+                Some(old) if !self.log.is_shared(old.id) && self.log.capacity(old.id) >= bytes.len() => {
+                    old.id
+                }
+                old => {
+                    if let Some(old) = old {
+                        self.log.free(old.id);
+                    }
+                    self.log.allocate(bytes.len())
+                }
+            };
+            extents[chunk_number] = Some(ChunkExtent {
+                id,
+                len: bytes.len(),
+                compressed: compressed.is_some(),
+            });
+            id
         };
+        debug!(target: "ufo_object", "writeback {:?} chunk {}: {} -> {}b",
+            self.ufo_id, chunk_number, data.len(), bytes.len());
 
-        writeback_arr.copy_from_slice(data);
-        atomic_bitset(bitmap_ptr, chunk_bit);
+        self.log.write(id, bytes)?;
+        self.written.set(chunk_number);
 
-        Ok(())
+        Ok(bytes.len())
     }
 
-    pub fn try_readback<'a>(&'a self, offset: &UfoOffset) -> Option<&'a [u8]> {
-        let off_head = offset.offset_from_header();
-        trace!(target: "ufo_object", "try readback {:?}@{:#x}", self.ufo_id, off_head);
-
-        let chunk_number = off_head.div_floor(self.chunk_size);
-        let readback_offset = self.header_bytes + off_head;
-
-        let chunk_byte = chunk_number >> 3;
-        let chunk_bit = 1u8 << (chunk_number & 0b111);
+    /// Whether the chunk at this offset was written back and should be read back rather than populated
+    pub fn is_written(&self, offset: &UfoOffset) -> bool {
+        trace!(target: "ufo_object", "try readback {:?}@{:#x}", self.ufo_id, offset.offset_from_header());
+        self.written.get(offset.chunk_number())
+    }
 
-        let bitmap_ptr: &u8 = unsafe { self.mmap.as_ptr().add(chunk_byte).as_ref().unwrap() };
-        let is_written = *bitmap_ptr & chunk_bit != 0;
+    /// A whole chunk of data written back earlier (see is_written), read from the log into `buffer`
+    /// and decompressed there if need be
+    pub(crate) fn readback<'a>(
+        &'a self,
+        offset: &UfoOffset,
+        buffer: &'a mut UfoWriteBuffer,
+    ) -> Result<&'a [u8]> {
+        trace!(target: "ufo_object", "allow readback {:?}@{:#x}", self.ufo_id, offset.offset_from_header());
+        let out = unsafe {
+            buffer.ensure_capcity(self.chunk_size);
+            &mut buffer.slice_mut()[0..self.chunk_size]
+        };
+        self.read_chunk(offset.chunk_number(), out)?;
+        Ok(out)
+    }
 
-        if is_written {
-            trace!(target: "ufo_object", "allow readback {:?}@{:#x}", self.ufo_id, off_head);
-            let arr: &[u8] = unsafe {
-                std::slice::from_raw_parts(self.mmap.as_ptr().add(readback_offset), self.chunk_size)
-            };
-            Some(arr)
+    /// Like readback, into `out` which needs only be as large as the chunk was when written back
+    pub(crate) fn read_chunk(&self, chunk_number: usize, out: &mut [u8]) -> Result<()> {
+        let extent = self.chunk_extents.lock().unwrap()[chunk_number];
+        let extent = match (extent, &self.persistent) {
+            (Some(extent), _) => extent,
+            // not written back since the last checkpoint, the file holds it
+            (None, Some(file)) => return file.read_chunk(chunk_number, out),
+            (None, None) => anyhow::bail!("chunk {} was never written back", chunk_number),
+        };
+        if extent.compressed {
+            let mut compressed = vec![0u8; extent.len];
+            self.log.read(extent.id, &mut compressed)?;
+            self.compression.decompress(&compressed, out)?;
         } else {
-            None
+            self.log.read(extent.id, &mut out[0..extent.len])?;
         }
+        Ok(())
     }
 
+    /// Forget everything written back and give the space back to the log. A persistent UFO goes
+    /// back to what its file held at the last checkpoint
     pub fn reset(&self) -> Result<()> {
-        let ptr = self.mmap.as_ptr();
-        unsafe {
-            check_return_zero(libc::madvise(
-                ptr.cast(),
-                self.total_bytes,
-                // punch a hole in the file
-                libc::MADV_REMOVE,
-            ))?;
+        if self.persistent.is_some() {
+            self.written.store(&self.checkpointed.snapshot());
+        } else {
+            self.written.clear_all();
         }
+        self.release_extents();
         Ok(())
     }
+
+    /// Whether the chunk was written back to the log, for a persistent UFO since its last checkpoint
+    fn is_logged(&self, chunk_number: usize) -> bool {
+        self.chunk_extents.lock().unwrap()[chunk_number].is_some()
+    }
+
+    /// Give the chunk's place in the log back, the persistent file or the source holds it now
+    fn release_logged(&self, chunk_number: usize) {
+        if let Some(old) = self.chunk_extents.lock().unwrap()[chunk_number].take() {
+            self.log.free(old.id);
+        }
+    }
+
+    /// The source holds the chunk now, it is populated from there rather than read back
+    fn forget(&self, chunk_number: usize) {
+        self.written.clear(chunk_number);
+        self.release_logged(chunk_number);
+    }
+
+    /// Everything written back so far, for a clone to start out with
+    fn share(&self) -> SharedChunks {
+        let extents = self.chunk_extents.lock().unwrap();
+        extents
+            .iter()
+            .flatten()
+            .for_each(|extent| self.log.share(extent.id));
+        SharedChunks {
+            written: self.written.snapshot(),
+            extents: extents.clone(),
+            log: self.log.clone(),
+            compression: self.compression,
+        }
+    }
+
+    fn release_extents(&self) {
+        let extents = &mut *self.chunk_extents.lock().unwrap();
+        extents
+            .iter_mut()
+            .filter_map(Option::take)
+            .for_each(|e| self.log.free(e.id));
+    }
+}
+
+/// The written back chunks of a UFO, held for a clone of it until the clone is allocated
+pub(crate) struct SharedChunks {
+    written: Vec<u64>,
+    extents: Vec<Option<ChunkExtent>>,
+    log: Arc<WritebackLog>,
+    compression: UfoCompression,
+}
+
+impl Drop for SharedChunks {
+    fn drop(&mut self) {
+        // empty once a clone took them over
+        self.extents
+            .iter()
+            .flatten()
+            .for_each(|extent| self.log.free(extent.id));
+    }
+}
+
+impl Drop for UfoFileWriteback {
+    fn drop(&mut self) {
+        self.release_extents();
+    }
 }
 
 pub struct UfoObject {
     pub id: UfoId,
     pub core: Weak<UfoCore>,
     pub config: UfoObjectConfig,
-    pub mmap: BaseMmap,
+    pub mmap: UfoMapping,
+    // the page cache mmap maps, for UFOs backed by shared memory
+    pub(crate) shared_memory: Option<SharedMemory>,
     pub(crate) writeback_util: UfoFileWriteback,
+    // bumped on every reset so chunks loaded before then can be told apart
+    pub(crate) generation: u64,
+    pub(crate) resident_chunks: ChunkBitmap,
+    // chunks written since they were loaded, None when dirty chunks are found by hashing
+    pub(crate) dirty_chunks: Option<ChunkBitmap>,
+    // set when a resident chunk is asked for again, cleared by eviction
+    pub(crate) referenced_chunks: Arc<ChunkBitmap>,
+    // resident chunks loaded as a constant, those on the zero page are not write protected
+    pub(crate) constant_chunks: ChunkBitmap,
+    // a whole chunk of the last constant asked for, copied from for every chunk of it
+    pub(crate) constant_template: Mutex<Option<(Vec<u8>, Arc<[u8]>)>>,
+    // what chunks held when last checkpointed, for those whose writes are not tracked
+    pub(crate) checkpointed: Mutex<HashMap<usize, DataHash>>,
+    pub(crate) readahead: Mutex<Readahead>,
+    pub(crate) stats: StatsRecorder,
 }
 
 impl std::cmp::PartialEq for UfoObject {
@@ -605,21 +1084,411 @@ impl std::cmp::Eq for UfoObject {}
 impl UfoObject {
     pub(crate) fn reset_internal(&mut self) -> anyhow::Result<()> {
         let length = self.config.true_size - self.config.header_size_with_padding;
-        unsafe {
-            check_return_zero(libc::madvise(
-                self.mmap
-                    .as_ptr()
-                    .add(self.config.header_size_with_padding)
-                    .cast(),
-                length,
-                libc::MADV_DONTNEED,
-            ))?;
+        match &self.shared_memory {
+            // unmapping would leave the pages in the page cache
+            Some(shared_memory) => shared_memory.punch(self.config.header_size_with_padding, length)?,
+            None => unsafe {
+                check_return_zero(libc::madvise(
+                    self.mmap
+                        .as_ptr()
+                        .add(self.config.header_size_with_padding)
+                        .cast(),
+                    length,
+                    libc::MADV_DONTNEED,
+                ))?;
+            },
         }
         self.writeback_util.reset()?;
+        self.generation += 1;
+        self.resident_chunks.clear_all();
+        if let Some(dirty) = &self.dirty_chunks {
+            dirty.clear_all();
+        }
+        self.referenced_chunks.clear_all();
+        self.constant_chunks.clear_all();
+        self.checkpointed.lock().unwrap().clear();
+        self.readahead.lock().unwrap().reset();
+
+        Ok(())
+    }
+
+    /// Bytes of chunk `chunk_number` that lie within the UFO, the last chunk is cut short
+    pub(crate) fn chunk_bytes(&self, chunk_number: usize) -> Range<usize> {
+        let chunk_size = self.config.elements_loaded_at_once * self.config.stride;
+        let body_bytes = self.config.element_ct * self.config.stride;
+        let start = chunk_number * chunk_size;
+        start..std::cmp::min(start + chunk_size, body_bytes)
+    }
+
+    /// Write the chunks changed since they were loaded or last checkpointed to the file of a
+    /// persistent UFO, along with those written back to the log since, and record every chunk the
+    /// file holds, so a later session reads them back from there. Between checkpoints the file is
+    /// left alone, only a crash during a checkpoint can leave it holding some chunks newer than
+    /// the rest
+    pub fn checkpoint(&self) -> anyhow::Result<()> {
+        let file = self
+            .writeback_util
+            .persistent
+            .as_ref()
+            .ok_or_else(|| anyhow::anyhow!("{:?} is not persistent", self.id))?;
+        debug!(target: "ufo_object", "checkpoint {:?}", self.id);
+        let core = self.core.upgrade();
+        let mut buffer = Vec::new();
+
+        for chunk_number in 0..self.config.chunk_ct() {
+            // holds off eviction, which would otherwise take the pages from under us
+            let _lock = self
+                .writeback_util
+                .chunk_locks
+                .spinlock(chunk_number)
+                .map_err(|_| anyhow::anyhow!("chunk lock broken"))?;
+            let bytes = self.chunk_bytes(chunk_number);
+            let logged = self.writeback_util.is_logged(chunk_number);
+            if !self.resident_chunks.get(chunk_number) {
+                if logged {
+                    buffer.resize(bytes.len(), 0);
+                    self.writeback_util.read_chunk(chunk_number, &mut buffer)?;
+                    file.write_chunk(chunk_number, &buffer)?;
+                    self.writeback_util.release_logged(chunk_number);
+                }
+                continue;
+            }
+            let data_ptr = unsafe { self.body_ptr().cast::<u8>().add(bytes.start) };
+            let data = unsafe { std::slice::from_raw_parts(data_ptr, bytes.len()) };
+            // a chunk loaded back from the log is new to the file even if unchanged since
+            if !self.take_unsaved(core.as_deref(), chunk_number, data)? && !logged {
+                continue;
+            }
+            if let Err(e) = file.write_chunk(chunk_number, data) {
+                self.mark_unsaved(chunk_number);
+                return Err(e);
+            }
+            self.writeback_util.release_logged(chunk_number);
+            self.writeback_util.written.set(chunk_number);
+        }
 
+        let held = self.writeback_util.written.snapshot();
+        file.checkpoint(&held)?;
+        self.writeback_util.checkpointed.store(&held);
         Ok(())
     }
 
+    /// Whether a resident chunk changed since it was loaded or last saved, it counts as saved from
+    /// here on. Write protection is armed again before the data is read, so a write racing the save
+    /// is either in the data or faults and makes the chunk dirty again. Chunks whose writes are not
+    /// seen, hashed ones and constants on the zero page, are compared with what was saved last
+    fn take_unsaved(
+        &self,
+        core: Option<&UfoCore>,
+        chunk_number: usize,
+        data: &[u8],
+    ) -> anyhow::Result<bool> {
+        match (&self.dirty_chunks, core) {
+            (Some(dirty), Some(core)) if !self.constant_chunks.get(chunk_number) => {
+                let unsaved = dirty.take(chunk_number);
+                if unsaved {
+                    core.protect_again(data.as_ptr() as *mut u8, up_to_nearest(data.len(), *PAGE_SIZE))?;
+                }
+                Ok(unsaved)
+            }
+            // the core is going away, there is nothing to re-arm
+            (Some(dirty), None) if !self.constant_chunks.get(chunk_number) => {
+                Ok(dirty.get(chunk_number))
+            }
+            _ => {
+                let hash = hash_function(data);
+                let saved = self.checkpointed.lock().unwrap().insert(chunk_number, hash);
+                Ok(saved != Some(hash))
+            }
+        }
+    }
+
+    /// The chunk could not be saved after all
+    fn mark_unsaved(&self, chunk_number: usize) {
+        if let Some(dirty) = &self.dirty_chunks {
+            dirty.set(chunk_number);
+        }
+        self.checkpointed.lock().unwrap().remove(&chunk_number);
+    }
+
+    /// What a chunk never loaded holds, worked out as a fault would: a constant where the source
+    /// says so, otherwise populated by the core, which reads file sources and populates in parallel
+    fn populate_unloaded(&self, chunk_number: usize, out: &mut [u8]) -> anyhow::Result<()> {
+        let start = chunk_number * self.config.elements_loaded_at_once;
+        let end = std::cmp::min(
+            start + self.config.elements_loaded_at_once,
+            self.config.element_ct,
+        );
+        let len = (end - start) * self.config.stride;
+        let fill = self
+            .config
+            .fill
+            .as_ref()
+            .map_or(UfoChunkFill::Data, |fill| fill(start, end));
+        match fill {
+            UfoChunkFill::Zero => out[0..len].iter_mut().for_each(|b| *b = 0),
+            UfoChunkFill::Constant(element) if element.len() == self.config.stride => {
+                out[0..len].copy_from_slice(&self.constant_template(&element)[0..len])
+            }
+            _ => {
+                let core = self
+                    .core
+                    .upgrade()
+                    .ok_or_else(|| anyhow::anyhow!("the core is shut down"))?;
+                core.populate(&self.config, start, end, out.as_mut_ptr())?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Make a UFO persistent. Every chunk is written to the new file, populating those never loaded,
+    /// so the file stands on its own without the source
+    pub fn persist(&mut self, persistence: UfoPersistence) -> anyhow::Result<()> {
+        anyhow::ensure!(
+            self.config.should_try_writeback(),
+            "read only UFOs cannot be persistent"
+        );
+        anyhow::ensure!(
+            self.writeback_util.persistent.is_none(),
+            "{:?} is already persistent",
+            self.id
+        );
+        anyhow::ensure!(
+            !self.writes_through(),
+            "{:?} writes through to its source",
+            self.id
+        );
+        debug!(target: "ufo_object", "persist {:?} to {}", self.id, persistence.path);
+
+        let header = self.config.persistent_header(&persistence);
+        let (file, _) = PersistentFile::open(&persistence, header)?;
+        let chunk_size = self.config.elements_loaded_at_once * self.config.stride;
+        let mut buffer = vec![0u8; chunk_size];
+        let core = self.core.upgrade();
+
+        // with the UFO write locked nothing is loaded or evicted meanwhile
+        for chunk_number in 0..self.config.chunk_ct() {
+            let bytes = self.chunk_bytes(chunk_number);
+            if self.resident_chunks.get(chunk_number) {
+                let data = unsafe {
+                    std::slice::from_raw_parts(
+                        self.body_ptr().cast::<u8>().add(bytes.start),
+                        bytes.len(),
+                    )
+                };
+                // the new file has nothing yet, changed or not the chunk is saved from here on
+                self.take_unsaved(core.as_deref(), chunk_number, data)?;
+                file.write_chunk(chunk_number, data)?;
+                continue;
+            }
+
+            if self.writeback_util.written.get(chunk_number) {
+                self.writeback_util.read_chunk(chunk_number, &mut buffer)?;
+            } else {
+                self.populate_unloaded(chunk_number, &mut buffer)?;
+            }
+            file.write_chunk(chunk_number, &buffer[0..bytes.len()])?;
+        }
+
+        self.writeback_util.release_extents();
+        for chunk_number in 0..self.config.chunk_ct() {
+            self.writeback_util.written.set(chunk_number);
+        }
+        self.writeback_util.persistent = Some(file);
+        self.config.persistence = Some(persistence);
+        self.checkpoint()
+    }
+
+    pub fn is_persistent(&self) -> bool {
+        self.writeback_util.persistent.is_some()
+    }
+
+    /// Write back the chunks changed since they were loaded and share everything written back with
+    /// a clone. Each side copies a shared chunk when it writes it back again, so the clone holds
+    /// what this UFO holds now and neither sees what the other writes later
+    pub(crate) fn share_chunks(&self) -> anyhow::Result<SharedChunks> {
+        anyhow::ensure!(!self.is_persistent(), "{:?} is persistent", self.id);
+        anyhow::ensure!(
+            !self.writes_through(),
+            "{:?} writes through to its source",
+            self.id
+        );
+        debug!(target: "ufo_object", "share the chunks of {:?}", self.id);
+
+        if self.config.should_try_writeback() {
+            for chunk_number in 0..self.config.chunk_ct() {
+                // holds off eviction, which would otherwise take the pages from under us
+                let _lock = self
+                    .writeback_util
+                    .chunk_locks
+                    .spinlock(chunk_number)
+                    .map_err(|_| anyhow::anyhow!("chunk lock broken"))?;
+                let dirty = self
+                    .dirty_chunks
+                    .as_ref()
+                    .map_or(true, |dirty| dirty.get(chunk_number))
+                    || self.constant_chunks.get(chunk_number);
+                if !self.resident_chunks.get(chunk_number) || !dirty {
+                    continue;
+                }
+                // the chunk stays dirty, it is written back again should it be evicted
+                let bytes = self.chunk_bytes(chunk_number);
+                let data_ptr = unsafe { self.body_ptr().cast::<u8>().add(bytes.start) };
+                let data = unsafe { std::slice::from_raw_parts(data_ptr, bytes.len()) };
+                let offset = UfoOffset::from_addr(self, data_ptr as *const libc::c_void);
+                self.writeback_util.writeback(&offset, data)?;
+            }
+        }
+
+        Ok(self.writeback_util.share())
+    }
+
+    /// Ask the source what chunks hold before populating them, see UfoObjectConfig::with_fill
+    pub fn set_fill(&mut self, fill: Option<Box<UfoFillFn>>) {
+        self.config.fill = fill.map(Arc::from);
+    }
+
+    /// Populate chunks on several threads from now on, see UfoObjectConfig::with_parallel_populate
+    pub fn set_parallel_populate(&mut self, parallel: bool) {
+        self.config.parallel_populate = parallel;
+    }
+
+    /// Read chunks straight from a file from now on, see UfoObjectConfig::with_file_source
+    pub fn set_file_source(&mut self, file_source: Option<UfoFileSource>) {
+        self.config.file_source = file_source.map(Arc::new);
+    }
+
+    /// A chunk of nothing but `element`, to copy constant chunks from
+    pub(crate) fn constant_template(&self, element: &[u8]) -> Arc<[u8]> {
+        let template = &mut *self.constant_template.lock().unwrap();
+        match template {
+            Some((cached, chunk)) if cached.as_slice() == element => chunk.clone(),
+            _ => {
+                let chunk_size = self.config.elements_loaded_at_once * self.config.stride;
+                let chunk: Arc<[u8]> = element
+                    .iter()
+                    .copied()
+                    .cycle()
+                    .take(chunk_size)
+                    .collect::<Vec<u8>>()
+                    .into();
+                *template = Some((element.to_vec(), chunk.clone()));
+                chunk
+            }
+        }
+    }
+
+    /// Write dirty chunks through to the source from now on, see UfoObjectConfig::with_write_through
+    pub fn set_write_through(
+        &mut self,
+        write_through: Option<Box<UfoWriteThroughFn>>,
+    ) -> anyhow::Result<()> {
+        anyhow::ensure!(
+            write_through.is_none() || self.config.should_try_writeback(),
+            "read only UFOs have nothing to write through"
+        );
+        anyhow::ensure!(
+            write_through.is_none() || !self.is_persistent(),
+            "{:?} writes back to its persistent file",
+            self.id
+        );
+        self.config.write_through = write_through;
+        Ok(())
+    }
+
+    pub fn writes_through(&self) -> bool {
+        self.config.write_through.is_some()
+    }
+
+    /// Hand a chunk back to the source, false if there is no write through or it failed, in which
+    /// case the chunk has to go to the writeback log. Called under the chunk lock
+    pub(crate) fn write_through(&self, chunk_number: usize, data: &[u8]) -> bool {
+        let write_through = match &self.config.write_through {
+            Some(write_through) => write_through,
+            None => return false,
+        };
+        let start = chunk_number * self.config.elements_loaded_at_once;
+        let end = std::cmp::min(
+            start + self.config.elements_loaded_at_once,
+            self.config.element_ct,
+        );
+        debug_assert!(data.len() >= (end - start) * self.config.stride);
+
+        match write_through(start, end, data.as_ptr()) {
+            Ok(()) => {
+                trace!(target: "ufo_object", "wrote through {:?} chunk {}", self.id, chunk_number);
+                self.writeback_util.forget(chunk_number);
+                true
+            }
+            Err(e) => {
+                warn!(target: "ufo_object", "{:?} chunk {}: {}, writing back instead", self.id, chunk_number, e);
+                false
+            }
+        }
+    }
+
+    /// Write the resident dirty chunks through to the source, all resident chunks when dirty chunks
+    /// are found by hashing. `protect` write protects a chunk again so that its next write is seen,
+    /// with it the chunks are no longer dirty afterwards
+    pub(crate) fn flush(
+        &self,
+        protect: Option<&dyn Fn(*mut u8, usize) -> anyhow::Result<()>>,
+    ) -> anyhow::Result<()> {
+        anyhow::ensure!(self.writes_through(), "{:?} does not write through", self.id);
+        debug!(target: "ufo_object", "flush {:?}", self.id);
+
+        let mut failed = 0;
+        for chunk_number in 0..self.config.chunk_ct() {
+            // holds off eviction, which would otherwise take the pages from under us
+            let _lock = self
+                .writeback_util
+                .chunk_locks
+                .spinlock(chunk_number)
+                .map_err(|_| anyhow::anyhow!("chunk lock broken"))?;
+            if !self.resident_chunks.get(chunk_number) {
+                continue;
+            }
+            let bytes = self.chunk_bytes(chunk_number);
+            let data_ptr = unsafe { self.body_ptr().cast::<u8>().add(bytes.start) };
+            let dirty = match (&self.dirty_chunks, protect) {
+                (None, _) => true,
+                // may have been written without a fault, see constant_chunks
+                _ if self.constant_chunks.get(chunk_number) => true,
+                (Some(dirty), None) => dirty.get(chunk_number),
+                // clean before protecting, a write in between is in the data we write through
+                (Some(dirty), Some(protect)) => {
+                    let dirty = dirty.take(chunk_number);
+                    if dirty {
+                        protect(data_ptr, up_to_nearest(bytes.len(), *PAGE_SIZE))?;
+                    }
+                    dirty
+                }
+            };
+            if !dirty {
+                continue;
+            }
+
+            let data = unsafe { std::slice::from_raw_parts(data_ptr, bytes.len()) };
+            if !self.write_through(chunk_number, data) {
+                if let Some(dirty) = &self.dirty_chunks {
+                    dirty.set(chunk_number);
+                }
+                failed += 1;
+            }
+        }
+
+        anyhow::ensure!(failed == 0, "{} chunks of {:?} could not be written through", failed, self.id);
+        Ok(())
+    }
+
+    /// Counters and latencies for this UFO alone, reset along with the core's (UfoCore::reset_stats)
+    pub fn stats(&self) -> UfoStats {
+        let chunk_size = self.config.elements_loaded_at_once * self.config.stride;
+        let body_size = self.config.true_size - self.config.header_size_with_padding;
+        let resident = std::cmp::min(self.resident_chunks.count() * chunk_size, body_size);
+        self.stats.snapshot(resident)
+    }
+
     pub fn header_ptr(&self) -> *mut std::ffi::c_void {
         let header_offset = self.config.header_size_with_padding - self.config.header_size;
         unsafe { self.mmap.as_ptr().add(header_offset).cast() }
@@ -647,6 +1516,27 @@ impl UfoObject {
         Ok(wait_group)
     }
 
+    /// Populate the chunks covering elements `start..end` on the prefetch workers, the returned
+    /// WaitGroup is released once they are all in
+    pub fn prefetch(&self, start: usize, end: usize) -> Result<WaitGroup, UfoLookupErr> {
+        let wait_group = crossbeam::sync::WaitGroup::new();
+        if start >= end {
+            return Ok(wait_group);
+        }
+        let core = match self.core.upgrade() {
+            None => return Err(UfoLookupErr::CoreShutdown),
+            Some(x) => x,
+        };
+
+        core.msg_send.send(UfoInstanceMsg::Prefetch(
+            wait_group.clone(),
+            self.id,
+            start..end,
+        ))?;
+
+        Ok(wait_group)
+    }
+
     pub fn free(&mut self) -> Result<WaitGroup, UfoLookupErr> {
         let wait_group = crossbeam::sync::WaitGroup::new();
         let core = match self.core.upgrade() {
@@ -0,0 +1,625 @@
+use std::alloc;
+use std::collections::{BTreeMap, BTreeSet, HashMap};
+use std::ops::{Deref, DerefMut};
+use std::sync::{Arc, Condvar, Mutex, RwLock};
+
+use anyhow::Result;
+use crossbeam::channel::{Receiver, Sender};
+use log::{debug, error, trace, warn};
+
+use crate::mmap_wrapers::OpenFile;
+use crate::return_checks::check_return_zero;
+
+// Extents are handed out in multiples of this, the smallest block a disk writes anyway
+const GRANULE: u64 = 512;
+// O_DIRECT wants offsets, lengths and buffers aligned to the logical block size, a page covers them all
+const DIRECT_GRANULE: u64 = 4096;
+// Holes smaller than this are left for the next extent to fill rather than punched out of the file
+const MIN_PUNCH_BYTES: u64 = 64 * 1024;
+// Compaction holds up every read and write to the log, below this much garbage it isn't worth it
+const MIN_COMPACTION_BYTES: u64 = 64 * 1024 * 1024;
+// UIO_MAXIOV, the most buffers one pwritev takes
+const MAX_IOVECS: usize = 1024;
+
+/// A slot in the log, stays the same when compaction moves the data
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct ExtentId(usize);
+
+#[derive(Clone, Copy)]
+struct Extent {
+    offset: u64,
+    capacity: u64,
+    // UFOs holding the extent, clones share the chunks their parent wrote back
+    refs: u32,
+}
+
+struct Space {
+    granule: u64,
+    extents: Vec<Option<Extent>>,
+    unused_ids: Vec<usize>,
+    // free space below `end`, by offset to coalesce neighbours and by size to find the best fit
+    holes: BTreeMap<u64, u64>,
+    holes_by_size: BTreeSet<(u64, u64)>,
+    end: u64,
+    live_bytes: u64,
+    compactions: u64,
+}
+
+impl Space {
+    fn remove_hole(&mut self, offset: u64, len: u64) {
+        self.holes.remove(&offset);
+        self.holes_by_size.remove(&(len, offset));
+    }
+
+    fn add_hole(&mut self, mut offset: u64, mut len: u64) {
+        if let Some((&before, &before_len)) = self.holes.range(..offset).next_back() {
+            if before + before_len == offset {
+                self.remove_hole(before, before_len);
+                offset = before;
+                len += before_len;
+            }
+        }
+        if let Some(&after_len) = self.holes.get(&(offset + len)) {
+            self.remove_hole(offset + len, after_len);
+            len += after_len;
+        }
+        self.holes.insert(offset, len);
+        self.holes_by_size.insert((len, offset));
+    }
+
+    /// Best fit from the holes, otherwise the end of the log
+    fn take_space(&mut self, capacity: u64) -> u64 {
+        let fit = self.holes_by_size.range((capacity, 0)..).next().copied();
+        match fit {
+            Some((len, offset)) => {
+                self.remove_hole(offset, len);
+                if len > capacity {
+                    self.holes.insert(offset + capacity, len - capacity);
+                    self.holes_by_size.insert((len - capacity, offset + capacity));
+                }
+                offset
+            }
+            None => {
+                let offset = self.end;
+                self.end += capacity;
+                offset
+            }
+        }
+    }
+
+    fn extent(&self, id: ExtentId) -> Extent {
+        self.extents[id.0].expect("extent already freed")
+    }
+}
+
+/// Heap memory aligned for O_DIRECT
+struct IoBuf {
+    ptr: *mut u8,
+    len: usize,
+}
+
+unsafe impl Send for IoBuf {}
+unsafe impl Sync for IoBuf {}
+
+impl IoBuf {
+    fn zeroed(len: usize) -> IoBuf {
+        let layout = Self::layout(len);
+        let ptr = unsafe { alloc::alloc_zeroed(layout) };
+        if ptr.is_null() {
+            alloc::handle_alloc_error(layout);
+        }
+        IoBuf { ptr, len }
+    }
+
+    fn layout(len: usize) -> alloc::Layout {
+        alloc::Layout::from_size_align(std::cmp::max(len, 1), DIRECT_GRANULE as usize).unwrap()
+    }
+}
+
+impl Deref for IoBuf {
+    type Target = [u8];
+    fn deref(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+impl DerefMut for IoBuf {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr, self.len) }
+    }
+}
+
+impl Drop for IoBuf {
+    fn drop(&mut self) {
+        unsafe { alloc::dealloc(self.ptr, Self::layout(self.len)) };
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct WritebackLogStats {
+    /// Bytes the log file spans, holes included
+    pub file_bytes: u64,
+    /// Bytes in extents holding written back chunks
+    pub live_bytes: u64,
+    pub compactions: u64,
+    /// Chunks written to the file
+    pub writes: u64,
+    /// Write calls they took, fewer than writes when the queue batches them up
+    pub submissions: u64,
+    /// Writes waiting in the queue or being written
+    pub queued: u64,
+}
+
+struct QueuedWrite {
+    extent: usize,
+    offset: u64,
+    data: Arc<IoBuf>,
+}
+
+struct Pending {
+    // the latest data of every extent still on its way to disk, readbacks are served from here
+    by_extent: HashMap<usize, Arc<IoBuf>>,
+    queued: usize,
+    // reported by the next write, the data stays in by_extent so reading it back still works
+    failed: Option<std::io::Error>,
+    writes: u64,
+    submissions: u64,
+}
+
+/// What the writer thread shares with the log
+struct LogFile {
+    file: OpenFile,
+    direct: bool,
+    pending: Mutex<Pending>,
+    drained: Condvar,
+}
+
+/// One file every UFO of a core writes its chunks back to. Space is handed out in extents as chunks
+/// are written back, rather than reserving the whole of each UFO up front, and goes back to the log
+/// when a UFO is reset or freed. Compaction moves extents down over the holes and truncates the file
+///
+/// With a queue depth writes return once the data is queued, a writer thread picks up what has
+/// queued meanwhile (up to the queue depth) and writes adjacent extents out together with pwritev.
+/// Writers block while the queue is full
+pub(crate) struct WritebackLog {
+    dir: String,
+    queue_depth: usize,
+    io: Arc<LogFile>,
+    queue: Option<Sender<QueuedWrite>>,
+    space: Mutex<Space>,
+    // queueing, reads and writes hold this shared, compaction exclusively while it moves extents about
+    moving: RwLock<()>,
+}
+
+pub(crate) fn write_all_at(file: &OpenFile, mut data: &[u8], mut offset: u64) -> Result<()> {
+    while !data.is_empty() {
+        let written =
+            unsafe { libc::pwrite64(file.as_fd(), data.as_ptr().cast(), data.len(), offset as i64) };
+        if written < 0 {
+            return Err(std::io::Error::last_os_error().into());
+        }
+        data = &data[written as usize..];
+        offset += written as u64;
+    }
+    Ok(())
+}
+
+/// Bytes read, short of the buffer at the end of the file
+pub(crate) fn read_at(file: &OpenFile, mut data: &mut [u8], mut offset: u64) -> Result<usize> {
+    let mut total = 0;
+    while !data.is_empty() {
+        let read =
+            unsafe { libc::pread64(file.as_fd(), data.as_mut_ptr().cast(), data.len(), offset as i64) };
+        if read < 0 {
+            return Err(std::io::Error::last_os_error().into());
+        }
+        if read == 0 {
+            break;
+        }
+        data = &mut data[read as usize..];
+        offset += read as u64;
+        total += read as usize;
+    }
+    Ok(total)
+}
+
+pub(crate) fn read_exact_at(file: &OpenFile, data: &mut [u8], offset: u64) -> Result<()> {
+    let read = read_at(file, data, offset)?;
+    anyhow::ensure!(read == data.len(), "writeback log cut short");
+    Ok(())
+}
+
+impl LogFile {
+    fn granule(&self) -> u64 {
+        if self.direct {
+            DIRECT_GRANULE
+        } else {
+            GRANULE
+        }
+    }
+
+    /// Where data goes on its way to the file, padded out to whole blocks for O_DIRECT
+    fn io_buf(&self, data: &[u8]) -> IoBuf {
+        let len = if self.direct {
+            (data.len() as u64).div_ceil(DIRECT_GRANULE) * DIRECT_GRANULE
+        } else {
+            data.len() as u64
+        };
+        let mut buf = IoBuf::zeroed(len as usize);
+        buf[0..data.len()].copy_from_slice(data);
+        buf
+    }
+
+    fn read(&self, out: &mut [u8], offset: u64) -> Result<()> {
+        if !self.direct {
+            return read_exact_at(&self.file, out, offset);
+        }
+        let padded = (out.len() as u64).div_ceil(DIRECT_GRANULE) * DIRECT_GRANULE;
+        let mut bounce = IoBuf::zeroed(padded as usize);
+        let read = read_at(&self.file, &mut bounce, offset)?;
+        anyhow::ensure!(read >= out.len(), "writeback log cut short");
+        out.copy_from_slice(&bounce[0..out.len()]);
+        Ok(())
+    }
+
+    /// Buffers for consecutive offsets, in one call where we can
+    fn write_run(&self, run: &[&QueuedWrite]) -> Result<()> {
+        let iovecs: Vec<libc::iovec> = run
+            .iter()
+            .map(|w| libc::iovec {
+                iov_base: w.data.ptr.cast(),
+                iov_len: w.data.len(),
+            })
+            .collect();
+        let written = unsafe {
+            libc::pwritev(
+                self.file.as_fd(),
+                iovecs.as_ptr(),
+                iovecs.len() as i32,
+                run[0].offset as i64,
+            )
+        };
+        if written < 0 {
+            return Err(std::io::Error::last_os_error().into());
+        }
+
+        // short writes are rare, finish them off a buffer at a time
+        let mut done = written as usize;
+        for w in run {
+            if done >= w.data.len() {
+                done -= w.data.len();
+                continue;
+            }
+            write_all_at(&self.file, &w.data[done..], w.offset + done as u64)?;
+            done = 0;
+        }
+        Ok(())
+    }
+
+    fn writer_loop(&self, recv: Receiver<QueuedWrite>, depth: usize) {
+        while let Ok(first) = recv.recv() {
+            let mut batch = vec![first];
+            while batch.len() < depth {
+                match recv.try_recv() {
+                    Ok(w) => batch.push(w),
+                    Err(_) => break,
+                }
+            }
+            let queued = batch.len();
+
+            // writes to freed or since rewritten extents are skipped, which leaves the live ones
+            // without overlaps and free to go out in any order
+            let mut live: Vec<&QueuedWrite> = {
+                let pending = self.pending.lock().unwrap();
+                batch
+                    .iter()
+                    .filter(|w| {
+                        pending
+                            .by_extent
+                            .get(&w.extent)
+                            .map_or(false, |d| Arc::ptr_eq(d, &w.data))
+                    })
+                    .collect()
+            };
+            live.sort_by_key(|w| w.offset);
+
+            let mut submissions = 0;
+            let mut result = Ok(());
+            for run in live.group_by(|a, b| a.offset + a.data.len() as u64 == b.offset) {
+                for run in run.chunks(MAX_IOVECS) {
+                    submissions += 1;
+                    result = result.and_then(|_| self.write_run(run));
+                }
+            }
+            trace!(target: "ufo_object", "wrote {} chunks to the log in {} calls", live.len(), submissions);
+
+            let pending = &mut *self.pending.lock().unwrap();
+            match result {
+                Ok(()) => {
+                    for w in &live {
+                        if pending
+                            .by_extent
+                            .get(&w.extent)
+                            .map_or(false, |d| Arc::ptr_eq(d, &w.data))
+                        {
+                            pending.by_extent.remove(&w.extent);
+                        }
+                    }
+                }
+                Err(e) => {
+                    error!(target: "ufo_object", "writeback failed: {}", e);
+                    pending.failed = Some(std::io::Error::new(std::io::ErrorKind::Other, e.to_string()));
+                }
+            }
+            pending.writes += live.len() as u64;
+            pending.submissions += submissions;
+            pending.queued -= queued;
+            self.drained.notify_all();
+        }
+        debug!(target: "ufo_object", "writeback log closed");
+    }
+}
+
+impl WritebackLog {
+    /// A queue depth of 0 writes straight away on the calling thread. Falls back to buffered I/O
+    /// where the file system does not take O_DIRECT
+    pub fn new(dir: &str, queue_depth: usize, direct: bool) -> Result<Arc<WritebackLog>, std::io::Error> {
+        debug!(target: "ufo_object", "new writeback log in {}, queue depth {}", dir, queue_depth);
+        let (file, direct) = match direct {
+            false => (unsafe { OpenFile::temp(dir, 0) }?, false),
+            true => match unsafe { OpenFile::temp_with_flags(dir, 0, libc::O_DIRECT) } {
+                Ok(file) => (file, true),
+                Err(e) if e.raw_os_error() == Some(libc::EINVAL) => {
+                    warn!(target: "ufo_object", "{} does not support direct I/O", dir);
+                    (unsafe { OpenFile::temp(dir, 0) }?, false)
+                }
+                Err(e) => return Err(e),
+            },
+        };
+        let io = Arc::new(LogFile {
+            file,
+            direct,
+            pending: Mutex::new(Pending {
+                by_extent: HashMap::new(),
+                queued: 0,
+                failed: None,
+                writes: 0,
+                submissions: 0,
+            }),
+            drained: Condvar::new(),
+        });
+
+        let queue = if queue_depth > 0 {
+            let (send, recv) = crossbeam::channel::bounded(queue_depth);
+            let writer_io = io.clone();
+            std::thread::Builder::new()
+                .name("Ufo Writeback".to_string())
+                .spawn(move || writer_io.writer_loop(recv, queue_depth))?;
+            Some(send)
+        } else {
+            None
+        };
+
+        Ok(Arc::new(WritebackLog {
+            dir: dir.to_string(),
+            queue_depth,
+            space: Mutex::new(Space {
+                granule: io.granule(),
+                extents: Vec::new(),
+                unused_ids: Vec::new(),
+                holes: BTreeMap::new(),
+                holes_by_size: BTreeSet::new(),
+                end: 0,
+                live_bytes: 0,
+                compactions: 0,
+            }),
+            io,
+            queue,
+            moving: RwLock::new(()),
+        }))
+    }
+
+    /// Whether this is the log a core configured like so would write to
+    pub fn matches(&self, dir: &str, queue_depth: usize, direct: bool) -> bool {
+        // a file system without O_DIRECT would only fall back to buffered I/O again
+        self.dir == dir && self.queue_depth == queue_depth && (self.io.direct || !direct)
+    }
+
+    pub fn allocate(&self, len: usize) -> ExtentId {
+        let space = &mut *self.space.lock().unwrap();
+        let capacity = std::cmp::max(1, len as u64).div_ceil(space.granule) * space.granule;
+        let offset = space.take_space(capacity);
+        space.live_bytes += capacity;
+        let extent = Some(Extent {
+            offset,
+            capacity,
+            refs: 1,
+        });
+        let id = match space.unused_ids.pop() {
+            Some(id) => {
+                space.extents[id] = extent;
+                id
+            }
+            None => {
+                space.extents.push(extent);
+                space.extents.len() - 1
+            }
+        };
+        trace!(target: "ufo_object", "log extent {} at {} ({}b)", id, offset, capacity);
+        ExtentId(id)
+    }
+
+    pub fn capacity(&self, id: ExtentId) -> usize {
+        self.space.lock().unwrap().extent(id).capacity as usize
+    }
+
+    /// Another holder for the extent, it is only given back once every holder freed it
+    pub fn share(&self, id: ExtentId) {
+        let space = &mut *self.space.lock().unwrap();
+        space.extents[id.0].as_mut().expect("extent already freed").refs += 1;
+    }
+
+    /// Whether more than one UFO holds the extent, it must not be written over then
+    pub fn is_shared(&self, id: ExtentId) -> bool {
+        self.space.lock().unwrap().extent(id).refs > 1
+    }
+
+    pub fn free(&self, id: ExtentId) {
+        {
+            let space = &mut *self.space.lock().unwrap();
+            let extent = space.extents[id.0].as_mut().expect("extent already freed");
+            if extent.refs > 1 {
+                extent.refs -= 1;
+                return;
+            }
+        }
+        // a write still queued for the extent is skipped
+        self.io.pending.lock().unwrap().by_extent.remove(&id.0);
+
+        let space = &mut *self.space.lock().unwrap();
+        let extent = space.extent(id);
+        space.extents[id.0] = None;
+        space.unused_ids.push(id.0);
+        space.live_bytes -= extent.capacity;
+        if extent.capacity >= MIN_PUNCH_BYTES {
+            // give the disk space back now, before anyone else can be handed the hole
+            let r = unsafe {
+                libc::fallocate64(
+                    self.io.file.as_fd(),
+                    libc::FALLOC_FL_PUNCH_HOLE | libc::FALLOC_FL_KEEP_SIZE,
+                    extent.offset as i64,
+                    extent.capacity as i64,
+                )
+            };
+            if r != 0 {
+                trace!(target: "ufo_object", "cannot punch holes: {}", std::io::Error::last_os_error());
+            }
+        }
+        space.add_hole(extent.offset, extent.capacity);
+    }
+
+    pub fn write(&self, id: ExtentId, data: &[u8]) -> Result<()> {
+        let _moving = self.moving.read().unwrap();
+        let extent = self.space.lock().unwrap().extent(id);
+        anyhow::ensure!(data.len() as u64 <= extent.capacity, "extent too small");
+
+        let queue = match &self.queue {
+            Some(queue) => queue,
+            None => {
+                if self.io.direct {
+                    write_all_at(&self.io.file, &self.io.io_buf(data), extent.offset)?;
+                } else {
+                    write_all_at(&self.io.file, data, extent.offset)?;
+                }
+                let pending = &mut *self.io.pending.lock().unwrap();
+                pending.writes += 1;
+                pending.submissions += 1;
+                return Ok(());
+            }
+        };
+
+        let data = Arc::new(self.io.io_buf(data));
+        {
+            let pending = &mut *self.io.pending.lock().unwrap();
+            if let Some(e) = pending.failed.take() {
+                return Err(e.into());
+            }
+            pending.by_extent.insert(id.0, data.clone());
+            pending.queued += 1;
+        }
+        // blocks while the queue is full, compaction waits for us to be done
+        queue
+            .send(QueuedWrite {
+                extent: id.0,
+                offset: extent.offset,
+                data,
+            })
+            .map_err(|_| anyhow::anyhow!("writeback log closed"))
+    }
+
+    pub fn read(&self, id: ExtentId, out: &mut [u8]) -> Result<()> {
+        let _moving = self.moving.read().unwrap();
+        let queued = self.io.pending.lock().unwrap().by_extent.get(&id.0).cloned();
+        if let Some(data) = queued {
+            anyhow::ensure!(out.len() <= data.len(), "read past the written data");
+            out.copy_from_slice(&data[0..out.len()]);
+            return Ok(());
+        }
+
+        let extent = self.space.lock().unwrap().extent(id);
+        anyhow::ensure!(out.len() as u64 <= extent.capacity, "read past the extent");
+        self.io.read(out, extent.offset)
+    }
+
+    /// Wait for every queued write to reach the file
+    fn drain(&self) {
+        let mut pending = self.io.pending.lock().unwrap();
+        while pending.queued > 0 {
+            pending = self.io.drained.wait(pending).unwrap();
+        }
+    }
+
+    /// Squeeze out the holes once they take up more of the file than the live extents do
+    pub fn compact(&self) -> Result<()> {
+        let _moving = self.moving.write().unwrap();
+        {
+            let space = self.space.lock().unwrap();
+            let garbage = space.end - space.live_bytes;
+            if garbage == 0 {
+                return Ok(());
+            }
+            // with nothing live left it is only a truncate, always worth it
+            if space.live_bytes > 0 && garbage < std::cmp::max(space.live_bytes, MIN_COMPACTION_BYTES) {
+                return Ok(());
+            }
+        }
+        // nothing new is queued while we hold `moving`, the queued writes still have the old offsets
+        self.drain();
+
+        let space = &mut *self.space.lock().unwrap();
+        debug!(target: "ufo_object", "compacting writeback log, {} live of {}", space.live_bytes, space.end);
+
+        let mut live: Vec<usize> = (0..space.extents.len())
+            .filter(|id| space.extents[*id].is_some())
+            .collect();
+        live.sort_by_key(|id| space.extents[*id].unwrap().offset);
+
+        let mut cursor = 0;
+        for id in live {
+            let extent = space.extents[id].as_mut().unwrap();
+            if extent.offset != cursor {
+                // always moving down, reading the whole extent first makes overlaps harmless. The
+                // tail of an extent may never have been written, read_at leaves it zeroed
+                let mut buffer = IoBuf::zeroed(extent.capacity as usize);
+                read_at(&self.io.file, &mut buffer, extent.offset)?;
+                write_all_at(&self.io.file, &buffer, cursor)?;
+                extent.offset = cursor;
+            }
+            cursor += extent.capacity;
+        }
+
+        space.holes.clear();
+        space.holes_by_size.clear();
+        space.end = cursor;
+        space.compactions += 1;
+        check_return_zero(unsafe { libc::ftruncate64(self.io.file.as_fd(), cursor as i64) })?;
+        Ok(())
+    }
+
+    pub fn stats(&self) -> WritebackLogStats {
+        // never hold both, free takes them the other way around
+        let (writes, submissions, queued) = {
+            let pending = self.io.pending.lock().unwrap();
+            (pending.writes, pending.submissions, pending.queued as u64)
+        };
+        let space = self.space.lock().unwrap();
+        WritebackLogStats {
+            file_bytes: space.end,
+            live_bytes: space.live_bytes,
+            compactions: space.compactions,
+            writes,
+            submissions,
+            queued,
+        }
+    }
+}
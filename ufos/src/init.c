@@ -8,7 +8,19 @@ static const R_CallMethodDef CallEntries[] __attribute__ ((unused)) = {
     // Start up and shutdown the system.
     {"ufo_initialize", (DL_FUNC) &ufo_initialize, 0},
     {"ufo_shutdown", (DL_FUNC) &ufo_shutdown, 0},
+    {"ufo_configure", (DL_FUNC) &ufo_configure, 17},
 	{"is_ufo", (DL_FUNC) &is_ufo, 1},
+	{"ufo_vector_prefetch", (DL_FUNC) &ufo_vector_prefetch, 4},
+	{"ufo_vector_prefetch_wait", (DL_FUNC) &ufo_vector_prefetch_wait, 1},
+	{"ufo_vector_budget", (DL_FUNC) &ufo_vector_budget, 2},
+	{"ufo_vector_set_budget", (DL_FUNC) &ufo_vector_set_budget, 2},
+	{"ufo_vector_budget_used", (DL_FUNC) &ufo_vector_budget_used, 1},
+	{"ufo_vector_stats", (DL_FUNC) &ufo_vector_stats, 1},
+	{"ufo_reset_stats", (DL_FUNC) &ufo_reset_stats, 0},
+	{"ufo_vector_checkpoint", (DL_FUNC) &ufo_vector_checkpoint, 2},
+	{"ufo_vector_open_persistent", (DL_FUNC) &ufo_vector_open_persistent, 1},
+	{"ufo_vector_flush", (DL_FUNC) &ufo_vector_flush, 1},
+	{"ufo_vector_clone", (DL_FUNC) &ufo_vector_clone, 1},
 
     // Terminates the function list. Necessary.
     {NULL, NULL, 0} 
@@ -19,4 +31,5 @@ static const R_CallMethodDef CallEntries[] __attribute__ ((unused)) = {
 void attribute_visible R_init_ufos(DllInfo *dll) {
     R_RegisterCCallable("ufos", "ufo_new", (DL_FUNC) &ufo_new);
     R_RegisterCCallable("ufos", "ufo_new_multidim", (DL_FUNC) &ufo_new_multidim);
+    R_RegisterCCallable("ufos", "ufo_new_vectors", (DL_FUNC) &ufo_new_vectors);
 }
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <printf.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ufos_c.h"
+#include "../unstdLib/errors.h"
+
+// Many threads faulting on small chunks at the same time, each fault is its own chunk so this
+// measures how quickly the core drains and answers page faults
+
+#define CHUNK_ELEMENTS 512 // one 4k page of uint64_t per chunk
+
+int testpopulate(void* userData, uint64_t startValueIdx, uint64_t endValueIdx, unsigned char* target){
+  uint64_t* t = (uint64_t*) target;
+  uint64_t* requestCt = (uint64_t*) userData;
+  UNUSED(requestCt);
+  assert(endValueIdx <= *requestCt);
+  for(uint64_t i = startValueIdx; i < endValueIdx; i++)
+    t[i - startValueIdx] = i;
+
+  return 0;
+}
+
+static inline uint64_t getns(void){
+  struct timespec ts;
+  int ret = clock_gettime(CLOCK_MONOTONIC, &ts);
+  UNUSED(ret);
+  assert(ret == 0);
+  return (((uint64_t)ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+typedef struct {
+  uint64_t* ptr;
+  uint64_t  chunks;
+  uint64_t  threadIdx;
+  uint64_t  threadCt;
+  uint64_t  sum;
+} StormArgs;
+
+static void* storm(void* a){
+  StormArgs* args = (StormArgs*) a;
+  uint64_t sum = 0;
+  // interleave the threads so neighbouring chunks are faulted at about the same time
+  for(uint64_t c = args->threadIdx; c < args->chunks; c += args->threadCt)
+    sum += args->ptr[c * CHUNK_ELEMENTS];
+  args->sum = sum;
+  return NULL;
+}
+
+// Fault in every chunk of a fresh UFO on a fresh core, returns the rate in faults/s or a negative number on a bad sum
+static double runStorm(uint64_t threadCt, uint64_t batchSize, uint64_t chunks, uint64_t maxWorkers){
+  UfoCoreParameters params = ufo_default_core_parameters();
+  params.low_water_mark  = 256l*1024*1024;
+  params.high_water_mark = 512l*1024*1024;
+  params.fault_batch_size = batchSize;
+  params.max_workers = maxWorkers;
+  UfoCore ufoCore = ufo_new_core_with_parameters(&params);
+
+  UfoPrototype prototype = ufo_new_prototype(0, sizeof(uint64_t), CHUNK_ELEMENTS, true);
+
+  uint64_t ct = chunks * CHUNK_ELEMENTS;
+  UfoObj o = ufo_new_with_prototype(&ufoCore, &prototype, ct, NULL, &ct, testpopulate);
+  uint64_t* ptr = (uint64_t*) ufo_body_ptr(&o);
+
+  pthread_t threads[threadCt];
+  StormArgs args[threadCt];
+
+  uint64_t start = getns();
+  for(uint64_t i = 0; i < threadCt; i++){
+    args[i] = (StormArgs) { .ptr = ptr, .chunks = chunks, .threadIdx = i, .threadCt = threadCt, .sum = 0 };
+    int ret = pthread_create(&threads[i], NULL, storm, &args[i]);
+    UNUSED(ret);
+    assert(ret == 0);
+  }
+  uint64_t sum = 0;
+  for(uint64_t i = 0; i < threadCt; i++){
+    pthread_join(threads[i], NULL);
+    sum += args[i].sum;
+  }
+  uint64_t dur = getns() - start;
+
+  uint64_t expected = CHUNK_ELEMENTS * (chunks * (chunks - 1) / 2);
+  if(sum != expected)
+    fprintf(stderr, "bad sum %lu != %lu\n", sum, expected);
+
+  double rate = chunks / (dur / 1e9);
+  UfoWorkerStats workers = ufo_core_worker_stats(&ufoCore);
+  fprintf(stdout, "threads %lu batch %lu: %lu faults in %lu ns, %.0f faults/s, %u populate workers at most\n",
+    threadCt, batchSize, chunks, dur, rate, workers.populate.peak_running);
+
+  ufo_free(o);
+  ufo_free_prototype(prototype);
+  ufo_core_shutdown(ufoCore);
+
+  return sum == expected ? rate : -1;
+}
+
+// ufoFaultStorm [threads] [batch size] [chunks] [max workers]
+// With no batch size (or 0) the storm runs once one fault at a time and once with the default batch
+int main(int argc, char **argv) {
+  uint64_t threadCt  = argc > 1 ? strtoull(argv[1], NULL, 10) : 8;
+  uint64_t batchSize = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+  uint64_t chunks    = argc > 3 ? strtoull(argv[3], NULL, 10) : 64*1024;
+  uint64_t maxWorkers = argc > 4 ? strtoull(argv[4], NULL, 10) : 0;
+
+  if(batchSize > 0)
+    exit(runStorm(threadCt, batchSize, chunks, maxWorkers) >= 0 ? 0 : 1);
+
+  uint64_t defaultBatch = ufo_default_core_parameters().fault_batch_size;
+  double single  = runStorm(threadCt, 1, chunks, maxWorkers);
+  double batched = runStorm(threadCt, defaultBatch, chunks, maxWorkers);
+  if(single < 0 || batched < 0)
+    exit(1);
+
+  fprintf(stdout, "batch 1: %.0f faults/s, batch %lu: %.0f faults/s, %.2fx\n",
+    single, defaultBatch, batched, batched / single);
+  exit(0);
+}
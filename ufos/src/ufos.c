@@ -1,5 +1,9 @@
 #define USE_RINTERNALS
 
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <R.h>
 #include <Rinternals.h>
 #include <R_ext/Rallocators.h>
@@ -14,6 +18,12 @@
 UfoCore __ufo_system;
 int __framework_initialized = 0;
 
+// What the core is running with, ufo_configure changes it piecemeal
+UfoCoreParameters __ufo_parameters;
+char __ufo_writeback_dir[PATH_MAX] = "/tmp/";
+// Vectors of up to this many bytes are ordinary R vectors populated straight away, 0 for none
+size_t __ufo_eager_max_bytes = 0;
+
 typedef SEXP (*__ufo_specific_vector_constructor)(ufo_source_t*);
 
 SEXP ufo_shutdown() {
@@ -31,10 +41,10 @@ SEXP ufo_initialize() {
 
     // ufo_begin_log(); // very verbose rust logging
 
-        // Actual initialization
-        size_t high = 2l * 1024 * 1024 * 1024;
-        size_t low = 1l * 1024 * 1024 * 1024;
-        __ufo_system = ufo_new_core("/tmp/", high, low);
+        // Actual initialization, the watermarks are sized to the memory we can get
+        __ufo_parameters = ufo_system_core_parameters();
+        __ufo_parameters.writeback_temp_path = __ufo_writeback_dir;
+        __ufo_system = ufo_new_core_with_parameters(&__ufo_parameters);
         if (ufo_core_is_error(&__ufo_system)) {
             Rf_error("Error initializing the UFO framework");
         }
@@ -42,6 +52,170 @@ SEXP ufo_initialize() {
     return R_NilValue;
 }
 
+static size_t __bytes_or_die(SEXP value, const char* name) {
+    double bytes = asReal(value);
+    if (ISNAN(bytes) || bytes < 0) {
+        Rf_error("%s must be a non-negative number", name);
+    }
+    return (size_t) bytes;
+}
+
+static const char* __eviction_policy_names[] = { "fifo", "clock", "cost-aware" };
+
+static UfoEvictionPolicy __eviction_policy_or_die(SEXP policy) {
+    if (!isString(policy) || LENGTH(policy) != 1) {
+        Rf_error("eviction_policy must be one of \"fifo\", \"clock\" or \"cost-aware\"");
+    }
+    const char* name = CHAR(STRING_ELT(policy, 0));
+    if (strcmp(name, "fifo") == 0)       return UfoEvictFifo;
+    if (strcmp(name, "clock") == 0)      return UfoEvictClock;
+    if (strcmp(name, "cost-aware") == 0) return UfoEvictCostAware;
+    Rf_error("Unknown eviction policy: %s", name);
+}
+
+static const char* __compression_names[] = { "none", "lz4", "zstd" };
+
+static UfoWritebackCompression __compression_or_die(SEXP compression) {
+    if (!isString(compression) || LENGTH(compression) != 1) {
+        Rf_error("compression must be one of \"none\", \"lz4\" or \"zstd\"");
+    }
+    const char* name = CHAR(STRING_ELT(compression, 0));
+    if (strcmp(name, "none") == 0) return UfoCompressNone;
+    if (strcmp(name, "lz4") == 0)  return UfoCompressLz4;
+    if (strcmp(name, "zstd") == 0) return UfoCompressZstd;
+    Rf_error("Unknown compression: %s", name);
+}
+
+static SEXP __configuration() {
+    const char* names[] = {
+        "high", "low", "background", "writeback_dir", "max_workers",
+        "readahead_depth", "readahead_max_bytes", "fault_batch_size", "eviction_policy",
+        "compression", "compression_level", "writeback_queue_depth", "direct_io",
+        "huge_page_min_bytes", "shared_memory", "arena_bytes", "eager_max_bytes", ""
+    };
+    SEXP/*VECSXP*/ config = PROTECT(mkNamed(VECSXP, names));
+
+    UfoCoreParameters *p = &__ufo_parameters;
+    size_t background = p->background_water_mark != 0
+        ? p->background_water_mark
+        : p->low_water_mark + (p->high_water_mark - p->low_water_mark) / 2;
+
+    SET_VECTOR_ELT(config, 0, ScalarReal((double) p->high_water_mark));
+    SET_VECTOR_ELT(config, 1, ScalarReal((double) p->low_water_mark));
+    SET_VECTOR_ELT(config, 2, ScalarReal((double) background));
+    SET_VECTOR_ELT(config, 3, mkString(__ufo_writeback_dir));
+    SET_VECTOR_ELT(config, 4, ScalarReal((double) p->max_workers));
+    SET_VECTOR_ELT(config, 5, ScalarReal((double) p->readahead_depth));
+    SET_VECTOR_ELT(config, 6, ScalarReal((double) p->readahead_max_bytes));
+    SET_VECTOR_ELT(config, 7, ScalarReal((double) p->fault_batch_size));
+    SET_VECTOR_ELT(config, 8, mkString(__eviction_policy_names[p->eviction_policy]));
+    SET_VECTOR_ELT(config, 9, mkString(__compression_names[p->writeback_compression]));
+    SET_VECTOR_ELT(config, 10, ScalarInteger(p->writeback_compression_level));
+    SET_VECTOR_ELT(config, 11, ScalarReal((double) p->writeback_queue_depth));
+    SET_VECTOR_ELT(config, 12, ScalarLogical(p->writeback_direct_io));
+    SET_VECTOR_ELT(config, 13, ScalarReal((double) p->huge_page_min_bytes));
+    SET_VECTOR_ELT(config, 14, ScalarLogical(p->shared_memory));
+    SET_VECTOR_ELT(config, 15, ScalarReal((double) p->arena_bytes));
+    SET_VECTOR_ELT(config, 16, ScalarReal((double) __ufo_eager_max_bytes));
+
+    UNPROTECT(1);
+    return config;
+}
+
+SEXP ufo_configure(SEXP high, SEXP low, SEXP background, SEXP writeback_dir, SEXP max_workers,
+                   SEXP readahead_depth, SEXP readahead_max_bytes, SEXP fault_batch_size,
+                   SEXP eviction_policy, SEXP compression, SEXP compression_level,
+                   SEXP writeback_queue_depth, SEXP direct_io, SEXP huge_page_min_bytes,
+                   SEXP shared_memory, SEXP arena_bytes, SEXP eager_max_bytes) {
+    if (!__framework_initialized) {
+        Rf_error("The UFO framework is not running");
+    }
+
+    // NULL keeps the current setting
+    UfoCoreParameters parameters = __ufo_parameters;
+    if (high != R_NilValue)                parameters.high_water_mark = __bytes_or_die(high, "high");
+    if (low != R_NilValue)                 parameters.low_water_mark = __bytes_or_die(low, "low");
+    if (background != R_NilValue)          parameters.background_water_mark = __bytes_or_die(background, "background");
+    if (max_workers != R_NilValue)         parameters.max_workers = __bytes_or_die(max_workers, "max_workers");
+    if (readahead_depth != R_NilValue)     parameters.readahead_depth = __bytes_or_die(readahead_depth, "readahead_depth");
+    if (readahead_max_bytes != R_NilValue) parameters.readahead_max_bytes = __bytes_or_die(readahead_max_bytes, "readahead_max_bytes");
+    if (fault_batch_size != R_NilValue)    parameters.fault_batch_size = __bytes_or_die(fault_batch_size, "fault_batch_size");
+    if (eviction_policy != R_NilValue)     parameters.eviction_policy = __eviction_policy_or_die(eviction_policy);
+    if (compression != R_NilValue)         parameters.writeback_compression = __compression_or_die(compression);
+    if (compression_level != R_NilValue) {
+        int level = asInteger(compression_level);
+        if (level == NA_INTEGER || level < 0 || level > 22) {
+            Rf_error("compression_level must be between 0 and 22");
+        }
+        parameters.writeback_compression_level = level;
+    }
+    if (writeback_queue_depth != R_NilValue) parameters.writeback_queue_depth = __bytes_or_die(writeback_queue_depth, "writeback_queue_depth");
+    if (direct_io != R_NilValue) {
+        int direct = asLogical(direct_io);
+        if (direct == NA_LOGICAL) {
+            Rf_error("direct_io must be TRUE or FALSE");
+        }
+        parameters.writeback_direct_io = direct;
+    }
+    if (huge_page_min_bytes != R_NilValue) parameters.huge_page_min_bytes = __bytes_or_die(huge_page_min_bytes, "huge_page_min_bytes");
+    if (shared_memory != R_NilValue) {
+        int shared = asLogical(shared_memory);
+        if (shared == NA_LOGICAL) {
+            Rf_error("shared_memory must be TRUE or FALSE");
+        }
+        parameters.shared_memory = shared;
+    }
+    if (arena_bytes != R_NilValue) parameters.arena_bytes = __bytes_or_die(arena_bytes, "arena_bytes");
+    size_t eager = __ufo_eager_max_bytes;
+    if (eager_max_bytes != R_NilValue) eager = __bytes_or_die(eager_max_bytes, "eager_max_bytes");
+
+    if (parameters.low_water_mark >= parameters.high_water_mark) {
+        Rf_error("The low watermark must be below the high watermark");
+    }
+    if (parameters.fault_batch_size == 0) {
+        Rf_error("fault_batch_size must be at least 1");
+    }
+    // a full batch of page sized chunks has to fit between the watermarks, the core also checks the
+    // chunks of the UFOs already allocated
+    if (parameters.high_water_mark - parameters.low_water_mark
+        <= parameters.fault_batch_size * (size_t) sysconf(_SC_PAGESIZE)) {
+        Rf_error("The watermarks must be more than fault_batch_size pages apart");
+    }
+    if (parameters.background_water_mark != 0
+        && (parameters.background_water_mark < parameters.low_water_mark
+            || parameters.background_water_mark > parameters.high_water_mark)) {
+        Rf_error("The background watermark must be between the low and high watermarks");
+    }
+
+    char writeback[PATH_MAX];
+    strcpy(writeback, __ufo_writeback_dir);
+    if (writeback_dir != R_NilValue) {
+        if (!isString(writeback_dir) || LENGTH(writeback_dir) != 1) {
+            Rf_error("writeback_dir must be a single path");
+        }
+        const char* dir = CHAR(STRING_ELT(writeback_dir, 0));
+        if (strlen(dir) >= PATH_MAX) {
+            Rf_error("writeback_dir is too long");
+        }
+        // otherwise we only find out when the next UFO is allocated
+        if (access(dir, W_OK) != 0) {
+            Rf_error("Cannot write to %s", dir);
+        }
+        strcpy(writeback, dir);
+    }
+    parameters.writeback_temp_path = writeback;
+
+    if (ufo_core_reconfigure(&__ufo_system, &parameters) != 0) {
+        Rf_error("Could not reconfigure the UFO framework, are the watermarks too close for the chunks of the UFOs in use?");
+    }
+
+    __ufo_parameters = parameters;
+    strcpy(__ufo_writeback_dir, writeback);
+    __ufo_parameters.writeback_temp_path = __ufo_writeback_dir;
+    __ufo_eager_max_bytes = eager;
+    return __configuration();
+}
+
 void __validate_status_or_die (int status) {
     switch(status) {
         case 0: return;
@@ -65,6 +239,80 @@ uint32_t __get_stride_from_type_or_die(ufo_vector_type_t type) {
     }
 }
 
+// Prototypes for the layouts vectors are made with, UFOs of the same element type, chunk size and
+// mutability share one. Prototypes do not depend on the core, they outlive its restarts. There are
+// a handful of layouts in practice and a batch may hold copies of any of them, so none are freed
+typedef struct __ufo_prototype {
+    ufo_vector_type_t       type;
+    int32_t                 min_load_count;
+    bool                    read_only;
+    UfoPrototype            prototype;
+    struct __ufo_prototype* next;
+} __ufo_prototype_t;
+
+static __ufo_prototype_t* __ufo_prototypes = NULL;
+
+static UfoPrototype* __ufo_prototype_for(ufo_source_t* source) {
+    for (__ufo_prototype_t* known = __ufo_prototypes; known != NULL; known = known->next) {
+        if (known->type == source->vector_type
+            && known->min_load_count == source->min_load_count
+            && known->read_only == source->read_only) {
+            return &known->prototype;
+        }
+    }
+
+    __ufo_prototype_t* known = (__ufo_prototype_t*) malloc(sizeof(__ufo_prototype_t));
+    if (known == NULL) {
+        Rf_error("Cannot allocate a UFO prototype");
+    }
+    known->prototype = ufo_new_prototype(
+        sizeof(SEXPREC_ALIGN) + sizeof(R_allocator_t),
+        __get_stride_from_type_or_die(source->vector_type),
+        source->min_load_count,
+        source->read_only
+    );
+    if (ufo_prototype_is_error(&known->prototype)) {
+        free(known);
+        Rf_error("Could not create UFO prototype");
+    }
+    known->type = source->vector_type;
+    known->min_load_count = source->min_load_count;
+    known->read_only = source->read_only;
+    known->next = __ufo_prototypes;
+    __ufo_prototypes = known;
+    return &known->prototype;
+}
+
+// A UFO made by ufo_new_vectors ahead of its vector, taken by the __ufo_alloc for its source
+static struct {
+    ufo_source_t* source;
+    UfoObj        object;
+} __ufo_preallocated = { .source = NULL };
+
+// Hand the parts of the source the core takes separately to a new UFO, frees it on failure
+static void __ufo_set_up_or_die(UfoObj* object, ufo_source_t* source) {
+    // set before anything can be evicted, changes go straight back to the source
+    if (source->writeback_function != NULL
+        && ufo_set_write_through(object, source->data, source->writeback_function) != 0) {
+        ufo_free(*object);
+        Rf_error("Could not create UFO writing through to its source");
+    }
+    if (source->fill_function != NULL
+        && ufo_set_fill(object, source->data, source->fill_function) != 0) {
+        ufo_free(*object);
+        Rf_error("Could not create UFO");
+    }
+    if (source->parallel_populate && ufo_set_parallel_populate(object, true) != 0) {
+        ufo_free(*object);
+        Rf_error("Could not create UFO");
+    }
+    if (source->read_from_file
+        && ufo_set_file_source(object, source->file_descriptor, source->file_offset) != 0) {
+        ufo_free(*object);
+        Rf_error("Could not create UFO reading from its file");
+    }
+}
+
 void* __ufo_alloc(R_allocator_t *allocator, size_t size) {
     ufo_source_t* source = (ufo_source_t*) allocator->data;
 
@@ -75,22 +323,27 @@ void* __ufo_alloc(R_allocator_t *allocator, size_t size) {
     		  "Sizes don't match at ufo_alloc (%li vs expected %li).", size - sexp_header_size - sexp_metadata_size,
 			  	  	  	  	  	  	  	  	  	  	  	  	  	  	   source->vector_size *  source->element_size);
 
-    UfoObj object = ufo_new_no_prototype(
-        &__ufo_system,
-        sexp_header_size + sexp_metadata_size,
-        __get_stride_from_type_or_die(source->vector_type),
-        source->min_load_count,
-        source->read_only,
-        source->vector_size,
-        source->data, // populate data
-        source->population_function
-    );
-
+    UfoObj object;
+    if (__ufo_preallocated.source == source) {
+        object = __ufo_preallocated.object;
+        __ufo_preallocated.source = NULL;
+    } else {
+        object = ufo_new_with_prototype(
+            &__ufo_system,
+            __ufo_prototype_for(source),
+            source->vector_size,
+            NULL, // budgets are set on the finished vector, see ufo_set_budget
+            source->data, // populate data
+            source->population_function
+        );
+    }
 
     if (ufo_is_error(&object)) {
         Rf_error("Could not create UFO");
     }
 
+    __ufo_set_up_or_die(&object, source);
+
     return ufo_header_ptr(&object);
 }
 
@@ -99,6 +352,47 @@ void free_error(void *ptr){
     //TODO: die loudly?
 }
 
+// Source data populating a UFO and its clones, destroyed along with the last of them. Data no
+// clone was made from is not in the list, its UFO is the only one using it
+typedef struct __shared_source_data {
+    void*                        data;
+    int                          references;
+    struct __shared_source_data* next;
+} __shared_source_data_t;
+
+static __shared_source_data_t* __shared_source_data = NULL;
+
+static void __share_source_data(void* data) {
+    for (__shared_source_data_t* shared = __shared_source_data; shared != NULL; shared = shared->next) {
+        if (shared->data == data) {
+            shared->references++;
+            return;
+        }
+    }
+    __shared_source_data_t* shared = (__shared_source_data_t*) malloc(sizeof(__shared_source_data_t));
+    shared->data = data;
+    shared->references = 2; // the parent and its first clone
+    shared->next = __shared_source_data;
+    __shared_source_data = shared;
+}
+
+// Whether the UFO letting go of the data was the last one using it
+static bool __release_source_data(void* data) {
+    for (__shared_source_data_t** link = &__shared_source_data; *link != NULL; link = &(*link)->next) {
+        __shared_source_data_t* shared = *link;
+        if (shared->data != data) {
+            continue;
+        }
+        if (--shared->references > 0) {
+            return false;
+        }
+        *link = shared->next;
+        free(shared);
+        return true;
+    }
+    return true;
+}
+
 void __ufo_free(R_allocator_t *allocator, void *ptr) {
     UfoObj object = ufo_get_by_address(&__ufo_system, ptr);
     if (ufo_is_error(&object)) {
@@ -106,8 +400,11 @@ void __ufo_free(R_allocator_t *allocator, void *ptr) {
         return;
     }
     ufo_source_t* source = (ufo_source_t*) allocator->data;
-    source->destructor_function(source->data);
+    // freeing writes the last changes through to the source, it has to be there still
     ufo_free(object);
+    if (__release_source_data(source->data)) {
+        source->destructor_function(source->data);
+    }
     if (source->dimensions != NULL) {
         free(source->dimensions);
     }
@@ -153,7 +450,186 @@ void __prepopulate_scalar(SEXP scalar, ufo_source_t* source) {
     source->population_function(source->data, 0, source->vector_size, DATAPTR(scalar));
 }
 
+// An eager vector is an ordinary R vector in a block of our own, which keeps its source so that
+// the UFO entry points can answer for it: resetting populates it again, saving writes it out
+typedef struct {
+    ufo_source_t* source;
+    UfoPrototype* prototype; // of a UFO made to save the vector, NULL until it is saved
+    char*         path;      // where ufo_checkpoint(x, path) saved it, NULL until then
+} __ufo_eager_t;
+
+static int __ufo_eager_save(__ufo_eager_t* eager, const void* body, const char* path);
+
+// The blocks of the eager vectors alive, open addressing keyed by address. A vector's block is
+// taken out as it is freed, before its address can be reused
+#define __EAGER_TOMBSTONE ((void*) 1)
+static void** __eager_blocks = NULL;
+static size_t __eager_capacity = 0; // a power of two
+static size_t __eager_used = 0;     // live blocks and tombstones
+static size_t __eager_live = 0;
+
+static size_t __eager_slot(void* block) {
+    return (size_t) ((((uintptr_t) block >> 4) * 0x9E3779B97F4A7C15ull) & (__eager_capacity - 1));
+}
+
+static bool __eager_blocks_grow() {
+    size_t capacity = 64;
+    while (capacity < __eager_live * 4) {
+        capacity *= 2;
+    }
+    void** blocks = (void**) calloc(capacity, sizeof(void*));
+    if (blocks == NULL) {
+        return false;
+    }
+    void** old = __eager_blocks;
+    size_t old_capacity = __eager_capacity;
+    __eager_blocks = blocks;
+    __eager_capacity = capacity;
+    __eager_used = __eager_live;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i] != NULL && old[i] != __EAGER_TOMBSTONE) {
+            size_t slot = __eager_slot(old[i]);
+            while (blocks[slot] != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            blocks[slot] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+static bool __eager_blocks_add(void* block) {
+    if ((__eager_used + 1) * 2 > __eager_capacity && !__eager_blocks_grow()) {
+        return false;
+    }
+    size_t slot = __eager_slot(block);
+    while (__eager_blocks[slot] != NULL && __eager_blocks[slot] != __EAGER_TOMBSTONE) {
+        slot = (slot + 1) & (__eager_capacity - 1);
+    }
+    if (__eager_blocks[slot] == NULL) {
+        __eager_used++;
+    }
+    __eager_blocks[slot] = block;
+    __eager_live++;
+    return true;
+}
+
+static void** __eager_blocks_find(void* block) {
+    if (__eager_capacity == 0) {
+        return NULL;
+    }
+    for (size_t slot = __eager_slot(block); __eager_blocks[slot] != NULL; slot = (slot + 1) & (__eager_capacity - 1)) {
+        if (__eager_blocks[slot] == block) {
+            return &__eager_blocks[slot];
+        }
+    }
+    return NULL;
+}
+
+// The eager vector x is, NULL for anything else. Only the address is compared until x is known
+static __ufo_eager_t* __ufo_eager_of(SEXP x) {
+    void* block = (char*) x - sizeof(R_allocator_t);
+    if (__eager_blocks_find(block) == NULL) {
+        return NULL;
+    }
+    return (__ufo_eager_t*) ((R_allocator_t*) block)->data;
+}
+
+// R returns a NULL block as an allocation error
+static void* __ufo_eager_alloc(R_allocator_t* allocator, size_t size) {
+    void* block = malloc(size);
+    if (block != NULL && !__eager_blocks_add(block)) {
+        free(block);
+        return NULL;
+    }
+    return block;
+}
+
+static void __ufo_eager_destroy(__ufo_eager_t* eager) {
+    ufo_source_t* source = eager->source;
+    source->destructor_function(source->data);
+    if (source->dimensions != NULL) {
+        free(source->dimensions);
+    }
+    free(source);
+    free(eager->path);
+    free(eager);
+}
+
+// Called by the GC, a vector saved to a file is saved once more like a UFO would be
+static void __ufo_eager_free(R_allocator_t* allocator, void* block) {
+    __ufo_eager_t* eager = (__ufo_eager_t*) allocator->data;
+    *__eager_blocks_find(block) = __EAGER_TOMBSTONE;
+    __eager_live--;
+    if (eager->path != NULL) {
+        SEXP vector = (SEXP) ((char*) block + sizeof(R_allocator_t));
+        if (__ufo_eager_save(eager, DATAPTR(vector), eager->path) != 0) {
+            fprintf(stderr, "Could not save vector to %s as it was freed\n", eager->path);
+        }
+    }
+    __ufo_eager_destroy(eager);
+    free(block);
+}
+
+static int32_t __ufo_eager_populate(__ufo_eager_t* eager, void* body) {
+    ufo_source_t* source = eager->source;
+    if (source->vector_size == 0) {
+        return 0;
+    }
+    return source->population_function(source->data, 0, source->vector_size, (unsigned char*) body);
+}
+
+// Small enough not to be worth a UFO: no mapping, no writeback file and no fault to populate it.
+// Strings, and sources writing through or read only, keep their UFO: an ordinary vector would
+// take the writes
+static bool __vector_is_eager(SEXPTYPE type, ufo_source_t* source) {
+    return __ufo_eager_max_bytes > 0
+        && source->vector_size * source->element_size <= __ufo_eager_max_bytes
+        && type != STRSXP
+        && source->writeback_function == NULL
+        && !source->read_only;
+}
+
+// The vector is populated here, on R's thread, and keeps its source until it is freed. R ignores
+// the allocator of a scalar, which is done with its source straight away
+static SEXP __ufo_new_eager(SEXPTYPE type, ufo_source_t* source) {
+    __ufo_eager_t* eager = (__ufo_eager_t*) malloc(sizeof(__ufo_eager_t));
+    if (eager == NULL) {
+        Rf_error("Cannot allocate vector");
+    }
+    *eager = (__ufo_eager_t) { .source = source, .prototype = NULL, .path = NULL };
+    // R copies the allocator into the vector's block
+    R_allocator_t allocator = {
+        .mem_alloc = &__ufo_eager_alloc,
+        .mem_free = &__ufo_eager_free,
+        .res = NULL,
+        .data = eager,
+    };
+    SEXP vector = PROTECT(source->dimensions_length == 2
+                          ? allocMatrix3(type, source->dimensions[0], source->dimensions[1], &allocator)
+                          : allocVector3(type, source->vector_size, &allocator));
+    int32_t status = __ufo_eager_populate(eager, DATAPTR(vector));
+
+    if (__ufo_eager_of(vector) == NULL) {
+        __ufo_eager_destroy(eager);
+    }
+    if (status != 0) {
+        Rf_error("Could not populate vector (%i)", status);
+    }
+    UNPROTECT(1);
+    return vector;
+}
+
 void __reset_vector(SEXP vector) {
+	 __ufo_eager_t* eager = __ufo_eager_of(vector);
+	 if (eager != NULL) {
+	     if (__ufo_eager_populate(eager, DATAPTR(vector)) != 0) {
+	         Rf_error("Could not populate vector");
+	     }
+	     return;
+	 }
+
 	 UfoObj object = ufo_get_by_address(&__ufo_system, vector);
 	 if (ufo_is_error(&object)) {
 	     Rf_error("Tried resetting a UFO, "
@@ -161,6 +637,7 @@ void __reset_vector(SEXP vector) {
 	 }
 
 	 ufo_reset(&object);
+	 ufo_drop_handle(object);
 }
 
 SEXP ufo_new(ufo_source_t* source) {
@@ -170,6 +647,10 @@ SEXP ufo_new(ufo_source_t* source) {
         Rf_error("No available vector constructor for this type.");
     }
 
+    if (__vector_is_eager(type, source)) {
+        return __ufo_new_eager(type, source);
+    }
+
     // Initialize an allocator.
     R_allocator_t* allocator = __ufo_new_allocator(source);
 
@@ -201,6 +682,10 @@ SEXP ufo_new_multidim(ufo_source_t* source) {
         Rf_error("No available vector constructor for this type.");
     }
 
+    if (__vector_is_eager(type, source)) {
+        return __ufo_new_eager(type, source);
+    }
+
     // Initialize an allocator.
     R_allocator_t* allocator = __ufo_new_allocator(source);
 
@@ -224,6 +709,606 @@ SEXP ufo_new_multidim(ufo_source_t* source) {
     return ufo;
 }
 
+// The UFOs of a batch, handed out to their vectors one by one
+typedef struct {
+    ufo_source_t** sources;
+    size_t         n;
+    UfoObj*        objects;
+    size_t*        batched; // the source each UFO was made for
+    size_t         batch_size;
+    size_t         next;    // the first UFO not handed out yet
+    SEXP           vectors;
+} __ufo_batch_t;
+
+static SEXP __ufo_hand_out_batch(void* data) {
+    __ufo_batch_t* batch = (__ufo_batch_t*) data;
+    // each vector is made as ufo_new makes it, __ufo_alloc takes the UFO made for its source
+    for (size_t i = 0; i < batch->n; i++) {
+        ufo_source_t* source = batch->sources[i];
+        if (batch->next < batch->batch_size && batch->batched[batch->next] == i) {
+            __ufo_preallocated.source = source;
+            __ufo_preallocated.object = batch->objects[batch->next++];
+        }
+        SEXP vector = source->dimensions_length == 2 ? ufo_new_multidim(source) : ufo_new(source);
+        SET_VECTOR_ELT(batch->vectors, i, vector);
+    }
+    return batch->vectors;
+}
+
+// Also run when making a vector fails part way, the UFOs no vector took are freed
+static void __ufo_release_batch(void* data) {
+    __ufo_batch_t* batch = (__ufo_batch_t*) data;
+    if (__ufo_preallocated.source != NULL) {
+        ufo_free(__ufo_preallocated.object);
+        __ufo_preallocated.source = NULL;
+    }
+    for (; batch->next < batch->batch_size; batch->next++) {
+        ufo_free(batch->objects[batch->next]);
+    }
+}
+
+SEXP ufo_new_vectors(ufo_source_t** sources, size_t n) {
+    SEXP/*VECSXP*/ vectors = PROTECT(allocVector(VECSXP, n));
+
+    // R allocates scalars itself and small vectors are not UFOs, those are left out of the batch.
+    // Released by R when this returns or fails
+    UfoPrototype* prototypes = (UfoPrototype*) R_alloc(n, sizeof(UfoPrototype));
+    size_t* cts = (size_t*) R_alloc(n, sizeof(size_t));
+    void** data = (void**) R_alloc(n, sizeof(void*));
+    UfoPopulateCallout* populates = (UfoPopulateCallout*) R_alloc(n, sizeof(UfoPopulateCallout));
+    UfoObj* objects = (UfoObj*) R_alloc(n, sizeof(UfoObj));
+    size_t* batched = (size_t*) R_alloc(n, sizeof(size_t));
+
+    size_t batch_size = 0;
+    for (size_t i = 0; i < n; i++) {
+        ufo_source_t* source = sources[i];
+        SEXPTYPE type = ufo_type_to_vector_type(source->vector_type);
+        if (__vector_will_be_scalarized(type, source->vector_size) || __vector_is_eager(type, source)) {
+            continue;
+        }
+        prototypes[batch_size] = *__ufo_prototype_for(source);
+        cts[batch_size] = source->vector_size;
+        data[batch_size] = source->data;
+        populates[batch_size] = source->population_function;
+        batched[batch_size] = i;
+        batch_size++;
+    }
+
+    // one round trip to the core for all of them
+    if (ufo_new_batch(&__ufo_system, batch_size, prototypes, cts, data, populates, objects) != 0) {
+        Rf_error("Could not create a batch of %li UFOs", batch_size);
+    }
+
+    __ufo_batch_t batch = {
+        .sources = sources,
+        .n = n,
+        .objects = objects,
+        .batched = batched,
+        .batch_size = batch_size,
+        .next = 0,
+        .vectors = vectors,
+    };
+    R_ExecWithCleanup(&__ufo_hand_out_batch, &batch, &__ufo_release_batch, &batch);
+
+    UNPROTECT(1);
+    return vectors;
+}
+
+static void __prefetch_finalizer(SEXP handle) {
+    void* ptr = R_ExternalPtrAddr(handle);
+    if (ptr != NULL) {
+        R_ClearExternalPtr(handle);
+        ufo_prefetch_free((UfoPrefetch) { .ptr = ptr });
+    }
+}
+
+SEXP ufo_vector_prefetch(SEXP x, SEXP from, SEXP to, SEXP wait) {
+    // an eager vector is all there already, its handle has nothing to wait for
+    if (__ufo_eager_of(x) != NULL) {
+        return asLogical(wait) ? x : R_MakeExternalPtr(NULL, R_NilValue, x);
+    }
+
+    UfoObj object = ufo_get_by_address(&__ufo_system, x);
+    if (ufo_is_error(&object)) {
+        Rf_error("Tried prefetching a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+
+    // R indices are 1-based and inclusive
+    double start = asReal(from) - 1;
+    double end = asReal(to);
+    if (ISNAN(start) || ISNAN(end) || start < 0 || end > XLENGTH(x) || start > end) {
+        ufo_drop_handle(object);
+        Rf_error("Prefetch range [%.0f, %.0f] is outside of the vector", start + 1, end);
+    }
+
+    bool asynchronous = !asLogical(wait);
+    UfoPrefetch prefetch = ufo_prefetch(&object, (size_t) start, (size_t) end, asynchronous);
+    ufo_drop_handle(object);
+
+    if (ufo_prefetch_is_error(&prefetch)) {
+        Rf_error("Could not prefetch UFO");
+    }
+
+    if (!asynchronous) {
+        ufo_prefetch_free(prefetch);
+        return x;
+    }
+
+    SEXP handle = PROTECT(R_MakeExternalPtr(prefetch.ptr, R_NilValue, x));
+    R_RegisterCFinalizerEx(handle, &__prefetch_finalizer, TRUE);
+    UNPROTECT(1);
+    return handle;
+}
+
+SEXP ufo_vector_prefetch_wait(SEXP handle) {
+    if (TYPEOF(handle) != EXTPTRSXP) {
+        Rf_error("Not a prefetch handle");
+    }
+    void* ptr = R_ExternalPtrAddr(handle);
+    if (ptr != NULL) {
+        R_ClearExternalPtr(handle);
+        ufo_prefetch_wait((UfoPrefetch) { .ptr = ptr });
+    }
+    return R_NilValue;
+}
+
+static void __budget_finalizer(SEXP handle) {
+    void* ptr = R_ExternalPtrAddr(handle);
+    if (ptr != NULL) {
+        R_ClearExternalPtr(handle);
+        ufo_free_budget((UfoBudget) { .ptr = ptr });
+    }
+}
+
+static UfoBudget __budget_from_handle_or_die(SEXP handle) {
+    if (TYPEOF(handle) != EXTPTRSXP || R_ExternalPtrAddr(handle) == NULL) {
+        Rf_error("Not a UFO budget");
+    }
+    return (UfoBudget) { .ptr = R_ExternalPtrAddr(handle) };
+}
+
+SEXP ufo_vector_budget(SEXP cap, SEXP reservation) {
+    double cap_bytes = asReal(cap);
+    double reservation_bytes = asReal(reservation);
+    if (ISNAN(cap_bytes) || cap_bytes <= 0 || ISNAN(reservation_bytes) || reservation_bytes < 0) {
+        Rf_error("A budget needs a positive cap and a non-negative reservation");
+    }
+
+    UfoBudget budget = ufo_new_budget((size_t) cap_bytes, (size_t) reservation_bytes);
+    if (ufo_budget_is_error(&budget)) {
+        Rf_error("Could not create UFO budget");
+    }
+
+    SEXP handle = PROTECT(R_MakeExternalPtr(budget.ptr, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(handle, &__budget_finalizer, TRUE);
+    UNPROTECT(1);
+    return handle;
+}
+
+SEXP ufo_vector_set_budget(SEXP x, SEXP budget) {
+    // check the budget first so that an error can't leave the object handle behind
+    UfoBudget handle = { .ptr = NULL };
+    if (budget != R_NilValue) {
+        handle = __budget_from_handle_or_die(budget);
+    }
+
+    // an eager vector has nothing loaded to cap
+    if (__ufo_eager_of(x) != NULL) {
+        return x;
+    }
+
+    UfoObj object = ufo_get_by_address(&__ufo_system, x);
+    if (ufo_is_error(&object)) {
+        Rf_error("Tried setting the budget of a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+
+    int result = ufo_set_budget(&object, budget == R_NilValue ? NULL : &handle);
+    ufo_drop_handle(object);
+
+    if (result != 0) {
+        Rf_error("Could not set UFO budget");
+    }
+    return x;
+}
+
+SEXP ufo_vector_budget_used(SEXP budget) {
+    UfoBudget handle = __budget_from_handle_or_die(budget);
+    return ScalarReal((double) ufo_budget_used(&handle));
+}
+
+static void __stats_row(SEXP columns, int row, const char* metric, double count, const UfoLatency* latency) {
+    SET_STRING_ELT(VECTOR_ELT(columns, 0), row, mkChar(metric));
+    REAL(VECTOR_ELT(columns, 1))[row] = count;
+    REAL(VECTOR_ELT(columns, 2))[row] = latency ? (double) latency->total_ns : NA_REAL;
+    REAL(VECTOR_ELT(columns, 3))[row] = latency && latency->count ? (double) latency->total_ns / latency->count : NA_REAL;
+    REAL(VECTOR_ELT(columns, 4))[row] = latency ? (double) latency->p50_ns : NA_REAL;
+    REAL(VECTOR_ELT(columns, 5))[row] = latency ? (double) latency->p90_ns : NA_REAL;
+    REAL(VECTOR_ELT(columns, 6))[row] = latency ? (double) latency->p99_ns : NA_REAL;
+    REAL(VECTOR_ELT(columns, 7))[row] = latency ? (double) latency->max_ns : NA_REAL;
+}
+
+// One row per counter and one per stage, the latency columns are NA for counters
+SEXP ufo_vector_stats(SEXP x) {
+    UfoStats stats;
+    __ufo_eager_t* eager = x == R_NilValue ? NULL : __ufo_eager_of(x);
+    if (x == R_NilValue) {
+        stats = ufo_core_stats(&__ufo_system);
+    } else if (eager != NULL) {
+        // never faulted, all of it resident
+        memset(&stats, 0, sizeof(UfoStats));
+        stats.resident_bytes = XLENGTH(x) * eager->source->element_size;
+    } else {
+        UfoObj object = ufo_get_by_address(&__ufo_system, x);
+        if (ufo_is_error(&object)) {
+            Rf_error("Tried reading the stats of a UFO, "
+                     "but the provided address is not a UFO header address.");
+        }
+        stats = ufo_stats(&object);
+        ufo_drop_handle(object);
+    }
+
+    const char* names[] = { "metric", "count", "total_ns", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns", "" };
+    const int rows = 19;
+    SEXP/*VECSXP*/ columns = PROTECT(mkNamed(VECSXP, names));
+    SET_VECTOR_ELT(columns, 0, allocVector(STRSXP, rows));
+    for (int i = 1; i < 8; i++) {
+        SET_VECTOR_ELT(columns, i, allocVector(REALSXP, rows));
+    }
+
+    __stats_row(columns, 0,  "faults",          (double) stats.faults,          NULL);
+    __stats_row(columns, 1,  "populate_calls",  (double) stats.populate_calls,  NULL);
+    __stats_row(columns, 2,  "readback_hits",   (double) stats.readback_hits,   NULL);
+    __stats_row(columns, 3,  "constant_chunks", (double) stats.constant_chunks, NULL);
+    __stats_row(columns, 4,  "huge_page_chunks", (double) stats.huge_page_chunks, NULL);
+    __stats_row(columns, 5,  "shared_memory_chunks", (double) stats.shared_memory_chunks, NULL);
+    __stats_row(columns, 6,  "writebacks",      (double) stats.writebacks,      NULL);
+    __stats_row(columns, 7,  "writeback_bytes", (double) stats.writeback_bytes, NULL);
+    __stats_row(columns, 8,  "writeback_stored_bytes", (double) stats.writeback_stored_bytes, NULL);
+    __stats_row(columns, 9,  "compression_ratio",      stats.compression_ratio,               NULL);
+    __stats_row(columns, 10, "freed_chunks",    (double) stats.freed_chunks,    NULL);
+    __stats_row(columns, 11, "resident_bytes",  (double) stats.resident_bytes,  NULL);
+    __stats_row(columns, 12, "load",      (double) stats.load.count,      &stats.load);
+    __stats_row(columns, 13, "populate",  (double) stats.populate.count,  &stats.populate);
+    __stats_row(columns, 14, "copy",      (double) stats.copy.count,      &stats.copy);
+    __stats_row(columns, 15, "hash",      (double) stats.hash.count,      &stats.hash);
+    __stats_row(columns, 16, "free",      (double) stats.free.count,      &stats.free);
+    __stats_row(columns, 17, "writeback", (double) stats.writeback.count, &stats.writeback);
+    __stats_row(columns, 18, "reclaim",   (double) stats.reclaim.count,   &stats.reclaim);
+
+    UNPROTECT(1);
+    return columns;
+}
+
+SEXP ufo_reset_stats() {
+    if (ufo_core_reset_stats(&__ufo_system) != 0) {
+        Rf_error("Could not reset the UFO stats");
+    }
+    return R_NilValue;
+}
+
+// Persistent files made from R vectors say so along with the type and length of the vector, and
+// what it was made from if the source says, eg. "ufos R vector integer[1000] from /data/x.bin".
+// The tag is the vector type again
+#define __PERSISTENT_IDENTITY      "ufos R vector %s[%zu]"
+#define __PERSISTENT_IDENTITY_FROM " from "
+#define __PERSISTENT_IDENTITY_BYTES 2048
+
+static void __persistent_identity(char* identity, ufo_vector_type_t type, size_t length, const char* description) {
+    int written = snprintf(identity, __PERSISTENT_IDENTITY_BYTES, __PERSISTENT_IDENTITY,
+                           type2char((SEXPTYPE) type), length);
+    if (description != NULL && written >= 0 && written < __PERSISTENT_IDENTITY_BYTES) {
+        snprintf(identity + written, __PERSISTENT_IDENTITY_BYTES - written,
+                 __PERSISTENT_IDENTITY_FROM "%s", description);
+    }
+}
+
+// What the vector in a persistent file was made from, NULL if it does not say or the file does
+// not hold the vector its type and length say
+static const char* __persistent_description(const UfoPersistentInfo* info, bool* matches) {
+    char expected[__PERSISTENT_IDENTITY_BYTES];
+    __persistent_identity(expected, (ufo_vector_type_t) info->tag, info->element_ct, NULL);
+    size_t length = strlen(expected);
+    const char* rest = info->identity + length;
+    size_t from_length = strlen(__PERSISTENT_IDENTITY_FROM);
+    *matches = strncmp(info->identity, expected, length) == 0
+        && (*rest == '\0' || strncmp(rest, __PERSISTENT_IDENTITY_FROM, from_length) == 0);
+    return *matches && *rest != '\0' ? rest + from_length : NULL;
+}
+
+static const char* __path_or_die(SEXP path) {
+    if (!isString(path) || LENGTH(path) != 1 || STRING_ELT(path, 0) == NA_STRING) {
+        Rf_error("path must be a single file name");
+    }
+    const char* name = CHAR(STRING_ELT(path, 0));
+    if (strlen(name) >= PATH_MAX) {
+        Rf_error("path is too long");
+    }
+    return name;
+}
+
+SEXP ufo_vector_checkpoint(SEXP x, SEXP path) {
+    // the file holds the elements, for strings those would be pointers into this session
+    if (TYPEOF(x) == STRSXP || TYPEOF(x) == VECSXP) {
+        Rf_error("Only atomic vectors can be saved to a persistent UFO");
+    }
+    const char* name = path == R_NilValue ? NULL : __path_or_die(path);
+
+    __ufo_eager_t* eager = __ufo_eager_of(x);
+    if (eager != NULL) {
+        const char* target = name != NULL ? name : eager->path;
+        if (target == NULL) {
+            Rf_error("Could not checkpoint UFO, was it saved to a file?");
+        }
+        if (eager->prototype == NULL) {
+            eager->prototype = __ufo_prototype_for(eager->source);
+        }
+        if (__ufo_eager_save(eager, DATAPTR(x), target) != 0) {
+            Rf_error("Could not save UFO to %s", target);
+        }
+        // saved again to the same file as it is freed
+        if (name != NULL) {
+            char* saved_path = strdup(name);
+            if (saved_path == NULL) {
+                Rf_error("Could not save UFO to %s", name);
+            }
+            free(eager->path);
+            eager->path = saved_path;
+        }
+        return x;
+    }
+
+    UfoObj object = ufo_get_by_address(&__ufo_system, x);
+    if (ufo_is_error(&object)) {
+        Rf_error("Tried checkpointing a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+
+    char identity[__PERSISTENT_IDENTITY_BYTES];
+    if (name != NULL) {
+        R_allocator_t* allocator = (R_allocator_t*) ((char*) x - sizeof(R_allocator_t));
+        ufo_source_t* source = (ufo_source_t*) allocator->data;
+        __persistent_identity(identity, (ufo_vector_type_t) TYPEOF(x), XLENGTH(x), source->description);
+    }
+    int result = name == NULL
+        ? ufo_checkpoint(&object)
+        : ufo_persist(&object, name, identity, (uint32_t) TYPEOF(x));
+    ufo_drop_handle(object);
+
+    if (result != 0 && name == NULL) {
+        Rf_error("Could not checkpoint UFO, was it saved to a file?");
+    }
+    if (result != 0) {
+        Rf_error("Could not save UFO to %s", name);
+    }
+    return x;
+}
+
+typedef struct {
+    const unsigned char* body;
+    size_t               element_size;
+} __ufo_eager_body_t;
+
+static int32_t __ufo_eager_body_populate(void* data, uintptr_t start, uintptr_t end, unsigned char* target) {
+    __ufo_eager_body_t* body = (__ufo_eager_body_t*) data;
+    memcpy(target, body->body + start * body->element_size, (end - start) * body->element_size);
+    return 0;
+}
+
+// An eager vector has no UFO to save, one populated from the vector is saved in its place. The
+// prototype is made beforehand, this also runs in the GC
+static int __ufo_eager_save(__ufo_eager_t* eager, const void* body, const char* path) {
+    ufo_source_t* source = eager->source;
+    __ufo_eager_body_t data = { .body = (const unsigned char*) body, .element_size = source->element_size };
+    UfoObj object = ufo_new_with_prototype(&__ufo_system, eager->prototype, source->vector_size,
+                                           NULL, &data, &__ufo_eager_body_populate);
+    if (ufo_is_error(&object)) {
+        return -1;
+    }
+    char identity[__PERSISTENT_IDENTITY_BYTES];
+    __persistent_identity(identity, source->vector_type, source->vector_size, source->description);
+    int result = ufo_persist(&object, path, identity, (uint32_t) source->vector_type);
+    ufo_free(object);
+    return result;
+}
+
+// A source for a vector read back from its persistent file, the file holds every chunk so the
+// populate function is never called. The source comes first so __ufo_free can free it as one
+typedef struct {
+    ufo_source_t source;
+    char         path[PATH_MAX];
+    char         identity[__PERSISTENT_IDENTITY_BYTES]; // as the file has it, the description points in here
+    size_t       elements_per_chunk;
+} ufo_persistent_source_t;
+
+static int32_t __persistent_populate(void* data, uintptr_t start, uintptr_t end, unsigned char* target) {
+    return -1;
+}
+
+static void __persistent_destroy(void* data) {}
+
+void* __ufo_persistent_alloc(R_allocator_t *allocator, size_t size) {
+    ufo_persistent_source_t* persistent = (ufo_persistent_source_t*) allocator->data;
+    ufo_source_t* source = &persistent->source;
+
+    size_t sexp_header_size = sizeof(SEXPREC_ALIGN);
+    size_t sexp_metadata_size = sizeof(R_allocator_t);
+
+    make_sure((size - sexp_header_size - sexp_metadata_size) >= (source->vector_size *  source->element_size), Rf_error,
+    		  "Sizes don't match at ufo_alloc (%li vs expected %li).", size - sexp_header_size - sexp_metadata_size,
+			  	  	  	  	  	  	  	  	  	  	  	  	  	  	   source->vector_size *  source->element_size);
+
+    UfoObj object = ufo_new_persistent(
+        &__ufo_system,
+        sexp_header_size + sexp_metadata_size,
+        source->element_size,
+        persistent->elements_per_chunk,
+        source->vector_size,
+        persistent->path,
+        persistent->identity,
+        (uint32_t) source->vector_type,
+        NULL,
+        source->population_function
+    );
+
+    if (ufo_is_error(&object)) {
+        Rf_error("Could not open persistent UFO %s", persistent->path);
+    }
+
+    return ufo_header_ptr(&object);
+}
+
+SEXP ufo_vector_open_persistent(SEXP path) {
+    const char* name = __path_or_die(path);
+
+    UfoPersistentInfo info;
+    if (ufo_persistent_info(name, &info) != 0) {
+        Rf_error("%s is not a persistent UFO", name);
+    }
+    ufo_vector_type_t type = (ufo_vector_type_t) info.tag;
+    if (type == UFO_STR || type == UFO_VEC || type == UFO_CHAR
+        || info.stride != __get_stride_from_type_or_die(type)) {
+        Rf_error("%s does not hold an R vector", name);
+    }
+    if (info.held_chunks < info.chunk_ct) {
+        Rf_error("%s is missing %li chunks, it was not saved with ufo_checkpoint(x, path)",
+                 name, info.chunk_ct - info.held_chunks);
+    }
+    // saved again under the same identity, it has to fit
+    bool matches;
+    const char* description = __persistent_description(&info, &matches);
+    if (!matches || strlen(info.identity) >= __PERSISTENT_IDENTITY_BYTES) {
+        Rf_error("%s holds %s, not the R vector its header says", name, info.identity);
+    }
+    if (__vector_will_be_scalarized(ufo_type_to_vector_type(type), info.element_ct)) {
+        Rf_error("%s holds a single element, which R does not allocate as a UFO", name);
+    }
+
+    ufo_persistent_source_t* persistent = (ufo_persistent_source_t*) malloc(sizeof(ufo_persistent_source_t));
+    persistent->source = (ufo_source_t) {
+        .data = NULL,
+        .population_function = &__persistent_populate,
+        .destructor_function = &__persistent_destroy,
+        .writeback_function = NULL,
+        .fill_function = NULL,
+        .vector_type = type,
+        .vector_size = info.element_ct,
+        .element_size = info.stride,
+        .dimensions = NULL,
+        .dimensions_length = 0,
+        .min_load_count = (int32_t) info.elements_per_chunk,
+        .read_only = false,
+        .parallel_populate = false,
+        .read_from_file = false,
+    };
+    strcpy(persistent->path, name);
+    strcpy(persistent->identity, info.identity);
+    persistent->source.description = description == NULL ? NULL
+        : persistent->identity + (description - info.identity);
+    persistent->elements_per_chunk = info.elements_per_chunk;
+
+    R_allocator_t* allocator = __ufo_new_allocator(&persistent->source);
+    allocator->mem_alloc = &__ufo_persistent_alloc;
+
+    return allocVector3(ufo_type_to_vector_type(type), info.element_ct, allocator);
+}
+
+SEXP ufo_vector_flush(SEXP x) {
+    // eager vectors never write through, there is nothing to flush
+    if (__ufo_eager_of(x) != NULL) {
+        return x;
+    }
+
+    UfoObj object = ufo_get_by_address(&__ufo_system, x);
+    if (ufo_is_error(&object)) {
+        Rf_error("Tried flushing a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+
+    int result = ufo_flush(&object);
+    ufo_drop_handle(object);
+
+    if (result != 0) {
+        Rf_error("Could not write UFO back to its source, does it write through?");
+    }
+    return x;
+}
+
+// A source for a clone, a copy of the parent's source sharing its data. The source comes first
+// so __ufo_free can free it as one
+typedef struct {
+    ufo_source_t source;
+    SEXP         parent;
+} ufo_clone_source_t;
+
+void* __ufo_clone_alloc(R_allocator_t *allocator, size_t size) {
+    ufo_clone_source_t* clone = (ufo_clone_source_t*) allocator->data;
+    ufo_source_t* source = &clone->source;
+
+    size_t sexp_header_size = sizeof(SEXPREC_ALIGN);
+    size_t sexp_metadata_size = sizeof(R_allocator_t);
+
+    make_sure((size - sexp_header_size - sexp_metadata_size) >= (source->vector_size *  source->element_size), Rf_error,
+    		  "Sizes don't match at ufo_alloc (%li vs expected %li).", size - sexp_header_size - sexp_metadata_size,
+			  	  	  	  	  	  	  	  	  	  	  	  	  	  	   source->vector_size *  source->element_size);
+
+    UfoObj parent = ufo_get_by_address(&__ufo_system, clone->parent);
+    if (ufo_is_error(&parent)) {
+        Rf_error("Tried cloning a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+    UfoObj object = ufo_clone(&__ufo_system, &parent);
+    ufo_drop_handle(parent);
+
+    if (ufo_is_error(&object)) {
+        Rf_error("Could not clone UFO, does it write through or save to a file?");
+    }
+    if (source->data != NULL) {
+        __share_source_data(source->data);
+    }
+
+    return ufo_header_ptr(&object);
+}
+
+SEXP ufo_vector_clone(SEXP x) {
+    // allocVector3 fills string vectors with blanks, which would overwrite the clone
+    if (TYPEOF(x) == STRSXP || TYPEOF(x) == VECSXP) {
+        Rf_error("Only atomic vectors can be cloned");
+    }
+    // as cheap as a clone at this size, and as separate from x
+    if (__ufo_eager_of(x) != NULL) {
+        return duplicate(x);
+    }
+    if (!ufo_address_is_ufo_object(&__ufo_system, x)) {
+        Rf_error("Tried cloning a UFO, "
+                 "but the provided address is not a UFO header address.");
+    }
+    R_allocator_t* parent_allocator = (R_allocator_t*) ((char*) x - sizeof(R_allocator_t));
+    ufo_source_t* parent_source = (ufo_source_t*) parent_allocator->data;
+
+    ufo_clone_source_t* clone = (ufo_clone_source_t*) malloc(sizeof(ufo_clone_source_t));
+    clone->source = *parent_source;
+    // changes to the clone are its own, they never reach the parent's source
+    clone->source.writeback_function = NULL;
+    clone->source.read_only = false;
+    // the parent frees its dimensions, the clone needs a copy
+    if (parent_source->dimensions != NULL) {
+        size_t bytes = sizeof(int) * parent_source->dimensions_length;
+        clone->source.dimensions = (int*) malloc(bytes);
+        memcpy(clone->source.dimensions, parent_source->dimensions, bytes);
+    }
+    clone->parent = x;
+
+    R_allocator_t* allocator = __ufo_new_allocator(&clone->source);
+    allocator->mem_alloc = &__ufo_clone_alloc;
+
+    SEXP result = PROTECT(allocVector3(TYPEOF(x), XLENGTH(x), allocator));
+    DUPLICATE_ATTRIB(result, x);
+    UNPROTECT(1);
+    return result;
+}
+
 SEXP is_ufo(SEXP x) {
 	SEXP/*LGLSXP*/ response = PROTECT(allocVector(LGLSXP, 1));
 	if(ufo_address_is_ufo_object(&__ufo_system, x)) {
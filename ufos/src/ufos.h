@@ -21,6 +21,18 @@ typedef enum {
 } ufo_vector_type_t;
 
 typedef int32_t (*UfoPopulateCallout)(void*, uintptr_t, uintptr_t, unsigned char*);
+// Writes elements start..end back to the source, called with the data of dirty chunks
+typedef int32_t (*UfoWriteThroughCallout)(void*, uintptr_t, uintptr_t, const unsigned char*);
+
+// What a fill function says elements start..end hold
+typedef enum {
+    UFO_FILL_DATA     = 0, // anything, the population function is called
+    UFO_FILL_ZERO     = 1,
+    UFO_FILL_CONSTANT = 2, // every element is the one written to the last argument
+} ufo_fill_t;
+
+// Called before populating, returns a ufo_fill_t. Never calls into R, it runs on the core's threads
+typedef int32_t (*UfoFillCallout)(void*, uintptr_t, uintptr_t, unsigned char*);
 
 // Function types for ufo_source_t
 typedef void (*ufo_destructor_t)(void*);
@@ -38,21 +50,48 @@ typedef struct {
     size_t              dimensions_length;
     int32_t             min_load_count;
     bool                read_only;
+    // Added since, sources built before them keep their layout and a zeroed source leaves them off
+    UfoWriteThroughCallout writeback_function; // NULL keeps changes in the writeback file
+    UfoFillCallout      fill_function;      // NULL populates every chunk
+    bool                parallel_populate;  // population_function is safe to call from many threads at once
+    bool                read_from_file;     // the core reads the body from file_descriptor itself
+    int                 file_descriptor;
+    size_t              file_offset;        // where the body starts in file_descriptor
+    const char*         description;        // what the data comes from, eg. its file, NULL if nothing to say
 } ufo_source_t;
 
 // Initialization and shutdown
 SEXP ufo_shutdown();
 SEXP ufo_initialize();
+SEXP ufo_configure(SEXP high, SEXP low, SEXP background, SEXP writeback_dir, SEXP max_workers,
+                   SEXP readahead_depth, SEXP readahead_max_bytes, SEXP fault_batch_size,
+                   SEXP eviction_policy, SEXP compression, SEXP compression_level,
+                   SEXP writeback_queue_depth, SEXP direct_io, SEXP huge_page_min_bytes,
+                   SEXP shared_memory, SEXP arena_bytes, SEXP eager_max_bytes);
 
 // Constructor
 SEXP ufo_new(ufo_source_t*);
 SEXP ufo_new_multidim(ufo_source_t* source);
+// One vector for each source, their UFOs allocated in one round trip to the core
+SEXP ufo_new_vectors(ufo_source_t** sources, size_t n);
 
 // Auxiliary functions.
 SEXP is_ufo(SEXP x);
+SEXP ufo_vector_prefetch(SEXP x, SEXP from, SEXP to, SEXP wait);
+SEXP ufo_vector_prefetch_wait(SEXP handle);
+SEXP ufo_vector_budget(SEXP cap, SEXP reservation);
+SEXP ufo_vector_set_budget(SEXP x, SEXP budget);
+SEXP ufo_vector_budget_used(SEXP budget);
+SEXP ufo_vector_stats(SEXP x);
+SEXP ufo_reset_stats();
+SEXP ufo_vector_checkpoint(SEXP x, SEXP path);
+SEXP ufo_vector_open_persistent(SEXP path);
+SEXP ufo_vector_flush(SEXP x);
+SEXP ufo_vector_clone(SEXP x);
 SEXPTYPE ufo_type_to_vector_type (ufo_vector_type_t);
 
 // Function types for R dynloader.
 typedef SEXP (*is_ufo_t)(SEXP);
 typedef SEXP (*ufo_new_t)(ufo_source_t*);
+typedef SEXP (*ufo_new_vectors_t)(ufo_source_t**, size_t);
 typedef SEXPTYPE (*ufo_type_to_vector_type_t)(ufo_vector_type_t);
@@ -44,6 +44,11 @@ SEXP/*INTXP*/ ufo_seq(SEXP/*INTXP*/ from, SEXP/*INTXP*/ to, SEXP/*INTXP*/ by) {
 
     source->destructor_function = &destroy_data;
     source->population_function = &populate;
+    source->writeback_function = NULL;
+    source->fill_function = NULL;
+    source->parallel_populate = false;
+    source->read_from_file = false;
+    source->description = NULL;
 
     ufo_new_t ufo_new = (ufo_new_t) R_GetCCallable("ufos", "ufo_new");
     return ufo_new(source);
@@ -8,6 +8,9 @@
 #include "../debug.h"
 
 #include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 int32_t __load_from_file(void* user_data, uintptr_t start, uintptr_t end, unsigned char* target) {
 
@@ -64,6 +67,33 @@ int32_t __load_from_file(void* user_data, uintptr_t start, uintptr_t end, unsign
     return 0;
 }
 
+int32_t __write_to_file(void* user_data, uintptr_t start, uintptr_t end, const unsigned char* data) {
+
+    ufo_file_source_data_t* cfg = (ufo_file_source_data_t*) user_data;
+
+    // no R API here, this runs on the core's threads
+    if (cfg->write_descriptor < 0) {
+        return 45;
+    }
+
+    size_t remaining = cfg->element_size * (end - start);
+    off_t offset = cfg->element_size * start;
+    while (remaining > 0) {
+        ssize_t written = pwrite(cfg->write_descriptor, data, remaining, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 45;
+        }
+        data += written;
+        offset += written;
+        remaining -= written;
+    }
+
+    return 0;
+}
+
 void __write_bytes_to_disk(const char *path, size_t size, const char *bytes) {
     //fprintf(stderr, "__write_bytes_to_disk(%s,%li,...)\n", path, size);
 
@@ -116,3 +146,11 @@ FILE *__open_file_or_die(char const *path) {
     }
     return file;
 }
+
+int __open_file_for_writing_or_die(char const *path) {
+    int descriptor = open(path, O_WRONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        Rf_error("Could not open file for writing.\n");
+    }
+    return descriptor;
+}
@@ -6,6 +6,9 @@
 /**
  * Load a range of values from a binary file.
  *
+ * The core reads the chunks of file-backed vectors from the file itself, this
+ * is only called for vectors R allocates outside of the core, ie. scalars.
+ *
  * Note: MappedMemory core should ensure that start and end never exceed the
  * actual size of the vector.
  *
@@ -22,10 +25,25 @@ int32_t __load_from_file(
     uintptr_t start, uintptr_t end,
     unsigned char* target);
 
-// int __save_to_file(
-//     UfoPopulateData user_data,
-//     uint64_t start, uint64_t end,
-//     void* target);
+/**
+ * Write a range of values back to a binary file, in place.
+ *
+ * Called by the UFO core for chunks that changed, as they are evicted or
+ * flushed, possibly from a thread other than R's.
+ *
+ * @param user_data Structure containing configuration information for the.
+ *                  loader (path, element size), must be ufo_file_source_data_t.
+ * @param start First index of the range.
+ * @param end Last index within the range.
+ * @param data The values to write.
+ * @return 0 on success, 45 if writing failed.
+ */
+int32_t __write_to_file(
+    void* user_data,
+    uintptr_t start, uintptr_t end,
+    const unsigned char* data);
+
 void __write_bytes_to_disk(const char *path, size_t size, const char *bytes);
 long __get_vector_length_from_file_or_die(const char * path, size_t element_size);
-FILE *__open_file_or_die(char const *path);
\ No newline at end of file
+FILE *__open_file_or_die(char const *path);
+int __open_file_for_writing_or_die(char const *path);
\ No newline at end of file
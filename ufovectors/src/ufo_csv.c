@@ -264,6 +264,7 @@ SEXP ufo_csv(SEXP/*STRSXP*/ path_sexp, SEXP/*LGLSXP*/ read_only_sexp, SEXP/*INTS
         REprintf("Creating UFOs to insert into data frame SEXP at %p\n\n", data_frame);
     }
 
+    ufo_source_t **sources = (ufo_source_t **) malloc(sizeof(ufo_source_t *) * csv_metadata->columns);
     for (size_t column = 0; column < csv_metadata->columns; column++) {
 
         ufo_csv_column_source_t *data = (ufo_csv_column_source_t *) malloc(sizeof(ufo_csv_column_source_t));
@@ -271,6 +272,11 @@ SEXP ufo_csv(SEXP/*STRSXP*/ path_sexp, SEXP/*LGLSXP*/ read_only_sexp, SEXP/*INTS
 
         source->population_function = load_column_from_csv;
         source->destructor_function = destroy_column;
+        source->writeback_function = NULL;
+        source->fill_function = NULL;
+        source->parallel_populate = false;
+        source->read_from_file = false;
+        source->description = path;
         source->data = (void*) data;
         source->vector_type = token_type_to_ufo_type(csv_metadata->column_types[column]);
         source->element_size = token_type_size(source->vector_type);
@@ -289,8 +295,16 @@ SEXP ufo_csv(SEXP/*STRSXP*/ path_sexp, SEXP/*LGLSXP*/ read_only_sexp, SEXP/*INTS
         data->tokenizer = tokenizer;
         data->initial_buffer_size = initial_buffer_size;
 
-        ufo_new_t ufo_new = (ufo_new_t) R_GetCCallable("ufos", "ufo_new");
-        SEXP/*UFO*/ vector = PROTECT(ufo_new(source));
+        sources[column] = source;
+    }
+
+    // every column in one round trip to the UFO core
+    ufo_new_vectors_t ufo_new_vectors = (ufo_new_vectors_t) R_GetCCallable("ufos", "ufo_new_vectors");
+    SEXP/*VECSXP*/ columns = PROTECT(ufo_new_vectors(sources, csv_metadata->columns));
+    free(sources);
+
+    for (size_t column = 0; column < csv_metadata->columns; column++) {
+        SEXP/*UFO*/ vector = VECTOR_ELT(columns, column);
         SET_VECTOR_ELT(data_frame, column, vector);
 
         if(add_class_to_columns) {
@@ -325,6 +339,6 @@ SEXP ufo_csv(SEXP/*STRSXP*/ path_sexp, SEXP/*LGLSXP*/ read_only_sexp, SEXP/*INTS
         REprintf("          row.names %p\n", row_names);
     }
 
-    UNPROTECT(1 + csv_metadata->columns + 2);
+    UNPROTECT(1 + 1 + 2);
     return data_frame;
 }
@@ -94,7 +94,7 @@ static int32_t __populate_empty(void* user_data, uintptr_t start, uintptr_t end,
 
 	case UFO_CPLX: {
 		Rcomplex *complex_vector = (Rcomplex *) target;
-		Rboolean initial_value = 
+		double initial_value = 
 			data.populate_with_na ? NA_REAL : 0;
 		for (size_t i = 0; i < size; i++) {
 			complex_vector[i].r = initial_value;
@@ -111,6 +111,45 @@ static int32_t __populate_empty(void* user_data, uintptr_t start, uintptr_t end,
 	return 1;
 }
 
+// Every element of an empty vector is the same, the core loads its chunks without populating them
+static int32_t __fill_empty(void* user_data, uintptr_t start, uintptr_t end, unsigned char* element) {
+	data_t data = *((data_t*) user_data);
+
+	switch (data.type) {
+	case UFO_VEC:
+		*((SEXP *) element) = R_NilValue;
+		return UFO_FILL_CONSTANT;
+
+	case UFO_STR:
+		*((SEXP *) element) = data.populate_with_na ? NA_STRING : R_BlankString;
+		return UFO_FILL_CONSTANT;
+
+	case UFO_LGL:
+		*((Rboolean *) element) = data.populate_with_na ? NA_LOGICAL : 0;
+		return data.populate_with_na ? UFO_FILL_CONSTANT : UFO_FILL_ZERO;
+
+	case UFO_INT:
+		*((int *) element) = data.populate_with_na ? NA_INTEGER : 0;
+		return data.populate_with_na ? UFO_FILL_CONSTANT : UFO_FILL_ZERO;
+
+	case UFO_REAL:
+		*((double *) element) = data.populate_with_na ? NA_REAL : 0;
+		return data.populate_with_na ? UFO_FILL_CONSTANT : UFO_FILL_ZERO;
+
+	case UFO_CPLX:
+		((Rcomplex *) element)->r = data.populate_with_na ? NA_REAL : 0;
+		((Rcomplex *) element)->i = data.populate_with_na ? NA_REAL : 0;
+		return data.populate_with_na ? UFO_FILL_CONSTANT : UFO_FILL_ZERO;
+
+	case UFO_RAW:
+		return UFO_FILL_ZERO;
+
+	default:
+		// populating reports the error
+		return UFO_FILL_DATA;
+	}
+}
+
 void __destroy_empty(void* user_data) {
     data_t *data = (data_t*) user_data;
 
@@ -130,6 +169,11 @@ SEXP ufo_empty(ufo_vector_type_t type, R_xlen_t size, bool populate_with_na, int
 
     source->population_function = &__populate_empty;
     source->destructor_function = &__destroy_empty;
+    source->writeback_function = NULL;
+    source->fill_function = &__fill_empty;
+    source->parallel_populate = false;
+    source->read_from_file = false;
+    source->description = NULL;
     source->vector_type = type;
     source->element_size = __get_element_size(type);
     source->vector_size = size;
@@ -9,6 +9,7 @@ typedef struct {
     size_t              vector_size;
     FILE*               file_handle;
     size_t              file_cursor;
+    int                 write_descriptor; /* -1 when read only */
 } ufo_file_source_data_t;
 
 
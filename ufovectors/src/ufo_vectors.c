@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <assert.h>
+#include <unistd.h>
 
 #define USE_RINTERNALS
 #include <R.h>
@@ -28,6 +29,9 @@ void __destroy(void* user_data) {
         REprintf("   element size: %li\n", data->element_size);
     }
     fclose(data->file_handle);
+    if (data->write_descriptor >= 0) {
+        close(data->write_descriptor);
+    }
     free((char *) data->path);
     free(data);
 }
@@ -46,6 +50,10 @@ ufo_source_t* __make_source_or_die(ufo_vector_type_t type, const char *path, int
 
     source->population_function = &__load_from_file;
     source->destructor_function = &__destroy;
+    // changes go back into the file as chunks are evicted, see ufo_flush
+    source->writeback_function = read_only ? NULL : &__write_to_file;
+    source->fill_function = NULL;
+    source->parallel_populate = false;
     source->data = (void*) data;
     source->vector_type = type;
     source->element_size = __get_element_size(type);
@@ -62,6 +70,13 @@ ufo_source_t* __make_source_or_die(ufo_vector_type_t type, const char *path, int
 
     data->file_handle = __open_file_or_die(path);
     data->file_cursor = 0;
+    data->write_descriptor = read_only ? -1 : __open_file_for_writing_or_die(path);
+
+    // the core reads chunks from the file itself, __load_from_file only fills in scalars
+    source->read_from_file = true;
+    source->file_descriptor = fileno(data->file_handle);
+    source->file_offset = 0;
+    source->description = path;
 
     return source;
 }